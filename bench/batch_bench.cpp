@@ -0,0 +1,114 @@
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../include/mysocket.hpp"
+
+#define BENCH_MESSAGES (256 * 1000)  // Сообщений в одном прогоне
+
+/**
+ * Число системных вызовов чтения процесса из /proc/self/io. Вызовы send()
+ * туда не попадают, поэтому отправки бенчмарк считает сам.
+ */
+uint64_t readSyscalls() {
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  uint64_t value;
+  while (io >> key >> value) {
+    if (key == "syscr:") {
+      return value;
+    }
+  }
+  return 0;
+}
+
+double cpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Передаёт BENCH_MESSAGES коротких сообщений через пару сокетов пакетами
+ * по batchSize штук и печатает число системных вызовов send() и read() и
+ * процессорное время на сообщение (обе стороны вместе).
+ */
+void runBatchSize(size_t batchSize) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    std::cerr << "socketpair failed" << std::endl;
+    return;
+  }
+  MySocket sender, receiver;
+  sender.setSocket(fds[0]);
+  receiver.setSocket(fds[1]);
+  sender.enableBatchSend();
+
+  Message message;
+  message = stringToMessage("/send general benchmark message", message);
+
+  uint64_t readsBefore = readSyscalls();
+  uint64_t sends = 0;
+  double cpuBefore = cpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread reader([&receiver] {
+    Message received;
+    for (size_t i = 0; i < BENCH_MESSAGES; ++i) {
+      if (!receiver.receiveMessage(received)) {
+        std::cerr << "receive failed at " << i << std::endl;
+        return;
+      }
+    }
+  });
+
+  for (size_t i = 0; i < BENCH_MESSAGES; ++i) {
+    if (batchSize > 1 && i % batchSize == 0) {
+      sender.beginBatch();
+    }
+    sender.sendMessage(message);
+    if (batchSize <= 1) {
+      ++sends;
+    } else if ((i + 1) % batchSize == 0) {
+      sender.flushBatch();
+      ++sends;
+    }
+  }
+  if (batchSize > 1 && BENCH_MESSAGES % batchSize != 0) {
+    sender.flushBatch();
+    ++sends;
+  }
+  reader.join();
+
+  double wallSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  double cpu = cpuSeconds() - cpuBefore;
+  uint64_t reads = readSyscalls() - readsBefore;
+
+  std::cout << std::setw(6) << batchSize << std::fixed << std::setprecision(3)
+            << std::setw(12) << static_cast<double>(sends) / BENCH_MESSAGES
+            << std::setw(12) << static_cast<double>(reads) / BENCH_MESSAGES
+            << std::setprecision(0) << std::setw(12)
+            << cpu * 1e9 / BENCH_MESSAGES << std::setw(12)
+            << BENCH_MESSAGES / wallSeconds << std::endl;
+}
+
+int main() {
+  std::cout << "messages per run: " << BENCH_MESSAGES << std::endl;
+  std::cout << std::setw(6) << "batch" << std::setw(12) << "sends/msg"
+            << std::setw(12) << "reads/msg" << std::setw(12) << "cpu ns/msg"
+            << std::setw(12) << "msg/s" << std::endl;
+  for (size_t batchSize : {1, 16, 256}) {
+    runBatchSize(batchSize);
+  }
+  return 0;
+}
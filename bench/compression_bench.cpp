@@ -0,0 +1,166 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/compression.hpp"
+#include "../include/history_index.hpp"
+#include "../include/mysocket.hpp"
+
+#define BENCH_HISTORY_DIRECTORY "./program/channels/history/"
+#define BENCH_SYNTHETIC_LINES 20000  // Строк истории, если дампов нет
+
+using Frames = std::vector<std::vector<uint8_t>>;
+
+/**
+ * Строки дампов истории без префикса "#<seq>@<ms> ". Если файлы не указаны,
+ * берутся все *_history.txt сервера, а при их отсутствии - сгенерированная
+ * переписка.
+ */
+std::vector<std::string> loadHistory(int argc, char *argv[],
+                                     std::string &source) {
+  std::vector<std::string> paths(argv + 1, argv + argc);
+  std::error_code ec;
+  if (paths.empty()) {
+    for (const auto &entry :
+         std::filesystem::directory_iterator(BENCH_HISTORY_DIRECTORY, ec)) {
+      std::string path = entry.path().string();
+      if (path.size() > 12 &&
+          path.compare(path.size() - 12, 12, "_history.txt") == 0) {
+        paths.push_back(path);
+      }
+    }
+  }
+
+  std::vector<std::string> lines;
+  for (const std::string &path : paths) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      uint64_t seq, timestampMs;
+      lines.push_back(line.substr(parseRecordPrefix(line, seq, timestampMs)));
+    }
+  }
+  if (!lines.empty()) {
+    source = std::to_string(paths.size()) + " history file(s)";
+    return lines;
+  }
+
+  const char *words[] = {"привет", "как",  "дела",   "сервер", "канал",
+                         "завтра", "встреча", "ok",  "the",    "build",
+                         "failed", "again", "давай", "созвонимся", "в",
+                         "пять",   "файл",  "готов", "спасибо", "?"};
+  std::mt19937 random(42);
+  for (int i = 0; i < BENCH_SYNTHETIC_LINES; ++i) {
+    std::string line = "[12:" + std::to_string(10 + i % 50) + ":00] " +
+                       std::to_string(random() % 50) + ":";
+    for (int n = 1 + random() % 12; n > 0; --n) {
+      line += " ";
+      line += words[random() % 20];
+    }
+    lines.push_back(line);
+  }
+  source = "synthetic history";
+  return lines;
+}
+
+// Тела кадров: отдельные сообщения (/send) и страницы ответа /read
+Frames messageFrames(const std::vector<std::string> &lines) {
+  Frames frames;
+  for (const std::string &line : lines) {
+    frames.emplace_back(line.begin(), line.end());
+  }
+  return frames;
+}
+
+Frames pageFrames(const std::vector<std::string> &lines) {
+  Frames frames;
+  std::string page;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    page += lines[i];
+    page += '\n';
+    if ((i + 1) % HISTORY_PAGE_SIZE == 0 || i + 1 == lines.size()) {
+      frames.emplace_back(page.begin(), page.end());
+      page.clear();
+    }
+  }
+  return frames;
+}
+
+/**
+ * Байты на проводе (с заголовками) и время сжатия/распаковки на кадр при
+ * заданных уровне zlib и пороге размера тела.
+ */
+void runCase(const Frames &frames, int level, size_t threshold,
+             uint64_t rawBytes) {
+  uint64_t wireBytes = 0;
+  size_t compressedFrames = 0;
+  double compressSeconds = 0, decompressSeconds = 0;
+  std::vector<uint8_t> packed, unpacked;
+
+  for (const std::vector<uint8_t> &body : frames) {
+    wireBytes += MESSAGE_HEADER_SIZE;
+    if (body.size() < threshold) {
+      wireBytes += body.size();
+      continue;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool smaller = compressBody(body, packed, level);
+    auto middle = std::chrono::steady_clock::now();
+    compressSeconds += std::chrono::duration<double>(middle - start).count();
+    if (!smaller) {
+      wireBytes += body.size();
+      continue;
+    }
+    decompressBody(packed, unpacked);
+    decompressSeconds += std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - middle)
+                             .count();
+    wireBytes += packed.size();
+    ++compressedFrames;
+  }
+
+  std::cout << std::setw(6) << level << std::setw(10) << threshold
+            << std::setw(12) << wireBytes << std::fixed << std::setprecision(3)
+            << std::setw(10) << static_cast<double>(wireBytes) / rawBytes
+            << std::setw(12) << compressedFrames << std::setprecision(0)
+            << std::setw(14) << compressSeconds * 1e9 / frames.size()
+            << std::setw(14) << decompressSeconds * 1e9 / frames.size()
+            << std::endl;
+}
+
+void runWorkload(const std::string &name, const Frames &frames) {
+  uint64_t rawBytes = 0;
+  for (const std::vector<uint8_t> &body : frames) {
+    rawBytes += MESSAGE_HEADER_SIZE + body.size();
+  }
+  std::cout << std::endl
+            << name << ": " << frames.size() << " frames, " << rawBytes
+            << " bytes uncompressed" << std::endl;
+  std::cout << std::setw(6) << "level" << std::setw(10) << "threshold"
+            << std::setw(12) << "wire bytes" << std::setw(10) << "ratio"
+            << std::setw(12) << "compressed" << std::setw(14)
+            << "deflate ns/fr" << std::setw(14) << "inflate ns/fr"
+            << std::endl;
+  for (int level : {1, 6, 9}) {
+    for (size_t threshold : {64, 256, 1024}) {
+      runCase(frames, level, threshold, rawBytes);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string source;
+  std::vector<std::string> lines = loadHistory(argc, argv, source);
+  std::cout << "source: " << source << ", " << lines.size() << " lines"
+            << std::endl;
+  runWorkload("single messages", messageFrames(lines));
+  runWorkload("/read pages of " + std::to_string(HISTORY_PAGE_SIZE),
+              pageFrames(lines));
+  return 0;
+}
@@ -0,0 +1,306 @@
+#include <opus/opus.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/audio_mix.hpp"
+#include "../include/auth_pool.hpp"
+#include "../include/database.hpp"
+#include "../include/mysocket.hpp"
+
+#define BENCH_MIN_SECONDS 0.2    // Минимальная длительность одного замера
+#define BENCH_ROUNDS 5           // Замеров на бенчмарк, в результат - медиана
+#define BENCH_TEXT_SIZE 1024     // Тело текстового кадра
+#define BENCH_HISTORY_LINES 100000
+#define BENCH_USERS 1000000
+#define BENCH_MIX_STREAMS 4      // Голосов в одном кадре микширования
+#define BENCH_AUDIO_RATE 48000
+#define BENCH_AUDIO_CHANNELS 2
+#define BENCH_AUDIO_FRAMES 480   // 10 мс, как кадр голоса клиента
+
+/**
+ * Микробенчмарки горячих путей: кадры протокола, разбор истории и списка
+ * пользователей, хеширование паролей, микширование и Opus. Каждая строка
+ * вывода - JSON-объект, поэтому результаты двух сборок сравниваются diff
+ * или jq. Аргументы - подстроки имён, запускаются только совпавшие.
+ *
+ * Файлы базы генерируются во временном каталоге, рабочие данные сервера
+ * не затрагиваются.
+ */
+
+// Не даёт компилятору выбросить результат
+template <typename T>
+void keep(T &&value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+std::vector<std::string> filters;
+
+bool selected(const std::string &name) {
+  if (filters.empty()) {
+    return true;
+  }
+  for (const std::string &filter : filters) {
+    if (name.find(filter) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * body(n) выполняет операцию n раз. Число повторов растёт, пока
+ * замер не займёт BENCH_MIN_SECONDS; затем BENCH_ROUNDS замеров,
+ * печатаются медиана, минимум и максимум наносекунд на операцию.
+ */
+void run(const std::string &name, const std::function<void(size_t)> &body) {
+  if (!selected(name)) {
+    return;
+  }
+  using Clock = std::chrono::steady_clock;
+  size_t iterations = 1;
+  while (true) {
+    auto start = Clock::now();
+    body(iterations);
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds >= BENCH_MIN_SECONDS) {
+      break;
+    }
+    // С запасом, но не больше чем в 100 раз за шаг
+    size_t factor = 100;
+    if (seconds > 0) {
+      factor = std::min<size_t>(
+          factor,
+          static_cast<size_t>(std::ceil(1.2 * BENCH_MIN_SECONDS / seconds)));
+    }
+    iterations *= std::max<size_t>(factor, 2);
+  }
+
+  std::vector<double> nsPerOp;
+  for (int round = 0; round < BENCH_ROUNDS; ++round) {
+    auto start = Clock::now();
+    body(iterations);
+    nsPerOp.push_back(
+        std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+        iterations);
+  }
+  std::sort(nsPerOp.begin(), nsPerOp.end());
+  std::printf(
+      "{\"name\":\"%s\",\"iterations\":%zu,\"rounds\":%d,"
+      "\"ns_per_op\":%.1f,\"ns_min\":%.1f,\"ns_max\":%.1f}\n",
+      name.c_str(), iterations, BENCH_ROUNDS, nsPerOp[nsPerOp.size() / 2],
+      nsPerOp.front(), nsPerOp.back());
+  std::fflush(stdout);
+}
+
+void benchMessages() {
+  Message message;
+  message = stringToMessage(std::string(BENCH_TEXT_SIZE, 'x'), message);
+  message.header.requestId = 7;
+  std::vector<uint8_t> buffer;
+  message.serialize(buffer);
+
+  run("message_serialize_1k", [&](size_t n) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i < n; ++i) {
+      message.serialize(out);
+      keep(out);
+    }
+  });
+  run("message_deserialize_1k", [&](size_t n) {
+    Message parsed;
+    for (size_t i = 0; i < n; ++i) {
+      parsed.deserialize(buffer);
+      keep(parsed);
+    }
+  });
+
+  // Разбор потока кадров: писатель в отдельном потоке
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    std::cerr << "socketpair failed" << std::endl;
+    return;
+  }
+  MySocket receiver;
+  receiver.setSocket(fds[1]);
+  std::vector<uint8_t> frames;
+  for (int i = 0; i < 64; ++i) {
+    frames.insert(frames.end(), buffer.begin(), buffer.end());
+  }
+  run("receive_message_socketpair_1k", [&](size_t n) {
+    size_t batches = (n + 63) / 64;
+    std::thread writer([&] {
+      for (size_t i = 0; i < batches; ++i) {
+        size_t sent = 0;
+        while (sent < frames.size()) {
+          ssize_t written =
+              write(fds[0], frames.data() + sent, frames.size() - sent);
+          if (written <= 0) {
+            return;
+          }
+          sent += written;
+        }
+      }
+    });
+    Message received;
+    for (size_t i = 0; i < batches * 64; ++i) {
+      if (!receiver.receiveMessage(received)) {
+        break;
+      }
+    }
+    writer.join();
+  });
+  close(fds[0]);
+}
+
+// Генерирует users.txt и историю канала в текущем (временном) каталоге
+void writeDatabaseFiles() {
+  std::filesystem::create_directories("./users");
+  std::filesystem::create_directories("./channels/history");
+  {
+    std::ofstream users("./users/users.txt");
+    char line[256];
+    for (int i = 0; i < BENCH_USERS; ++i) {
+      int length = std::snprintf(
+          line, sizeof(line),
+          "%08x-0000-4000-8000-%012x:user%d:4:login%d:pbkdf2$100000$"
+          "00112233445566778899aabbccddeeff$"
+          "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff\n",
+          i, i, i, i);
+      users.write(line, length);
+    }
+  }
+  std::ofstream history("./channels/history/bench_history.txt");
+  const char *words[] = {"привет", "как", "дела", "build", "failed",
+                         "again",  "ok",  "файл", "готов", "спасибо"};
+  uint64_t timestampMs = 1700000000000ULL;
+  for (int i = 0; i < BENCH_HISTORY_LINES; ++i) {
+    history << "#" << i + 1 << "@" << timestampMs + i * 1000ULL << " [12:"
+            << 10 + i % 50 << ":00] " << i % 1000 << ": ";
+    for (int word = 0; word < 3 + i % 8; ++word) {
+      history << words[(i + word * 7) % 10] << ' ';
+    }
+    history << "#" << i << "\n";
+  }
+}
+
+void benchDatabase() {
+  if (!selected("nicknames_file_1m") &&
+      !selected("channels_history_file_100k")) {
+    return;
+  }
+  char directory[] = "/tmp/micro_bench_XXXXXX";
+  if (mkdtemp(directory) == nullptr) {
+    std::cerr << "mkdtemp failed" << std::endl;
+    return;
+  }
+  std::filesystem::path previous = std::filesystem::current_path();
+  std::filesystem::current_path(directory);
+  {
+    DataBase db;
+    writeDatabaseFiles();
+    run("nicknames_file_1m", [&](size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        keep(db.nicknamesFile());
+      }
+    });
+    run("channels_history_file_100k", [&](size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        keep(db.channelsHistoryFile("bench"));
+      }
+    });
+  }
+  std::filesystem::current_path(previous);
+  std::error_code ec;
+  std::filesystem::remove_all(directory, ec);
+}
+
+void benchPasswords() {
+  AuthWorkerContext context;
+  std::string stored = makePasswordHash(context, "Passw0rd!x");
+  run("hash_password_pbkdf2", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      keep(makePasswordHash(context, "Passw0rd!x"));
+    }
+  });
+  run("check_password_pbkdf2", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      keep(checkPasswordHash(context, "Passw0rd!x", stored));
+    }
+  });
+}
+
+void benchAudio() {
+  size_t samples = BENCH_AUDIO_FRAMES * BENCH_AUDIO_CHANNELS;
+  std::vector<std::vector<int16_t>> streams(BENCH_MIX_STREAMS,
+                                            std::vector<int16_t>(samples));
+  std::vector<int16_t *> buffers;
+  for (size_t s = 0; s < streams.size(); ++s) {
+    for (size_t i = 0; i < samples; ++i) {
+      streams[s][i] = static_cast<int16_t>(
+          12000 * std::sin(2 * M_PI * (220 * (s + 1)) *
+                           (i / BENCH_AUDIO_CHANNELS) / BENCH_AUDIO_RATE));
+    }
+    buffers.push_back(streams[s].data());
+  }
+  std::vector<int16_t> mixed(samples);
+  run("mix_audio_buffers_4x10ms", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      mix_audio_buffers(buffers, mixed.data(), BENCH_AUDIO_FRAMES,
+                        BENCH_AUDIO_CHANNELS);
+      keep(mixed);
+    }
+  });
+
+  int error;
+  OpusEncoder *encoder = opus_encoder_create(
+      BENCH_AUDIO_RATE, BENCH_AUDIO_CHANNELS, OPUS_APPLICATION_VOIP, &error);
+  OpusDecoder *decoder =
+      opus_decoder_create(BENCH_AUDIO_RATE, BENCH_AUDIO_CHANNELS, &error);
+  if (encoder == nullptr || decoder == nullptr) {
+    std::cerr << "Failed to create Opus codec" << std::endl;
+    return;
+  }
+  std::vector<unsigned char> packet(4000);
+  opus_int32 packetLength =
+      opus_encode(encoder, mixed.data(), BENCH_AUDIO_FRAMES, packet.data(),
+                  static_cast<opus_int32>(packet.size()));
+  run("opus_encode_10ms", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      keep(opus_encode(encoder, mixed.data(), BENCH_AUDIO_FRAMES,
+                       packet.data(), static_cast<opus_int32>(packet.size())));
+    }
+  });
+  std::vector<int16_t> decoded(samples);
+  run("opus_decode_10ms", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      keep(opus_decode(decoder, packet.data(), packetLength, decoded.data(),
+                       BENCH_AUDIO_FRAMES, 0));
+    }
+  });
+  opus_encoder_destroy(encoder);
+  opus_decoder_destroy(decoder);
+}
+
+int main(int argc, char *argv[]) {
+  filters.assign(argv + 1, argv + argc);
+  benchMessages();
+  benchDatabase();
+  benchPasswords();
+  benchAudio();
+  return 0;
+}
@@ -1,71 +1,137 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "../include/database.hpp"
 
+#define COMMAND_MAX_TOKENS 8   // Слова сверх этого числа доступны через rest()
+#define COMMAND_TABLE_SIZE 16  // Размер таблицы диспетчеризации
+
+/**
+ * @brief Слова команды в виде string_view на исходную строку
+ *
+ * @details
+ * Разбиение не выделяет память. Строка, из которой получены слова, должна
+ * жить дольше CommandTokens.
+ */
+struct CommandTokens {
+  std::string_view input;
+  std::array<std::string_view, COMMAND_MAX_TOKENS> words;
+  size_t count = 0;
+
+  size_t size() const { return count; }
+  std::string_view operator[](size_t index) const { return words[index]; }
+  // Исходный текст начиная со слова index (например, текст для /send)
+  std::string_view rest(size_t index) const;
+};
+
+void tokenizeCommand(std::string_view input, CommandTokens &tokens);
+
 class CommandHandler {
  public:
-  virtual std::string handleCommand(std::vector<std::string> &command,
+  virtual std::string handleCommand(const CommandTokens &command,
                                     DataBase &db, User &user) = 0;
 
  private:
-  virtual bool validateCommand(std::vector<std::string> &command) = 0;
+  virtual bool validateCommand(const CommandTokens &command) = 0;
 };
 
 class ReadCommand : public CommandHandler {
  public:
-  std::string handleCommand(std::vector<std::string> &command, DataBase &db,
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
                             User &user) override;
 
  private:
-  bool validateCommand(std::vector<std::string> &command) override;
-  void parseReadCommand(std::vector<std::string> &command,
-                        std::string &channel);
-  std::string readCommandHistory(DataBase &db, User &user);
+  bool validateCommand(const CommandTokens &command) override;
+  void parseReadCommand(const CommandTokens &command,
+                        std::string &channel, std::string &range,
+                        std::string &position);
+  std::string readHistoryRange(DataBase &db, User &user,
+                               const std::string &channel,
+                               const std::string &range,
+                               const std::string &position);
+  std::string readCommandHistory(DataBase &db, User &user,
+                                 bool withSequence = false);
 };
 
 class SendCommand : public CommandHandler {
  public:
-  std::string handleCommand(std::vector<std::string> &command, DataBase &db,
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
                             User &user) override;
 
  private:
-  bool validateCommand(std::vector<std::string> &command) override;
-  void parseSendCommand(std::vector<std::string> &command, std::string &channel,
+  bool validateCommand(const CommandTokens &command) override;
+  void parseSendCommand(const CommandTokens &command, std::string &channel,
                         std::string &message);
 };
 
 class JoinCommand : public CommandHandler {
  public:
-  std::string handleCommand(std::vector<std::string> &command, DataBase &db,
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
                             User &user) override;
 
  private:
-  bool validateCommand(std::vector<std::string> &command) override;
-  void parseJoinCommand(std::vector<std::string> &command,
+  bool validateCommand(const CommandTokens &command) override;
+  void parseJoinCommand(const CommandTokens &command,
                         std::string &channel);
 };
 
 class ExitCommand : public CommandHandler {
  public:
-  std::string handleCommand(std::vector<std::string> &command, DataBase &db,
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
                             User &user) override;
 
  private:
-  bool validateCommand(std::vector<std::string> &command) override;
-  void parseExitCommand(std::vector<std::string> &command,
+  bool validateCommand(const CommandTokens &command) override;
+  void parseExitCommand(const CommandTokens &command,
                         std::string &channel);
 };
 
 class NickCommand : public CommandHandler {
  public:
-  std::string handleCommand(std::vector<std::string> &command, DataBase &db,
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
                             User &user) override;
 
  private:
-  bool validateCommand(std::vector<std::string> &command) override;
-  void parseNickCommand(std::vector<std::string> &command,
+  bool validateCommand(const CommandTokens &command) override;
+  void parseNickCommand(const CommandTokens &command,
                         std::string &newNnickname);
-};
\ No newline at end of file
+};
+
+class SearchCommand : public CommandHandler {
+ public:
+  std::string handleCommand(const CommandTokens &command, DataBase &db,
+                            User &user) override;
+
+ private:
+  bool validateCommand(const CommandTokens &command) override;
+  void parseSearchCommand(const CommandTokens &command,
+                          std::string &channel,
+                          std::vector<std::string> &terms, DataBase &db);
+};
+
+enum class CommandId {
+  READ,
+  SEND,
+  JOIN,
+  SEARCH,
+  EXIT,
+  NICK,
+  CONNECT,
+  CHANNELS,
+  TIME_ON,
+  TIME_OFF,
+  VOICEMAIL_ON,
+};
+
+struct CommandEntry {
+  std::string_view name;
+  CommandId id;
+  CommandHandler *handler;  // nullptr - команда обрабатывается сервером
+};
+
+// Поиск по совершенной хеш-таблице: одно сравнение строк на команду
+const CommandEntry *findCommand(std::string_view name);
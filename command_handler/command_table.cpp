@@ -0,0 +1,89 @@
+#include "command_handler.hpp"
+
+std::string_view CommandTokens::rest(size_t index) const {
+  if (index >= count) {
+    return {};
+  }
+  std::string_view remainder =
+      input.substr(words[index].data() - input.data());
+  size_t end = remainder.find_last_not_of(" \t\r\n");
+  return remainder.substr(0, end + 1);
+}
+
+void tokenizeCommand(std::string_view input, CommandTokens &tokens) {
+  tokens.input = input;
+  tokens.count = 0;
+  size_t position = 0;
+  while (tokens.count < COMMAND_MAX_TOKENS) {
+    size_t start = input.find_first_not_of(" \t\r\n", position);
+    if (start == std::string_view::npos) {
+      break;
+    }
+    size_t end = input.find_first_of(" \t\r\n", start);
+    if (end == std::string_view::npos) {
+      end = input.size();
+    }
+    tokens.words[tokens.count++] = input.substr(start, end - start);
+    position = end;
+  }
+}
+
+// Обработчики не хранят состояния, поэтому один экземпляр на все потоки
+static ReadCommand readCommand;
+static SendCommand sendCommand;
+static JoinCommand joinCommand;
+static SearchCommand searchCommand;
+static ExitCommand exitCommand;
+static NickCommand nickCommand;
+
+// Коэффициенты подобраны так, что у имён команд нет коллизий
+static constexpr size_t commandSlot(std::string_view name) {
+  return (name.size() * 2 + static_cast<unsigned char>(name[1]) * 5 +
+          static_cast<unsigned char>(name.back())) %
+         COMMAND_TABLE_SIZE;
+}
+
+static constexpr std::array<std::string_view, 11> commandNames = {
+    "/read",    "/send",     "/join",    "/search",
+    "/exit",    "/nick",     "/connect", "/channels",
+    "/time_on", "/time_off", "/voicemail_on"};
+
+static constexpr bool slotsAreUnique() {
+  for (size_t i = 0; i < commandNames.size(); ++i) {
+    for (size_t j = i + 1; j < commandNames.size(); ++j) {
+      if (commandSlot(commandNames[i]) == commandSlot(commandNames[j])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+static_assert(slotsAreUnique(), "command names collide in the dispatch table");
+
+static const std::array<CommandEntry, COMMAND_TABLE_SIZE> commandTable = [] {
+  std::array<CommandEntry, COMMAND_TABLE_SIZE> table{};
+  auto put = [&table](std::string_view name, CommandId id,
+                      CommandHandler *handler) {
+    table[commandSlot(name)] = {name, id, handler};
+  };
+  put("/read", CommandId::READ, &readCommand);
+  put("/send", CommandId::SEND, &sendCommand);
+  put("/join", CommandId::JOIN, &joinCommand);
+  put("/search", CommandId::SEARCH, &searchCommand);
+  put("/exit", CommandId::EXIT, &exitCommand);
+  put("/nick", CommandId::NICK, &nickCommand);
+  put("/connect", CommandId::CONNECT, nullptr);
+  put("/channels", CommandId::CHANNELS, nullptr);
+  put("/time_on", CommandId::TIME_ON, nullptr);
+  put("/time_off", CommandId::TIME_OFF, nullptr);
+  put("/voicemail_on", CommandId::VOICEMAIL_ON, nullptr);
+  return table;
+}();
+
+const CommandEntry *findCommand(std::string_view name) {
+  if (name.size() < 2) {
+    return nullptr;
+  }
+  const CommandEntry &entry = commandTable[commandSlot(name)];
+  return entry.name == name ? &entry : nullptr;
+}
@@ -1,6 +1,6 @@
 #include "command_handler.hpp"
 
-std::string ExitCommand::handleCommand(std::vector<std::string> &command,
+std::string ExitCommand::handleCommand(const CommandTokens &command,
                                        DataBase &db, User &user) {
   if (!validateCommand(command)) {
     return "Error command, usage: exit <channel>";
@@ -8,16 +8,16 @@ std::string ExitCommand::handleCommand(std::vector<std::string> &command,
   std::string channel;
   parseExitCommand(command, channel);
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_channels = db.channelsFile();
-    db.database_channels_members = db.channelsMembersFile(channel);
+    db.database_channels_members = db.channelMembers(channel);
   }
 
   if (db.ChannelExists(channel)) {
-    if (db.MemberInChannel(user.id)) {
+    if (db.MemberInChannel(user.localId)) {
       {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        db.deleteChannelMember(user.id, channel);
+        std::lock_guard<MeteredMutex> lock(dbMutex);
+        db.deleteChannelMember(user.localId, channel);
       }
       return "You have left the channel";
     }
@@ -26,11 +26,11 @@ std::string ExitCommand::handleCommand(std::vector<std::string> &command,
   return "Channel not found";
 }
 
-bool ExitCommand::validateCommand(std::vector<std::string> &command) {
+bool ExitCommand::validateCommand(const CommandTokens &command) {
   return command.size() == 2;
 }
 
-void ExitCommand::parseExitCommand(std::vector<std::string> &command,
+void ExitCommand::parseExitCommand(const CommandTokens &command,
                                    std::string &channel) {
   channel = command[1];
 }
@@ -1,6 +1,6 @@
 #include "command_handler.hpp"
 
-std::string JoinCommand::handleCommand(std::vector<std::string>& command,
+std::string JoinCommand::handleCommand(const CommandTokens &command,
                                        DataBase& db, User& user) {
   if (!validateCommand(command)) {
     return "Error command, use: join <channel>";
@@ -8,28 +8,28 @@ std::string JoinCommand::handleCommand(std::vector<std::string>& command,
   std::string channel;
   parseJoinCommand(command, channel);
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_channels = db.channelsFile();
-    db.database_channels_members = db.channelsMembersFile(channel);
+    db.database_channels_members = db.channelMembers(channel);
   }
   if (db.ChannelExists(channel)) {
-    if (db.MemberInChannel(user.id)) {
+    if (db.MemberInChannel(user.localId)) {
       return "You already on this channel";
     }
     {
-      std::lock_guard<std::mutex> lock(dbMutex);
-      db.addChannelMember(user.id, channel);
+      std::lock_guard<MeteredMutex> lock(dbMutex);
+      db.addChannelMember(user.localId, channel);
     }
     return "You have joined the channel";
   }
   return "Channel does not exist";
 }
 
-void JoinCommand::parseJoinCommand(std::vector<std::string>& command,
+void JoinCommand::parseJoinCommand(const CommandTokens &command,
                                    std::string& channel) {
   channel = command[1];
 }
 
-bool JoinCommand::validateCommand(std::vector<std::string>& command) {
+bool JoinCommand::validateCommand(const CommandTokens &command) {
   return command.size() == 2;
 }
\ No newline at end of file
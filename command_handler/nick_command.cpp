@@ -1,6 +1,6 @@
 #include "command_handler.hpp"
 
-std::string NickCommand::handleCommand(std::vector<std::string> &command,
+std::string NickCommand::handleCommand(const CommandTokens &command,
                                        DataBase &db, User &user) {
   if (!validateCommand(command)) {
     return "Error command, usage: /nick <new_nickname>";
@@ -9,18 +9,24 @@ std::string NickCommand::handleCommand(std::vector<std::string> &command,
   parseNickCommand(command, newNickname);
 
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    // Ник уникален так же, как при регистрации; свой текущий ник не занят
+    LocalId owner = db.userRegistry.findNickname(newNickname);
+    if (owner != INVALID_LOCAL_ID && owner != user.localId) {
+      return "Nickname already exists";
+    }
     db.changeNickname(user.id, newNickname);
   }
+  user.nickname = newNickname;
 
   return newNickname;
 }
 
-bool NickCommand::validateCommand(std::vector<std::string> &command) {
+bool NickCommand::validateCommand(const CommandTokens &command) {
   return command.size() == 2;
 }
 
-void NickCommand::parseNickCommand(std::vector<std::string> &command,
+void NickCommand::parseNickCommand(const CommandTokens &command,
                                    std::string &newNnickname) {
   newNnickname = command[1];
 }
\ No newline at end of file
@@ -1,24 +1,34 @@
+#include <charconv>
+
 #include "command_handler.hpp"
 
-std::string ReadCommand::handleCommand(std::vector<std::string>& command,
+std::string ReadCommand::handleCommand(const CommandTokens &command,
                                        DataBase& db, User& user) {
   if (!validateCommand(command)) {
-    return "Error command, use: read <channel>";
+    return "Error command, use: read <channel> [since <seq|time> | before "
+           "<seq>]";
   }
 
-  std::string channel;
-  parseReadCommand(command, channel);
+  std::string channel, range, position;
+  parseReadCommand(command, channel, range, position);
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_channels = db.channelsFile();
-    db.database_channels_members = db.channelsMembersFile(channel);
+    db.database_channels_members = db.channelMembers(channel);
   }
   // logMessage("1");
   if (db.ChannelExists(channel)) {
     std::cout << "Channel found: " << channel << std::endl;
 
-    if (db.MemberInChannel(user.id)) {
-      std::lock_guard<std::mutex> lock(dbMutex);
+    if (db.MemberInChannel(user.localId)) {
+      std::lock_guard<MeteredMutex> lock(dbMutex);
+      if (!range.empty()) {
+        return readHistoryRange(db, user, channel, range, position);
+      }
+      std::string cached;
+      if (db.historyCache.get(channel, user.timeFlag, cached)) {
+        return cached;
+      }
       logMessage("Start read file: " + channel, SERVER_LOG_FILE);
       logMessage("Start read", SERVER_LOG_FILE);
       db.database_channels_history = db.channelsHistoryFile(channel);
@@ -30,7 +40,9 @@ std::string ReadCommand::handleCommand(std::vector<std::string>& command,
         return "Channel is empty";
       }
 
-      return readCommandHistory(db, user);
+      std::string answer = readCommandHistory(db, user);
+      db.historyCache.put(channel, user.timeFlag, answer);
+      return answer;
     }
 
     return "You don't have access to this channel, use join <channel> for "
@@ -40,37 +52,67 @@ std::string ReadCommand::handleCommand(std::vector<std::string>& command,
   return "Channel not found, use /channels to see available channels";
 }
 
-bool ReadCommand::validateCommand(std::vector<std::string>& command) {
-  return command.size() == 2;
+bool ReadCommand::validateCommand(const CommandTokens &command) {
+  return command.size() == 2 ||
+         (command.size() == 4 &&
+          (command[2] == "since" || command[2] == "before"));
 }
 
-void ReadCommand::parseReadCommand(std::vector<std::string>& command,
-                                   std::string& channel) {
+void ReadCommand::parseReadCommand(const CommandTokens &command,
+                                   std::string& channel, std::string& range,
+                                   std::string& position) {
   channel = command[1];
+  if (command.size() == 4) {
+    range = command[2];
+    position = command[3];
+  }
+}
+
+std::string ReadCommand::readHistoryRange(DataBase& db, User& user,
+                                          const std::string& channel,
+                                          const std::string& range,
+                                          const std::string& position) {
+  // Номер записи можно указывать как в ответе: "#12"
+  std::string sequence = position[0] == '#' ? position.substr(1) : position;
+  // Без исключений: слишком большой номер - ошибка команды, а не падение
+  uint64_t seq = 0;
+  auto [end, error] =
+      std::from_chars(sequence.data(), sequence.data() + sequence.size(), seq);
+  bool isSequence = !sequence.empty() && error == std::errc() &&
+                    end == sequence.data() + sequence.size();
+  uint64_t timestampMs = 0;
+  if (range == "since" && isSequence) {
+    db.database_channels_history = db.channelsHistorySince(channel, seq);
+  } else if (range == "since" && parseHistoryTime(position, timestampMs)) {
+    db.database_channels_history =
+        db.channelsHistorySinceTime(channel, timestampMs);
+  } else if (range == "before" && isSequence) {
+    db.database_channels_history = db.channelsHistoryBefore(channel, seq);
+  } else {
+    return "Error command, use: read <channel> since <seq|HH:MM:SS|"
+           "YYYY-MM-DDTHH:MM:SS> or read <channel> before <seq>";
+  }
+
+  if (db.database_channels_history.empty()) {
+    return "No messages";
+  }
+  return readCommandHistory(db, user, true);
 }
 
-std::string ReadCommand::readCommandHistory(DataBase& db, User& user) {
+std::string ReadCommand::readCommandHistory(DataBase& db, User& user,
+                                            bool withSequence) {
   std::ostringstream oss;
   bool first = true;
 
-  // Загружаем пользователей, чтобы `db.database_names` был актуальным
-  db.database_names = db.nicknamesFile();
-
   for (const History& line : db.database_channels_history) {
     logMessage("Read: " + line.time, SERVER_LOG_FILE);
 
-    if (!line.id.empty()) {
-      // Ищем пользователя по id
-      auto userIt =
-          std::find_if(db.database_names.begin(), db.database_names.end(),
-                       [&](const User& u) { return u.id == line.id; });
-
-      std::string nickname =
-          line.id;  // По умолчанию используем id, если nickname не найден
-      if (userIt != db.database_names.end()) {
-        nickname = userIt->nickname;
-      } else {
-        logMessage("User not found for id: " + line.id, SERVER_LOG_FILE);
+    if (line.userId != INVALID_LOCAL_ID) {
+      // Ник по номеру пользователя; по умолчанию выводим сам номер
+      std::string nickname = db.userRegistry.nickname(line.userId);
+      if (nickname.empty()) {
+        nickname = std::to_string(line.userId);
+        logMessage("User not found for id: " + nickname, SERVER_LOG_FILE);
       }
 
       logMessage(
@@ -83,24 +125,11 @@ std::string ReadCommand::readCommandHistory(DataBase& db, User& user) {
         oss << '\n';
       }
 
-      if (user.timeFlag) {
-        oss << "[" << line.time << "] ";
-      }
-
-      oss << nickname << ": ";
-
-      if (line.isAudio) {
-        oss << "[Voicemail_ID: " << line.voicemailID
-            << ", Duration: " << line.duration << "]";
-      } else if (line.isFile) {
-        oss << "[File_ID: " << line.fileID << ", Name: " << line.filename;
-        if (!line.extension.empty()) {
-          oss << ", Extension: " << line.extension;
-        }
-        oss << ", Size: " << line.fileSize << " bytes]";
-      } else {
-        oss << line.message;
+      // Номер записи нужен клиенту, чтобы продолжить чтение с него
+      if (withSequence) {
+        oss << "#" << line.seq << " ";
       }
+      oss << renderHistoryLine(line, nickname, user.timeFlag);
 
       first = false;
 
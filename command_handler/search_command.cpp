@@ -0,0 +1,88 @@
+#include "command_handler.hpp"
+
+std::string SearchCommand::handleCommand(const CommandTokens &command,
+                                         DataBase &db, User &user) {
+  if (!validateCommand(command)) {
+    return "Error command, use: search <channel> <terms>";
+  }
+
+  std::string channel;
+  std::vector<std::string> terms;
+  {
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    parseSearchCommand(command, channel, terms, db);
+    db.database_channels = db.channelsFile();
+    db.database_channels_members = db.channelMembers(channel);
+  }
+
+  if (!db.ChannelExists(channel)) {
+    return "Channel not found, use /channels to see available channels";
+  }
+  if (!db.MemberInChannel(user.localId)) {
+    return "You don't have access to this channel, use join <channel> for "
+           "adding";
+  }
+
+  std::vector<SearchDocument> found;
+  {
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    found = db.searchInChannel(channel, terms);
+  }
+  if (found.empty()) {
+    return "Nothing found";
+  }
+
+  std::ostringstream oss;
+  for (size_t i = 0; i < found.size(); ++i) {
+    History line;
+    line.time = found[i].time;
+    line.message = found[i].text;
+
+    std::string nickname = db.userRegistry.nickname(found[i].userId);
+    if (nickname.empty()) {
+      nickname = std::to_string(found[i].userId);
+    }
+    if (i != 0) {
+      oss << '\n';
+    }
+    oss << renderHistoryLine(line, nickname, true);
+  }
+  return oss.str();
+}
+
+bool SearchCommand::validateCommand(const CommandTokens &command) {
+  return command.size() >= 3;
+}
+
+void SearchCommand::parseSearchCommand(const CommandTokens &command,
+                                       std::string &channel,
+                                       std::vector<std::string> &terms,
+                                       DataBase &db) {
+  channel = command[1];
+  // Слова запроса берём из остатка строки: их может быть больше, чем
+  // помещается в CommandTokens
+  std::string_view rest = command.rest(2);
+  while (!rest.empty()) {
+    size_t start = rest.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) {
+      break;
+    }
+    rest.remove_prefix(start);
+    size_t end = std::min(rest.find_first_of(" \t\r\n"), rest.size());
+    std::string_view word = rest.substr(0, end);
+    rest.remove_prefix(end);
+
+    // from:<nickname> - фильтр по отправителю
+    if (word.substr(0, 5) == "from:") {
+      std::string nickname(word.substr(5));
+      LocalId localId = db.userRegistry.findNickname(nickname);
+      terms.push_back("@" + (localId != INVALID_LOCAL_ID
+                                 ? std::to_string(localId)
+                                 : nickname));
+      continue;
+    }
+    for (const std::string &token : tokenizeText(std::string(word))) {
+      terms.push_back(token);
+    }
+  }
+}
@@ -1,18 +1,17 @@
 #include "command_handler.hpp"
 
-bool SendCommand::validateCommand(std::vector<std::string>& command) {
+bool SendCommand::validateCommand(const CommandTokens &command) {
   return command.size() >= 3;
 }
 
-void SendCommand::parseSendCommand(std::vector<std::string>& command,
+void SendCommand::parseSendCommand(const CommandTokens &command,
                                    std::string& channel, std::string& message) {
   channel = command[1];
-  for (int i = 2; i < command.size(); i++) {
-    message += command[i] + " ";
-  }
+  // Текст сообщения - остаток строки без разбиения на слова
+  message = command.rest(2);
 }
 
-std::string SendCommand::handleCommand(std::vector<std::string>& command,
+std::string SendCommand::handleCommand(const CommandTokens &command,
                                        DataBase& db, User& user) {
   if (!validateCommand(command)) {
     return "Error command, use: send <channel> <message>";
@@ -21,16 +20,15 @@ std::string SendCommand::handleCommand(std::vector<std::string>& command,
   parseSendCommand(command, channel, message);
 
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_channels = db.channelsFile();
-    db.database_channels_members = db.channelsMembersFile(channel);
+    db.database_channels_members = db.channelMembers(channel);
   }
   if (db.ChannelExists(channel)) {
-    if (db.MemberInChannel(user.id)) {
+    if (db.MemberInChannel(user.localId)) {
       {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        db.database_channels_history = db.channelsHistoryFile(channel);
-        db.addMessageInChannel(user.id, channel, message);
+        std::lock_guard<MeteredMutex> lock(dbMutex);
+        db.addMessageInChannel(user.localId, channel, message);
       }
       return "Message sent";
     }
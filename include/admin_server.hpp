@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#define ADMIN_PORT_OFFSET 1000     // По умолчанию: порт сервера + 1000
+#define ADMIN_POLL_MS 500          // Как часто поток проверяет остановку
+#define ADMIN_IO_TIMEOUT_MS 1000   // Медленный клиент не держит поток дольше
+#define ADMIN_REQUEST_MAX 8192     // Предел заголовков запроса
+
+/**
+ * @brief HTTP-порт метрик в формате Prometheus
+ *
+ * @details
+ * Слушает только 127.0.0.1 и отвечает на GET /metrics. Запросы по одному
+ * обслуживает собственный поток. Текст собирается из атомарных счётчиков
+ * потоков (metricsExposition), без мьютексов, общих с обработкой клиентов,
+ * поэтому опрос не влияет на задержки.
+ */
+class AdminServer {
+ public:
+  explicit AdminServer(std::function<std::string()> render);
+  ~AdminServer();
+  AdminServer(const AdminServer &) = delete;
+  AdminServer &operator=(const AdminServer &) = delete;
+
+  bool start(int port);
+  void stop();
+
+ private:
+  std::function<std::string()> render;
+  int listenSocket = -1;
+  std::atomic<bool> running{false};
+  std::thread worker;
+
+  void run();
+  void serve(int socket);
+};
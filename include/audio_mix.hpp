@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Сложение кадров голоса с насыщением до int16; буферы по frame_count кадров
+// из channels чередующихся сэмплов
+void mix_audio_buffers(std::vector<int16_t *> &buffers, int16_t *output,
+                       int frame_count, int channels);
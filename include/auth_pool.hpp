@@ -0,0 +1,96 @@
+#pragma once
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define AUTH_WORKERS 4             // Число потоков хеширования паролей
+#define AUTH_QUEUE_CAPACITY 64     // Максимум ожидающих проверок
+#define AUTH_PBKDF2_ITERATIONS 100000
+#define AUTH_SALT_SIZE 16
+#define AUTH_LATENCY_SAMPLES 1024  // Окно для расчёта p99
+#define LEGACY_PASSWORD_SALT "fixed_salt_value"
+
+/**
+ * @brief Контексты OpenSSL одного потока проверки паролей
+ *
+ * @details
+ * EVP_MD_CTX и EVP_KDF_CTX создаются один раз на поток и переиспользуются
+ * для каждого пароля, вместо создания контекста на каждый вход.
+ */
+class AuthWorkerContext {
+ public:
+  AuthWorkerContext();
+  ~AuthWorkerContext();
+  AuthWorkerContext(const AuthWorkerContext &) = delete;
+  AuthWorkerContext &operator=(const AuthWorkerContext &) = delete;
+
+  std::string sha256(const std::string &data);
+  std::string pbkdf2(const std::string &password, const std::string &salt,
+                     uint32_t iterations);
+
+ private:
+  EVP_MD_CTX *mdContext = nullptr;
+  EVP_KDF_CTX *kdfContext = nullptr;
+};
+
+// Хеш для users.txt: "pbkdf2$<итерации>$<соль hex>$<хеш hex>"
+std::string makePasswordHash(AuthWorkerContext &context,
+                             const std::string &password);
+// Проверяет как новые хеши, так и старые SHA-256 с общей солью
+bool checkPasswordHash(AuthWorkerContext &context, const std::string &password,
+                       const std::string &stored);
+
+/**
+ * @brief Пул потоков для дорогих операций входа и регистрации
+ *
+ * @details
+ * Хеширование выполняется на AUTH_WORKERS потоках, поэтому всплеск входов
+ * не занимает все ядра и не тормозит обмен сообщениями. Очередь
+ * ограничена: при переполнении задача сразу отклоняется.
+ */
+class AuthPool {
+ public:
+  explicit AuthPool(size_t workers = AUTH_WORKERS,
+                    size_t capacity = AUTH_QUEUE_CAPACITY);
+  ~AuthPool();
+
+  // Выполняет задачу в пуле и ждёт её; false, если очередь полна или
+  // задача завершилась исключением
+  bool run(const std::function<void(AuthWorkerContext &)> &task);
+  size_t queueDepth();
+  double p99LatencyMs();
+  std::string stats();
+
+ private:
+  struct Task {
+    std::function<void(AuthWorkerContext &)> function;
+    std::chrono::steady_clock::time_point enqueued;
+    std::function<void(bool)> done;
+  };
+
+  size_t capacity;
+  bool stopping = false;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::queue<Task> tasks;
+  std::vector<std::thread> threads;
+
+  std::mutex latencyMutex;
+  std::vector<double> latencies;  // Кольцевой буфер, мс
+  size_t latencyPosition = 0;
+  uint64_t completed = 0;
+  uint64_t rejected = 0;
+
+  void workerLoop();
+  void recordLatency(double milliseconds);
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <openssl/evp.h>
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define BLOB_DIRECTORY "channels/blobs/"
+// Журнал ссылок: "<digest> <ссылок> <байт> <ссылок-файлов>" после сжатия,
+// затем "+ <digest> <байт> <вид>" и "- <digest> <вид>" на каждое
+// добавление и снятие; вид - file или voicemail
+#define BLOB_REFS_FILE "channels/blobs/refs.txt"
+#define BLOB_DIGEST_LENGTH 64                     // SHA-256 в hex
+#define BLOB_TRANSCODED_SUFFIX ".opus"            // Сжатая копия голосового
+
+// Кто ссылается на блоб: вложение отдаётся как есть, голосовое может
+// храниться только в сжатом виде
+enum class BlobRef { FILE, VOICEMAIL };
+
+// Потоковое вычисление SHA-256 по мере приёма данных
+class Sha256 {
+ public:
+  Sha256();
+  ~Sha256();
+  Sha256(const Sha256 &) = delete;
+  Sha256 &operator=(const Sha256 &) = delete;
+
+  void update(const uint8_t *data, size_t size);
+  std::string finalHex();
+
+ private:
+  EVP_MD_CTX *context;
+};
+
+/**
+ * @brief Хранилище вложений по содержимому
+ *
+ * @details
+ * Файл и голосовое сообщение сохраняются один раз под своим SHA-256 в
+ * channels/blobs/, история канала ссылается на дайджест. Для каждого
+ * дайджеста считается число записей истории, которые на него ссылаются;
+ * при удалении канала ссылки снимаются, и блоб без ссылок удаляется.
+ * Изменения ссылок дописываются в журнал, который сжимается до таблицы
+ * счётчиков при записи снимка сервера.
+ * Голосовое сообщение после перекодирования хранится как <digest>.opus;
+ * исходные байты удаляются, если на блоб не ссылается ни одно вложение
+ * File_ID с теми же байтами.
+ */
+class BlobStore {
+ public:
+  BlobStore();
+
+  // Принятый файл переносится в хранилище или удаляется, если такой уже есть
+  bool addFile(const std::string &tempPath, const std::string &digest,
+               uint64_t size, BlobRef ref);
+  // Вложение, принятое одним кадром; возвращает дайджест или ""
+  std::string addBuffer(const std::vector<uint8_t> &data, BlobRef ref);
+  void release(const std::string &digest, BlobRef ref);
+  // Сжатая копия из tempPath сохраняется рядом с исходным файлом, который
+  // удаляется, если все ссылки - голосовые
+  bool storeTranscoded(const std::string &digest, const std::string &tempPath);
+  // Голосовые без сжатой копии, например не перекодированные до остановки
+  std::vector<std::string> untranscodedVoicemails();
+  std::string path(const std::string &digest) const;
+  std::string transcodedPath(const std::string &digest) const;
+  static bool isDigest(const std::string &id);
+  std::string stats();
+  // Переписывает журнал ссылок текущими счётчиками
+  bool compactRefs();
+
+ private:
+  struct Blob {
+    uint64_t refs = 0;
+    uint64_t size = 0;
+    uint64_t fileRefs = 0;  // Из refs: вложения, которым нужны исходные байты
+  };
+
+  std::mutex blobsMutex;
+  std::unordered_map<std::string, Blob> blobs;
+  uint64_t savedBytes = 0;  // Не записано благодаря повторам
+  std::ofstream refsLog;
+
+  void logRefLocked(char change, const std::string &digest, BlobRef ref,
+                    uint64_t size = 0);
+  // Повтор вложения, когда исходные байты уже заменены сжатой копией
+  bool needsRawLocked(const std::string &digest, BlobRef ref);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define BLOOM_BITS_PER_KEY 10  // ~1% ложных срабатываний при 7 хешах
+#define BLOOM_HASHES 7
+#define BLOOM_MIN_KEYS 1024
+
+/**
+ * @brief Фильтр Блума для быстрых отрицательных ответов "ключа нет"
+ *
+ * @details
+ * Позиции битов считаются двойным хешированием FNV-1a. Удаление не
+ * поддерживается: устаревший ключ даёт лишь ложное срабатывание, которое
+ * отсекается проверкой по точному индексу.
+ */
+class BloomFilter {
+ public:
+  explicit BloomFilter(size_t expectedKeys = BLOOM_MIN_KEYS);
+  void add(const std::string &key);
+  bool mightContain(const std::string &key) const;
+  // Заполнен ли фильтр до расчётного числа ключей
+  bool isFull() const { return keyCount >= expectedKeys; }
+  size_t capacity() const { return expectedKeys; }
+  void reset(size_t newExpectedKeys);
+
+ private:
+  std::vector<uint64_t> bits;
+  size_t bitCount = 0;
+  size_t expectedKeys = 0;
+  size_t keyCount = 0;
+};
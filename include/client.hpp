@@ -13,6 +13,7 @@
 #include <csignal>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <iostream>
 #include <mutex>
 #include <queue>
@@ -25,13 +26,43 @@
 #define NUM_CHANNELS 2
 #define SAMPLE_TYPE paInt16
 #define FILE_FORMAT (SF_FORMAT_WAV | SF_FORMAT_PCM_16)
+#define CLIENT_MAX_IN_FLIGHT 1024  // Команд без ответа в режиме конвейера
+#define CLIENT_REPLY_TIMEOUT_SEC 10  // Ожидание ответов в конце ввода
+#define CLIENT_VOICE_INBOX_CAPACITY 16  // Кадров голоса в очереди, 160 мс
+#define UPLOAD_WINDOW 8            // Частей загрузки без подтверждения
+#define UPLOAD_REPLY_TIMEOUT_SEC 30
+#define UPLOAD_STATE_FILE ".upload_resume"  // Незавершённая загрузка
 
+#include "../include/client_dispatch.hpp"
+#include "../include/compression.hpp"
 #include "../include/mysocket.hpp"
+#include "../include/voicemail_codec.hpp"
+#include "../include/voicemail_player.hpp"
 
-bool ready = false;  // Флаг готовности для вывода приглашения
+std::atomic<bool> ready{false};  // Флаг готовности для вывода приглашения
+
+// Состояние текущей загрузки по частям, меняется потоком приёма
+struct UploadState {
+  uint64_t id = 0;
+  uint64_t acked = 0;  // Подтверждённое сервером смещение
+  // Неподтверждённые части: конец части и проход, в котором её отправили.
+  // Сервер отвечает на каждую часть по порядку
+  std::deque<std::pair<uint64_t, uint32_t>> sent;
+  uint32_t pass = 0;    // Растёт при каждом возврате к acked
+  bool rewind = false;  // Сервер не принял часть, слать заново с acked
+  bool begun = false;
+  bool done = false;
+  bool failed = false;
+};
 
 class Client {
   std::string nickname = "";
+  std::string sessionToken = "";   // Токен для входа без пароля при /connect
+  std::string resumeChannel = "";  // Канал из последнего RESUME
+  // Ответ сервера о канале для приглашения; пишет поток служебных флагов,
+  // применяет основной поток
+  enum class ChannelEvent { NONE, REJECTED, DELETED };
+  ChannelEvent channelEvent = ChannelEvent::NONE;
 
   void helpToUse();
   bool isValidIpPort(const std::string &ip_port);
@@ -52,18 +83,29 @@ class Client {
   MySocket clientSocket;
   std::mutex mtx;
   std::condition_variable cv;
-  std::string lastChannel = "";
-  std::queue<std::string> messageQueue;  // Очередь сообщений от сервера
+  std::string lastChannel = "";  // Только основной поток
+  // Ответы для вывода перед приглашением; пишут потоки-обработчики
+  MpscQueue<std::string> messageQueue;
   bool loginCorrect = false;
   bool passwordCorrect = false;
   bool nicknameCorrect = false;
   bool timeFlag = false;
+  // Ввод не с терминала: команды отправляются без ожидания ответов, ответы
+  // печатаются с номером запроса
+  bool pipelineMode = false;
+  std::atomic<uint32_t> nextRequestId{0};
+  std::atomic<uint32_t> inFlight{0};
   bool recording_start = false;
   std::vector<short> audio_buffer;
+  VoicemailPlayer voicemailPlayer;  // Голосовые из /voicemail_on
+  VoiceOutput voiceOutput{SAMPLE_RATE, NUM_CHANNELS};  // Голос канала
 
   void record_audio(int recOrVoice, std::string &channel);
   void processAudioMessage(const Message &message);
   void processVoiceMessage(const Message &message);
+  // Ответ для вывода перед приглашением
+  void printReply(const std::string &text);
+  void signalReady();
   void save_audio_to_file(const std::string &filename);
   std::string generateFilename(const std::string &userId);
 
@@ -76,18 +118,41 @@ class Client {
                  std::string &channel, std::string &ip, int &port);
   void promptConnect(std::string &ip_port, std::string &nick,
                      std::string &channel);
+  // Отправка команды с новым requestId
+  bool sendCommand(Message &message);
+  void completeRequest();
+  void waitForReplies();
+  void requestCompression();
+  UploadState upload;
+  bool uploadFile(const std::string &filePath, const std::string &channel,
+                  const std::string &kind);
+  void uploadReply(Message &message);
+  uint64_t loadUploadResume(const std::string &kind, const std::string &channel,
+                            const std::string &filePath, uint64_t fileSize);
+  void saveUploadResume(uint64_t uploadId, const std::string &kind,
+                        const std::string &channel, const std::string &filePath,
+                        uint64_t fileSize);
   void enterOnServer();
   void setNickname(std::string &nick);
   std::string getNickname();
+  void setSessionToken(const std::string &token);
+  // Вход одним кадром RESUME; false, если токена нет
+  bool resumeSession(const std::string &channel);
+  // Токен отклонён: канал и ник отправляются так же, как без токена
+  void resumeFailed();
+  // NO_CHANNEL и DEL_CHANNEL из потока служебных флагов
+  void channelRejected();
+  void channelDeleted();
+  // Основной поток: применяет ответ о канале к каналу приглашения
+  void applyChannelEvent(std::string &currentChannel);
 };
 
 void signalHandler(int signal);
-void ReceiveMessage(std::string &id, std::string &currentChannel,
-                    Client &client);
+void ReceiveMessage(std::string &id, Client &client);
 bool handleConnectCommand(const std::string &input, std::string &ipPort,
                           std::string &ip, int &port, std::string &nick,
                           std::string &channel, std::string &id,
-                          std::string &currentChannel, Client &client);
+                          Client &client);
 bool commandHandler(std::string &command, Message &message, std::string &ipPort,
                     std::string &ip, int &port, const std::string &nick,
                     std::string &channel, std::string &currentChannel,
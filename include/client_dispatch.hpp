@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "../include/mysocket.hpp"
+
+/**
+ * @brief Очередь без блокировок: много писателей, один читатель
+ *
+ * @details
+ * Связный список с фиктивным узлом. push - один атомарный обмен головы,
+ * поэтому поток приёма никогда не ждёт обработчики. pop вызывает только
+ * поток-владелец очереди.
+ */
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+  ~MpscQueue() {
+    T value;
+    while (pop(value)) {
+    }
+    delete tail;
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  void push(T value) {
+    Node *node = new Node;
+    node->value = std::move(value);
+    Node *previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  bool pop(T &value) {
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    value = std::move(next->value);
+    delete tail;
+    tail = next;
+    return true;
+  }
+
+  // Для читателя: есть ли что забрать
+  bool empty() const {
+    return tail->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  struct Node {
+    T value;
+    std::atomic<Node *> next{nullptr};
+  };
+  std::atomic<Node *> head;
+  Node *tail;  // Только читатель
+};
+
+/**
+ * @brief Поток-обработчик сообщений одного вида
+ *
+ * @details
+ * Поток приёма раскладывает сообщения по исполнителям (текст, голос,
+ * голосовые сообщения, служебные флаги), у каждого свой поток и своя
+ * очередь. Долгая обработка одного вида не задерживает остальные.
+ * Мьютекс берётся только для сна потока на пустой очереди. С ненулевой
+ * ёмкостью лишние сообщения отбрасываются: живому голосу лучше потерять
+ * кадр, чем копить задержку.
+ */
+class ClientExecutor {
+ public:
+  // capacity - сообщений в очереди, 0 - без ограничения
+  ClientExecutor(std::string name, std::function<void(Message &)> handler,
+                 size_t capacity = 0);
+  ~ClientExecutor();
+
+  // false - очередь полна, сообщение отброшено
+  bool post(Message message);
+  // Обрабатывает уже принятое и останавливает поток
+  void stop();
+
+ private:
+  std::string name;
+  std::function<void(Message &)> handler;
+  MpscQueue<Message> inbox;
+  size_t capacity;
+  std::atomic<size_t> pending{0};
+  std::atomic<bool> running{true};
+  std::atomic<bool> sleeping{false};
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  std::thread worker;
+
+  void run();
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mysocket.hpp"
+#include "presence.hpp"
+
+#define CLUSTER_VIRTUAL_NODES 160  // Точек узла на кольце: ровнее делит каналы
+#define CLUSTER_REQUEST_TIMEOUT_MS 5000
+#define CLUSTER_RECONNECT_MS 1000  // Пауза перед повторным подключением к узлу
+#define CLUSTER_POLL_MS 200  // Как часто потоки узла проверяют остановку
+#define CLUSTER_CONNECT_TIMEOUT_MS 2000  // Подключение к недоступному узлу
+#define CLUSTER_HELLO_TIMEOUT_MS 2000  // Ожидание HELLO от входящей связи
+#define CLUSTER_MAX_PENDING_INBOUND 16  // Входящих связей без проверенного HELLO
+
+// Операция кадра между узлами: поле flag. Запрос с ответом несёт requestId,
+// ответ приходит с тем же requestId и флагом REPLY. Тело - поля
+// appendField: длина (uint32_t, сетевой порядок) и байты.
+enum class ClusterOp : uint32_t {
+  HELLO = 1,       // <id узла> <секрет>: первый кадр подключившегося узла
+  REPLY,           // <ответ>
+  COMMAND,         // <UUID> <ник> <0|1 время> <команда>: команда канала
+  CHANNELS,        // Список каналов узла
+  CREATE_CHANNEL,  // <канал>
+  DELETE_CHANNEL,  // <канал>
+  VOICE,           // <канал> <UUID отправителя> <тело VOICE>: владельцу канала
+  DELIVER,  // <type> <flag> <UUID-исключение> <тело> <UUID>...: своим клиентам
+};
+
+void appendField(std::vector<uint8_t> &body, std::string_view field);
+// false, если тело обрывается посреди поля
+bool readFields(const std::vector<uint8_t> &body,
+                std::vector<std::string> &fields);
+Message clusterMessage(ClusterOp op, const std::vector<std::string> &fields,
+                       DataType type = DataType::TEXT);
+
+struct ClusterPeer {
+  std::string id;
+  std::string host;
+  int port = 0;  // Порт связей между узлами
+};
+
+/**
+ * @brief Согласованное хеширование имён каналов по узлам
+ *
+ * @details
+ * У каждого узла CLUSTER_VIRTUAL_NODES точек на кольце 64-битного хеша
+ * (FNV-1a с перемешиванием из MurmurHash3: без него похожие короткие имена
+ * "n1#0", "n1#1" ложатся на кольцо кучно); канал принадлежит узлу первой
+ * точки не меньше хеша имени. Хеш не зависит от платформы и порядка строк
+ * в файле кластера, поэтому все узлы с одним списком узлов считают
+ * владельцев одинаково, а при добавлении узла переезжает только примерно
+ * 1/N каналов.
+ */
+class HashRing {
+ public:
+  explicit HashRing(const std::vector<std::string> &nodes = {});
+  // Индекс в nodes; у пустого кольца - 0
+  size_t owner(std::string_view key) const;
+
+ private:
+  std::vector<std::pair<uint64_t, size_t>> points;
+};
+
+/**
+ * @brief Узел кластера: кольцо каналов и постоянные связи с другими узлами
+ *
+ * @details
+ * Файл кластера одинаков на всех узлах: строки "<id> <host> <port>" с
+ * портом связей, строка "secret <секрет>", '#' - комментарий. Узел слушает
+ * порт связей только на своём адресе из файла и принимает соединение, если
+ * HELLO несёт общий секрет, а адрес источника - адрес названного в нём
+ * узла. Сам узел держит по одному исходящему соединению к каждому другому
+ * узлу: запросы уходят по исходящему, ответы на запросы соседа - по
+ * входящему. Отправка идёт через очередь Connection, поэтому медленный
+ * сосед не задерживает поток клиента, а голос при переполнении
+ * отбрасывается. Оборванная связь восстанавливается раз в
+ * CLUSTER_RECONNECT_MS, ждущие ответа запросы сразу получают отказ.
+ */
+class ClusterNode {
+ public:
+  // Обработка кадра соседа; ответ отправляется, если у запроса есть
+  // requestId
+  using Handler = std::function<Message(const Message &)>;
+
+  ~ClusterNode();
+
+  bool load(const std::string &path, const std::string &selfId,
+            std::string &error);
+  bool enabled() const { return !nodes.empty(); }
+  bool start(Handler handler);
+  void stop();
+
+  const std::string &selfId() const { return self; }
+  // Узел-владелец канала; без кластера - свой
+  const std::string &ownerOf(std::string_view channel) const;
+  bool ownsChannel(std::string_view channel) const;
+  std::vector<std::string> peers() const;
+
+  // false - узел недоступен или не ответил за CLUSTER_REQUEST_TIMEOUT_MS
+  bool request(const std::string &node, Message message, Message &reply);
+  // Без ответа; false - связь не установлена или кадр отброшен
+  bool post(const std::string &node, const Message &message);
+  size_t linksUp() const;
+  std::string status() const;
+
+ private:
+  struct PeerLink {
+    ClusterPeer peer;
+    mutable std::mutex mutex;
+    MySocket socket;
+    std::unique_ptr<Connection> writer;  // Есть, пока связь установлена
+    std::unordered_map<uint32_t, std::promise<Message>> pending;
+    std::thread thread;
+  };
+  struct InboundLink {
+    sockaddr_storage address{};  // Откуда подключились
+    MySocket socket;
+    std::thread thread;
+    std::atomic<bool> authenticated{false};  // HELLO проверен
+    std::atomic<bool> finished{false};
+  };
+
+  std::string self;
+  std::string secret;  // Из файла кластера, в HELLO
+  std::string listenHost;
+  int listenPort = 0;
+  std::vector<ClusterPeer> nodes;  // Все узлы, включая свой
+  HashRing ring;
+  std::vector<std::unique_ptr<PeerLink>> links;
+  Handler handler;
+  std::atomic<bool> running{false};
+  std::atomic<uint32_t> nextRequestId{1};
+  int listenSocket = -1;
+  std::thread acceptor;
+  std::mutex inboundMutex;
+  std::vector<std::unique_ptr<InboundLink>> inbound;
+
+  PeerLink *findLink(const std::string &node) const;
+  void runLink(PeerLink &link);
+  bool connectLink(PeerLink &link);
+  void dropLink(PeerLink &link);
+  void acceptLoop();
+  void serveInbound(InboundLink &link);
+  void reapInbound(bool all);
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Значения по умолчанию выбраны по bench/compression_bench.cpp
+#define COMPRESSION_LEVEL 1         // Уровень zlib: 1 - самый быстрый
+#define COMPRESSION_MIN_SIZE 256    // Тела короче не сжимаются
+#define COMPRESSION_NAME "zlib"     // Кодек, предлагаемый при согласовании
+#define COMPRESSION_MAX_SIZE (10 * 1024 * 1024)  // Предел распакованного тела
+// Для больших тел сначала сжимается начало: несжимаемые данные (архивы,
+// медиа) отправляются как есть, не тратя время на сжатие всего тела
+#define COMPRESSION_PROBE_SIZE 4096
+#define COMPRESSION_PROBE_RATIO 0.9
+
+/**
+ * @brief Сжатие тел кадров
+ *
+ * @details
+ * Сжатое тело - 4 байта исходного размера (в сетевом порядке) и поток
+ * deflate. compressBody возвращает false, если сжатие не уменьшило тело,
+ * тогда кадр отправляется как есть.
+ */
+bool compressBody(const std::vector<uint8_t> &body, std::vector<uint8_t> &out,
+                  int level = COMPRESSION_LEVEL);
+bool decompressBody(const std::vector<uint8_t> &body,
+                    std::vector<uint8_t> &out);
@@ -6,29 +6,39 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "blob_store.hpp"
+#include "history_cache.hpp"
+#include "history_index.hpp"
 #include "mysocket.hpp"
 #include "other.hpp"
+#include "search_index.hpp"
+#include "snapshot.hpp"
+#include "user_registry.hpp"
 
 namespace fs = std::filesystem;
 
 struct User {
-  std::string id;
+  std::string id;  // UUID в виде строки (для протокола)
+  LocalId localId = INVALID_LOCAL_ID;
   std::string nickname;
-  std::string socketNumber;
+  std::string socketNumber;  // Только формат users.txt; живые сокеты - в presence
   std::string login;
   std::string password;
   bool timeFlag = false;
 };
 
 struct History {
+  uint64_t seq = 0;          // Номер записи в канале
+  uint64_t timestampMs = 0;  // Время записи в мс (0 для старых записей)
   std::string time;
-  std::string id;       // ID пользователя
+  LocalId userId = INVALID_LOCAL_ID;  // Номер пользователя
   std::string message;  // Текстовое сообщение
   bool isAudio = false;
   bool isFile = false;
@@ -46,56 +56,93 @@ class DataBase {
   const std::string users_file = "users.txt";
   const std::string channels_file = "channels.txt";
 
+  // Дописать только что сохранённую строку истории в кэш /read и индекс
+  void indexHistoryLine(const std::string &channel, const std::string &line);
+  // Запись строки в историю канала с присвоением номера
+  std::string appendHistoryRecord(const std::string &channel,
+                                  const std::string &record);
+  std::vector<History> parseHistoryRecords(
+      const std::vector<HistoryRecord> &records);
+  // true, если индекс пришлось построить заново по файлу истории
+  bool loadSearchIndex(const std::string &channel);
+  // Снимает ссылки истории канала на вложения в blobStore
+  void releaseChannelBlobs(const std::string &channel);
+  // Участники каналов в памяти: файл канала читается один раз, дальше
+  // список меняют addChannelMember и deleteChannelMember. Голос рассылается
+  // по нему на каждый кадр, поэтому свой мьютекс, а не dbMutex
+  std::mutex membersMutex;
+  std::unordered_map<std::string, std::unordered_set<LocalId>> membersCache;
+  std::unordered_set<LocalId> channelsMembersFile(const std::string &channel);
+
  public:
   std::vector<User> database_names;
   std::unordered_set<std::string> database_channels;
-  std::unordered_set<std::string> database_channels_members;
+  std::unordered_set<LocalId> database_channels_members;
   std::vector<History> database_channels_history;
+  HistoryCache historyCache;
+  BlobStore blobStore;
+  HistoryIndex historyIndex;
+  SearchIndex searchIndex;
+  UserRegistry userRegistry;
   DataBase() {
-    std::ifstream Users(users_file);
-    std::ifstream Channels(channels_file);
+    // Номера пользователей выдаются в порядке users.txt
+    if (!loadSnapshot()) {
+      nicknamesFile();
+    }
   }
   std::unordered_set<std::string> addFile(const std::string &element);
   std::vector<User> nicknamesFile();
   bool parseHistoryLine(const std::string &lineStr, History &historyEntry);
   std::unordered_set<std::string> channelsFile();
-  std::unordered_set<std::string> channelsMembersFile(
-      const std::string &channel);
+  std::unordered_set<LocalId> channelMembers(const std::string &channel);
+  // Канал удаляется: участников больше нет
+  void dropChannelMembers(const std::string &channel);
   std::vector<History> channelsHistoryFile(const std::string &channel);
+  std::vector<History> channelsHistorySince(const std::string &channel,
+                                            uint64_t seq);
+  std::vector<History> channelsHistorySinceTime(const std::string &channel,
+                                                uint64_t timestampMs);
+  std::vector<History> channelsHistoryBefore(const std::string &channel,
+                                             uint64_t seq);
   int channelsMembersCount(const std::string &channel);
   void addUser(const std::string &username, int socketNumber,
                const std::string &login, const std::string &password);
+  // Заглушка участника с другого узла кластера: UUID и ник без логина и
+  // пароля, чтобы файлы участников и истории хранили его номер. Возвращает
+  // номер, ник обновляется при изменении
+  LocalId addRemoteUser(const std::string &id, const std::string &nickname);
   // void addUser(const std::string &username, const std::string &id);
 
   void addChannel(const std::string &channel);
-  void addChannelMember(const std::string &username,
-                        const std::string &channel);
-  void addMessageInChannel(const std::string &username,
-                           const std::string &channel,
+  void addChannelMember(LocalId id, const std::string &channel);
+  void addMessageInChannel(LocalId id, const std::string &channel,
                            const std::string &message);
-  void addAudioMessageToChannelHistory(const std::string &senderNickname,
+  void addAudioMessageToChannelHistory(LocalId senderId,
                                        const std::string &channel,
                                        const std::string &audioMessageID,
                                        double duration);
-  void addFileMessageToChannelHistory(const std::string &senderNickname,
+  void addFileMessageToChannelHistory(LocalId senderId,
                                       const std::string &channel,
                                       const std::string &fileMessageID,
                                       std::string &filename,
                                       uint32_t &fileSize);
 
-  void deleteChannelMember(const std::string &id, const std::string &channel);
+  void deleteChannelMember(LocalId id, const std::string &channel);
   void deleteChannel(const std::string &channel);
   std::string pathToChannelsMembers(const std::string &channel);
   std::string pathToChannelsHistory(const std::string &channel);
+  std::string pathToChannelsIndex(const std::string &channel);
+  std::string pathToChannelsHistoryIndex(const std::string &channel);
   std::string pathToChannels();
 
   void changeNickname(const std::string &id, const std::string &newUsername);
-  std::vector<User> addFileNicknames(const std::string &path);
+  // offset - с какого байта читать (дочитывание после снимка)
+  std::vector<User> addFileNicknames(const std::string &path,
+                                     uint64_t offset = 0);
   bool removeChannelFiles(const std::string &pathMembers,
                           const std::string &patHistory);
   bool ChannelExists(std::string &channel);  // проверка существования канала
-  bool MemberInChannel(const std::string &id);
-  bool nickameInSet(std::string nickname, std::unordered_set<std::string> set);
+  bool MemberInChannel(LocalId id);
   std::string userId(std::string &login);  // поиск id клиента в базе данных
   std::string userNickbyId(std::string &id);
   void channelMessage(
@@ -106,4 +153,11 @@ class DataBase {
                        std::string &channel, MySocket &client);
   bool idMessage(bool &idReceived, Message &message, std::string &id);
   std::string listOfChannelsOnServer();
+  std::vector<SearchDocument> searchInChannel(
+      const std::string &channel, const std::vector<std::string> &terms);
+  // Снимок реестра пользователей и индексов истории для быстрого запуска;
+  // writersMutex - мьютекс, под которым регистрируются пользователи и
+  // дописывается история
+  bool saveSnapshot(MeteredMutex &writersMutex);
+  bool loadSnapshot();
 };
\ No newline at end of file
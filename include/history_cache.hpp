@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define HISTORY_CACHE_CAPACITY 64  // Максимальное число каналов в кэше
+
+struct History;
+
+// Отрисовка одной записи истории так, как её возвращает /read
+std::string renderHistoryLine(const History &line, const std::string &nickname,
+                              bool timeFlag);
+
+/**
+ * @brief LRU-кэш готовых ответов /read по каналам
+ *
+ * @details
+ * Для каждого канала хранятся два варианта текста: с временем и без
+ * (user.timeFlag). Новые записи истории дописываются в уже готовый текст,
+ * поэтому повторный /read не разбирает файл истории заново.
+ */
+class HistoryCache {
+ public:
+  explicit HistoryCache(size_t capacity = HISTORY_CACHE_CAPACITY)
+      : capacity(capacity) {}
+
+  bool get(const std::string &channel, bool timeFlag, std::string &rendered);
+  void put(const std::string &channel, bool timeFlag,
+           const std::string &rendered);
+  // Дописать запись в закэшированные варианты канала (если они есть)
+  void append(const std::string &channel, const History &line,
+              const std::string &nickname);
+  void invalidate(const std::string &channel);
+  void clear();
+
+  uint64_t hits() const { return hitCount.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return missCount.load(std::memory_order_relaxed); }
+  std::string stats();
+
+ private:
+  struct Entry {
+    std::string rendered[2];  // [0] - без времени, [1] - со временем
+    bool valid[2] = {false, false};
+    std::list<std::string>::iterator lruPosition;
+  };
+
+  size_t capacity;
+  std::mutex cacheMutex;
+  std::list<std::string> lru;  // В начале - недавно использованные каналы
+  std::unordered_map<std::string, Entry> entries;
+  std::atomic<uint64_t> hitCount{0};
+  std::atomic<uint64_t> missCount{0};
+
+  void touch(Entry &entry);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snapshot.hpp"
+
+#define HISTORY_INDEX_INTERVAL 64  // Каждая N-я запись попадает в индекс
+#define HISTORY_PAGE_SIZE 100      // Число записей в ответе /read ... before
+
+// Запись разреженного индекса: номер, время (мс) и смещение строки в файле
+struct HistoryCheckpoint {
+  uint64_t seq;
+  uint64_t timestampMs;
+  uint64_t offset;
+};
+
+// Строка истории вместе с её номером в канале
+using HistoryRecord = std::pair<uint64_t, std::string>;
+
+uint64_t currentTimeMs();
+// HH:MM:SS (сегодня) или YYYY-MM-DDTHH:MM:SS в миллисекунды от эпохи
+bool parseHistoryTime(const std::string &text, uint64_t &timestampMs);
+
+/**
+ * @brief Нумерация записей истории и разреженный индекс по ним
+ *
+ * @details
+ * Каждая новая строка истории получает префикс "#<seq>@<epoch-ms> ".
+ * Номер записи совпадает с номером строки в файле, поэтому старые строки
+ * без префикса нумеруются так же. Для каждой HISTORY_INDEX_INTERVAL-й
+ * записи в <channel>_history.idx сохраняется её смещение, что позволяет
+ * читать историю с нужного места без просмотра всего файла.
+ */
+class HistoryIndex {
+ public:
+  // Дописывает запись в историю и возвращает сохранённую строку
+  std::string appendRecord(const std::string &channel,
+                           const std::string &historyPath,
+                           const std::string &indexPath,
+                           const std::string &record);
+
+  std::vector<HistoryRecord> readSince(const std::string &channel,
+                                       const std::string &historyPath,
+                                       const std::string &indexPath,
+                                       uint64_t seq);
+  std::vector<HistoryRecord> readSinceTime(const std::string &channel,
+                                           const std::string &historyPath,
+                                           const std::string &indexPath,
+                                           uint64_t timestampMs);
+  std::vector<HistoryRecord> readBefore(const std::string &channel,
+                                        const std::string &historyPath,
+                                        const std::string &indexPath,
+                                        uint64_t seq,
+                                        size_t limit = HISTORY_PAGE_SIZE);
+  void dropChannel(const std::string &channel);
+  void saveSnapshot(SnapshotWriter &writer);
+  // Каналы, история которых изменилась после снимка, загрузятся лениво
+  bool loadSnapshot(SnapshotReader &reader);
+
+ private:
+  struct ChannelState {
+    std::string historyPath;
+    std::string indexPath;
+    std::vector<HistoryCheckpoint> checkpoints;
+    uint64_t lastSeq = 0;
+    uint64_t lastTimestampMs = 0;
+    uint64_t endOffset = 0;
+  };
+
+  std::mutex indexMutex;
+  std::unordered_map<std::string, ChannelState> channels;
+
+  ChannelState &loadState(const std::string &channel,
+                          const std::string &historyPath,
+                          const std::string &indexPath);
+  static void addCheckpoint(ChannelState &state, const std::string &indexPath,
+                            const HistoryCheckpoint &checkpoint);
+  // Чтение записей начиная с контрольной точки, пока stop() не вернёт true
+  template <typename Filter, typename Stop>
+  static std::vector<HistoryRecord> scanFrom(const std::string &historyPath,
+                                             const HistoryCheckpoint &from,
+                                             Filter filter, Stop stop);
+};
+
+// Разбор префикса "#<seq>@<ms> "; возвращает длину префикса или 0
+size_t parseRecordPrefix(const std::string &line, uint64_t &seq,
+                         uint64_t &timestampMs);
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define METRICS_SUB_BUCKET_BITS 3  // 8 корзин на степень двойки: ошибка <12.5%
+#define METRICS_MAX_EXPONENT 40    // Больше 2^41 нс (~36 минут) - в последней
+#define METRICS_BUCKETS \
+  ((METRICS_MAX_EXPONENT - METRICS_SUB_BUCKET_BITS + 2) << METRICS_SUB_BUCKET_BITS)
+#define METRICS_DUMP_FILE "stats.txt"
+#define METRICS_DUMP_INTERVAL_SEC 60
+
+/**
+ * Все измеряемые величины сервера. Задержки - в наносекундах, глубины
+ * очередей - в элементах. Команды сопоставляются с CommandId в
+ * commandMetric, порядок сообщений совпадает с DataType.
+ */
+enum class Metric {
+  // commandProcessing
+  COMMAND_READ,
+  COMMAND_SEND,
+  COMMAND_JOIN,
+  COMMAND_SEARCH,
+  COMMAND_EXIT,
+  COMMAND_NICK,
+  COMMAND_CONNECT,
+  COMMAND_CHANNELS,
+  COMMAND_TIME_ON,
+  COMMAND_TIME_OFF,
+  COMMAND_VOICEMAIL_ON,
+  COMMAND_UNKNOWN,
+  // messageProcessing: от приёма кадра до отправки ответа
+  MESSAGE_TEXT,
+  MESSAGE_NUMBER,
+  MESSAGE_AUDIO,
+  MESSAGE_FILE,
+  MESSAGE_VOICE,
+  MESSAGE_BATCH,
+  // Файлы базы
+  DB_READ_USERS,
+  DB_READ_CHANNELS,
+  DB_READ_MEMBERS,
+  DB_READ_HISTORY,
+  DB_APPEND_USER,
+  DB_APPEND_MEMBER,
+  DB_APPEND_HISTORY,
+  // Ожидание мьютексов
+  LOCK_DB,
+  LOCK_CLIENTS,
+  // Глубина очереди в момент постановки
+  QUEUE_AUTH,
+  QUEUE_TRANSCODE,
+  QUEUE_VOICE,
+  QUEUE_OUTBOUND,
+  COUNT
+};
+
+// Монотонные счётчики. Байты - по DataType, в том же порядке
+enum class Counter {
+  CONNECTIONS_ACCEPTED,
+  CONNECTIONS_CLOSED,
+  BYTES_IN_TEXT,
+  BYTES_IN_NUMBER,
+  BYTES_IN_AUDIO,
+  BYTES_IN_FILE,
+  BYTES_IN_VOICE,
+  BYTES_IN_BATCH,
+  BYTES_OUT_TEXT,
+  BYTES_OUT_NUMBER,
+  BYTES_OUT_AUDIO,
+  BYTES_OUT_FILE,
+  BYTES_OUT_VOICE,
+  BYTES_OUT_BATCH,
+  VOICE_STREAMS_STARTED,
+  VOICE_STREAMS_ENDED,
+  MIXER_TICKS,
+  MIXER_OVERRUNS,  // Кадр обработан дольше своей длительности
+  CONNECTIONS_REJECTED,  // Отказ при accept: достигнут предел соединений
+  // Отброшенные лимитами кадры, по TrafficClass
+  THROTTLED_COMMAND,
+  THROTTLED_VOICE,
+  THROTTLED_UPLOAD,
+  OUTBOUND_DROPPED,  // Голос, не поместившийся в очередь получателя
+  // Кластер: команды, переданные владельцу канала, и кадры для соседей
+  CLUSTER_FORWARDED,
+  CLUSTER_FORWARD_FAILED,
+  CLUSTER_RELAYED,
+  COUNT
+};
+
+// Сводка одной метрики по всем потокам
+struct HistogramSnapshot {
+  std::vector<uint64_t> buckets = std::vector<uint64_t>(METRICS_BUCKETS);
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+
+  // Верхняя граница корзины, в которую попал квантиль q (0..1)
+  uint64_t percentile(double q) const;
+};
+
+// Запись значения; без блокировок, у каждого потока свои гистограммы
+void recordMetric(Metric metric, uint64_t value);
+void addCounter(Counter counter, uint64_t value = 1);
+// Слияние по всем потокам, в том числе завершившимся. Тоже без блокировок
+HistogramSnapshot metricSnapshot(Metric metric);
+uint64_t counterValue(Counter counter);
+const char *metricName(Metric metric);
+// Таблица для /stats: count, p50, p90, p99, max, mean по непустым метрикам
+std::string metricsReport();
+// Запись отчёта во временный файл и переименование поверх path
+bool dumpMetrics(const std::string &path);
+// Счётчики и гистограммы в текстовом формате Prometheus
+std::string metricsExposition();
+
+/**
+ * @brief Замер времени от создания до выхода из области видимости
+ */
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(Metric metric)
+      : metric(metric), start(std::chrono::steady_clock::now()) {}
+  ~ScopedLatency() {
+    recordMetric(metric, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+  }
+  ScopedLatency(const ScopedLatency &) = delete;
+  ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+  // Если вид операции становится известен после начала замера
+  void setMetric(Metric value) { metric = value; }
+
+ private:
+  Metric metric;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Мьютекс, записывающий время ожидания захвата
+ *
+ * @details
+ * Сначала try_lock: без конкуренции часы не читаются и записывается 0,
+ * поэтому гистограмма показывает и долю захватов с ожиданием.
+ */
+class MeteredMutex {
+ public:
+  explicit MeteredMutex(Metric metric) : metric(metric) {}
+
+  void lock() {
+    if (mutex.try_lock()) {
+      recordMetric(metric, 0);
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    mutex.lock();
+    recordMetric(metric, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+  }
+  bool try_lock() { return mutex.try_lock(); }
+  void unlock() { mutex.unlock(); }
+
+ private:
+  std::mutex mutex;
+  Metric metric;
+};
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <arpa/inet.h>
+#include <endian.h>
 #include <sndfile.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cctype>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -14,14 +18,29 @@
 #include <stdexcept>
 #include <vector>
 #define OPUS_MAX_PACKET_SIZE 4000
+#define WAV_PROBE_SIZE 65536  // Заголовок WAV ищется в начале файла
 
-enum DataType { TEXT, NUMBER, AUDIO, FILE_TYPE, VOICE };
+enum DataType { TEXT, NUMBER, AUDIO, FILE_TYPE, VOICE, BATCH };
 
 struct AudioPacket {
   uint64_t timestamp;  // метка времени в миллисекундах
   unsigned char opus_data[OPUS_MAX_PACKET_SIZE];  // аудиоданные
   int opus_length;                                // длина данных
 };
+// Формат и положение данных WAV по чанкам RIFF fmt и data
+struct WavInfo {
+  uint16_t format = 0;  // Принимается только 1 - PCM
+  uint16_t channels = 0;
+  uint32_t sampleRate = 0;
+  uint16_t blockAlign = 0;
+  uint16_t bitsPerSample = 0;
+  uint64_t dataOffset = 0;
+  uint64_t dataSize = 0;
+
+  double duration() const {
+    return static_cast<double>(dataSize / blockAlign) / sampleRate;
+  }
+};
 struct FilePacket {
   uint64_t timestamp;
   std::string filename;
@@ -55,12 +74,54 @@ enum Flags {
   TIME_ON = 21,
   TIME_OFF = 22,
   FILE_ERROR = 23,
+  SESSION_TOKEN = 24,  // Токен сессии для быстрого переподключения
+  RESUME = 25,         // Вход по токену: "<token>\n<channel>"
+  RESUME_FAILED = 26,
+  COMPRESSION = 27,  // Согласование сжатия: тело - имя кодека
+  UPLOAD_BEGIN = 28,  // Начало или продолжение загрузки по частям
+  UPLOAD_CHUNK = 29,  // Часть файла (FILE_TYPE)
+  UPLOAD_END = 30,    // Загрузка завершена
+  UPLOAD_ACK = 31,    // "<uploadId> <принято байт>"
+  UPLOAD_ERROR = 32,  // "<uploadId> <причина>"
+  // Голосовое сообщение частями: заголовок, части звука, конец
+  VOICEMAIL_STREAM_BEGIN = 33,
+  VOICEMAIL_STREAM_CHUNK = 34,
+  VOICEMAIL_STREAM_END = 35,
+  THROTTLED = 36,  // Превышен лимит: "<текст>", кадр не обработан
 };
 
+// Заголовок: type (1 байт) + size (4 байта) + flag (4 байта). Если в type
+// установлен старший бит, за flag следует requestId (4 байта) - версия 2
+// протокола. Сервер возвращает requestId в ответе на команду, поэтому
+// клиент может отправлять команды, не дожидаясь ответов.
+#define MESSAGE_HEADER_SIZE 9
+#define MESSAGE_REQUEST_ID_SIZE 4
+#define MESSAGE_EXTENDED_HEADER 0x80
+// Бит type: тело сжато (см. compression.hpp). Отправляется только после
+// согласования флагом COMPRESSION, принимается всегда.
+#define MESSAGE_COMPRESSED 0x40
+
+// Тело кадра BATCH - подряд записанные обычные кадры (заголовок + тело).
+// Вложенные BATCH не допускаются.
+#define BATCH_MAX_MESSAGES 256         // Сообщений в одном кадре BATCH
+#define BATCH_MAX_SIZE (256 * 1024)    // Байт в одном кадре BATCH
+
+// Загрузка по частям: UPLOAD_BEGIN "<file|audio>\n<канал>\n<имя>\n<размер>
+// \n<uploadId для продолжения или 0>", затем части UPLOAD_CHUNK с телом
+// uploadId (8 байт) + смещение (8 байт) + данные, затем UPLOAD_END
+// "<uploadId>". Сервер подтверждает каждую часть, поэтому после обрыва
+// загрузка продолжается с последнего подтверждённого смещения.
+#define UPLOAD_CHUNK_SIZE (256 * 1024)
+#define UPLOAD_CHUNK_HEADER_SIZE 16
+#define UPLOAD_MAX_SIZE 0xFFFFFFFFULL  // Размер файла в истории - uint32_t
+#define MESSAGE_MAX_SIZE (10 * 1024 * 1024)  // Тело принимаемого кадра
+
 struct MessageHeader {
-  DataType type;
-  uint32_t size;
+  DataType type = DataType::TEXT;
+  uint32_t size = 0;
   uint32_t flag = 0;
+  uint32_t requestId = 0;  // 0 - сообщение без идентификатора (версия 1)
+  bool compressed = false;
 };
 
 struct Message {
@@ -85,10 +146,17 @@ struct Message {
   bool setAudioMessage(const std::string &filePath, const std::string &id,
                        const std::string &channel);
   bool setAudioMessage(const std::string &filePath);
+  // Аудио из памяти: сжатое голосовое или собранный из него WAV
+  bool setAudioMessage(const std::string &fileName,
+                       const std::vector<uint8_t> &audioData);
   bool setVoiceMessage(const std::vector<int16_t> &audioData,
                        const std::string &channel);
   bool setVoiceMessage(AudioPacket &packet, const std::string &channel);
 
+  void setUploadChunk(uint64_t uploadId, uint64_t offset, const uint8_t *data,
+                      size_t size);
+  bool getUploadChunk(uint64_t &uploadId, uint64_t &offset, const uint8_t *&data,
+                      size_t &size) const;
   bool setFileMessage(const FilePacket &packet, const std::string &channel,
                       const std::string &id);
 };
@@ -107,9 +175,9 @@ class MySocket {
   void setSocket(int socket) { sock = socket; }
   int getSocket() const { return sock; }
   std::string getIP();
-  bool sendFileIfExists(const std::string &filePath, const std::string &channel,
-                        const std::string &id);
   bool sendMessage(const Message &message);
+  // Мимо открытого пакета: для кадров, отправляемых не владельцем сокета
+  bool sendMessageNow(const Message &message);
   bool sendMessage(const Message &message, int socket);
   bool sendAudioMessage(AudioPacket &packet);
   bool receiveMessage(Message &message);
@@ -118,23 +186,66 @@ class MySocket {
   bool receiveAudioMessage(Message &message);
   bool sendFile(const std::string &filePath, int socket);
 
+  // Пока пакет открыт, sendMessage копит сообщения, flushBatch отправляет
+  // их одним кадром BATCH (или по одному, если собеседник не присылал BATCH)
+  void beginBatch();
+  bool flushBatch();
+  // Есть ли уже принятое, но не прочитанное сообщение; неполный кадр не в
+  // счёт, иначе ответы ждали бы его окончания
+  bool hasBufferedInput();
+  bool peerBatches() const { return peerSupportsBatch; }
+  void enableBatchSend() { peerSupportsBatch = true; }
+  // Сжимать TEXT и FILE_TYPE длиннее COMPRESSION_MIN_SIZE
+  void enableCompression() { compressionEnabled = true; }
+  bool compressionOn() const { return compressionEnabled; }
+
   static DataType determineType(const std::string &input);
   static bool isNumber(const std::string &input);
 
+  // Учёт байт кадров на проводе; задаётся сервером до запуска потоков
+  using TrafficCounter = void (*)(bool outgoing, DataType type, size_t bytes);
+  static void setTrafficCounter(TrafficCounter counter) {
+    trafficCounter = counter;
+  }
+
   void closeSocket();
 
  private:
+  static TrafficCounter trafficCounter;
+  static void countTraffic(bool outgoing, DataType type, size_t bytes) {
+    if (trafficCounter != nullptr) {
+      trafficCounter(outgoing, type, bytes);
+    }
+  }
+
   int sock;
   std::mutex send_mutex;
   struct sockaddr_in address;
+  std::atomic<bool> batching{false};
+  std::atomic<bool> peerSupportsBatch{false};
+  std::vector<uint8_t> outBatch;  // Сериализованные сообщения пакета
+  size_t outBatchCount = 0;
+  std::deque<Message> inBatch;  // Распакованные сообщения входящего BATCH
+  std::atomic<bool> compressionEnabled{false};
 
   bool extractMessage(Message &message);
+  bool sendBuffer(const std::vector<uint8_t> &buffer);
+  void encodeMessage(const Message &message, std::vector<uint8_t> &buffer);
+  static bool inflateMessage(Message &message);
+  bool flushBatchLocked();
+  bool readFrame(Message &message);
+  bool unpackBatch(const Message &batch);
 };
 
 std::string messageToString(Message &message);
 Message stringToMessage(const std::string &text, Message &message);
 bool saveFile(const std::string &directory, const std::string &fileName,
               const std::vector<uint8_t> &audioData);
+// data/size - начало файла, totalSize - его полный размер
+bool parseWavHeader(const uint8_t *data, size_t size, uint64_t totalSize,
+                    WavInfo &info, std::string &error);
+bool probeWavFile(const std::string &filePath, WavInfo &info,
+                  std::string &error);
 double getAudioDuration(const std::string &filePath);
 Message flagOn(Message &message, int flag);
 Message flagOff(Message &message);
@@ -5,9 +5,11 @@
 #include <mutex>
 #include <string>
 
+#include "metrics.hpp"
+
 #define SERVER_LOG_FILE "server.log"
 
-extern std::mutex dbMutex;
+extern MeteredMutex dbMutex;
 extern std::mutex logMutex;
 
 void logMessage(const std::string &message,
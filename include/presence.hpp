@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "metrics.hpp"
+#include "mysocket.hpp"
+#include "user_registry.hpp"
+
+#define OUTBOUND_QUEUE_CAPACITY 256  // Кадров; лишний голос отбрасывается
+#define OUTBOUND_QUEUE_HARD_CAPACITY 1024  // Кадров; дальше соединение закрывается
+
+/**
+ * @brief Исходящая очередь соединения для отправок по инициативе сервера
+ *
+ * @details
+ * Голос, уведомления об удалении канала и т.п. приходят из потоков других
+ * клиентов. Они только кладут кадр в очередь, а отправляет его поток
+ * очереди через MySocket соединения. Поэтому кадры не перемешиваются с
+ * ответами владельца (общий send_mutex), а медленный получатель не
+ * задерживает отправителя. При переполнении новые кадры голоса
+ * отбрасываются, остальные ставятся в очередь до жёсткого предела; кадр
+ * сверх него закрывает соединение, чтобы не расти без ограничения.
+ */
+class Connection {
+ public:
+  explicit Connection(MySocket &socket);
+  ~Connection();
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  // false - соединение закрыто, кадр голоса отброшен или очередь
+  // переполнена (тогда соединение закрывается)
+  bool post(const Message &message);
+  // Отправляет уже принятое в очередь и останавливает поток
+  void close();
+
+ private:
+  MySocket &socket;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::deque<Message> queue;
+  bool closing = false;
+  std::thread writer;
+
+  void run();
+};
+
+/**
+ * @brief Кто из пользователей сейчас в сети и через какие соединения
+ *
+ * @details
+ * Заполняется при входе (ID, RESUME) и очищается при отключении, поэтому
+ * сервер не ищет сокет в users.txt, где записан номер сокета на момент
+ * регистрации. У одного пользователя может быть несколько соединений.
+ */
+class PresenceRegistry {
+ public:
+  void add(LocalId user, const std::shared_ptr<Connection> &connection);
+  void remove(LocalId user, const std::shared_ptr<Connection> &connection);
+  // Число соединений, принявших кадр
+  size_t send(LocalId user, const Message &message);
+  size_t sendToMany(const std::unordered_set<LocalId> &users,
+                    const Message &message,
+                    LocalId except = INVALID_LOCAL_ID);
+  // Без блокировок: для порта метрик
+  size_t online() const { return onlineUsers.load(std::memory_order_relaxed); }
+
+ private:
+  MeteredMutex mutex{Metric::LOCK_CLIENTS};
+  std::unordered_map<LocalId, std::vector<std::shared_ptr<Connection>>>
+      connections;
+  std::atomic<size_t> onlineUsers{0};
+};
+
+/**
+ * @brief Присутствие одного соединения на время messageProcessing
+ *
+ * @details
+ * login регистрирует соединение (повторный вход заменяет пользователя),
+ * деструктор снимает его и останавливает очередь до закрытия сокета,
+ * чтобы отложенный кадр не ушёл клиенту, получившему тот же номер сокета.
+ * Connection с потоком отправки создаётся при первом входе: соединению,
+ * которое так и не вошло, рассылки не нужны.
+ */
+class PresenceSession {
+ public:
+  PresenceSession(PresenceRegistry &registry, MySocket &socket);
+  ~PresenceSession();
+  PresenceSession(const PresenceSession &) = delete;
+  PresenceSession &operator=(const PresenceSession &) = delete;
+
+  void login(LocalId user);
+
+ private:
+  PresenceRegistry &registry;
+  MySocket &socket;
+  std::shared_ptr<Connection> connection;  // Есть после первого входа
+  LocalId user = INVALID_LOCAL_ID;
+};
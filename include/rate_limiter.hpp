@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mysocket.hpp"
+#include "user_registry.hpp"
+
+#define RATE_COMMANDS_PER_SEC 20  // Команды и служебные кадры
+#define RATE_COMMANDS_BURST 40
+#define RATE_VOICE_PER_SEC 150  // Кадры голоса: 100 в секунду и запас
+#define RATE_VOICE_BURST 300
+#define RATE_UPLOAD_BYTES_PER_SEC (4 * 1024 * 1024)  // Файлы и аудио
+#define RATE_UPLOAD_BURST (16 * 1024 * 1024)
+#define RATE_USER_FACTOR 2  // Лимит пользователя - столько соединений
+#define RATE_USER_SHARDS 16
+#define RATE_BACKPRESSURE_MAX_WAIT_MS 1000  // Проверка остановки сервера
+#define MAX_CLIENT_CONNECTIONS 1024  // Больше - отказ сразу при accept
+#define CONNECTION_FD_RESERVE 64  // Дескрипторы для файлов базы, логов и т.п.
+
+// Классы кадров с отдельными лимитами
+enum class TrafficClass { COMMAND, VOICE, UPLOAD, COUNT };
+
+TrafficClass classifyMessage(const Message &message);
+// Части загрузки не отбрасываются: поток клиента ждёт токенов и не читает
+// сокет, поэтому отправителя притормаживает TCP, а загрузка не рвётся
+bool isBackpressured(const Message &message);
+// Стоимость кадра: байты тела для загрузок, 1 для остальных
+double messageCost(TrafficClass trafficClass, const Message &message);
+
+/**
+ * @brief Ведро токенов: rate в секунду, не больше burst про запас
+ */
+class TokenBucket {
+ public:
+  TokenBucket(double rate, double burst);
+
+  // false, если токенов мало; retryMs - когда их хватит
+  bool take(double cost, std::chrono::steady_clock::time_point now,
+            uint32_t &retryMs);
+  // Возврат токенов, если кадр отклонил другой лимит
+  void give(double cost);
+
+ private:
+  double rate;
+  double burst;
+  double tokens;
+  std::chrono::steady_clock::time_point updated;
+};
+
+/**
+ * @brief Лимиты по id пользователя, общие для всех его соединений
+ *
+ * @details
+ * Таблица разбита на RATE_USER_SHARDS частей со своими мьютексами, чтобы
+ * соединения разных пользователей почти не встречались на одном замке.
+ */
+class UserRateLimits {
+ public:
+  bool take(LocalId user, TrafficClass trafficClass, double cost,
+            std::chrono::steady_clock::time_point now, uint32_t &retryMs);
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<LocalId, std::vector<TokenBucket>> buckets;
+  };
+  Shard shards[RATE_USER_SHARDS];
+};
+
+/**
+ * @brief Лимиты одного соединения
+ *
+ * @details
+ * Принадлежит потоку клиента, поэтому без блокировок. Кадр проходит, если
+ * его пропустили и ведро соединения, и ведро пользователя (после входа).
+ * Об отказе клиенту сообщается один раз, пока кадры класса не начнут снова
+ * проходить, чтобы поток голоса не превращался в поток ответов.
+ */
+class ConnectionRateLimits {
+ public:
+  ConnectionRateLimits();
+
+  bool admit(TrafficClass trafficClass, double cost, LocalId user,
+             UserRateLimits &users, uint32_t &retryMs);
+  // true при первом отказе подряд в этом классе
+  bool shouldNotify(TrafficClass trafficClass);
+
+ private:
+  std::vector<TokenBucket> buckets;
+  std::vector<bool> throttled;
+};
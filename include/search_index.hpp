@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "user_registry.hpp"
+
+#define SEARCH_RESULTS_LIMIT 20  // Максимальное число результатов /search
+
+struct SearchDocument {
+  std::string time;  // Время отправки
+  LocalId userId;    // Номер отправителя
+  std::string text;  // Текст сообщения
+};
+
+// Разбиение текста на слова в нижнем регистре (UTF-8 байты сохраняются)
+std::vector<std::string> tokenizeText(const std::string &text);
+
+/**
+ * @brief Инвертированный индекс истории каналов
+ *
+ * @details
+ * Для каждого канала хранится список сообщений и для каждого слова -
+ * возрастающий список номеров сообщений, в которых оно встречается.
+ * Отправитель индексируется как слово "@<номер>". Индекс пополняется при
+ * каждой записи в историю и дописывается в файл <channel>_index.txt рядом
+ * с историей, поэтому при следующем запуске историю не нужно разбирать.
+ */
+class SearchIndex {
+ public:
+  bool isLoaded(const std::string &channel);
+  // Загрузка индекса из файла; false, если файла нет
+  bool loadChannel(const std::string &channel, const std::string &indexPath,
+                   UserRegistry &registry);
+  void addMessage(const std::string &channel, const std::string &indexPath,
+                  const SearchDocument &document);
+  // Сообщения, содержащие все слова запроса, от новых к старым
+  std::vector<SearchDocument> search(const std::string &channel,
+                                     const std::vector<std::string> &terms,
+                                     size_t limit = SEARCH_RESULTS_LIMIT);
+  void dropChannel(const std::string &channel);
+
+ private:
+  struct ChannelIndex {
+    std::vector<SearchDocument> documents;
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+  };
+
+  std::mutex indexMutex;
+  std::unordered_map<std::string, ChannelIndex> channels;
+
+  static void indexDocument(ChannelIndex &index,
+                            const SearchDocument &document);
+};
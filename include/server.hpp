@@ -1,11 +1,14 @@
 #pragma once
 
+#include <endian.h>
 #include <netinet/in.h>
 #include <openssl/evp.h>
 #include <opus/opus.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <csignal>
 #include <cstring>
@@ -21,12 +24,26 @@
 #include <vector>
 
 #include "../command_handler/command_handler.hpp"
+#include "admin_server.hpp"
+#include "audio_mix.hpp"
+#include "auth_pool.hpp"
+#include "cluster.hpp"
+#include "compression.hpp"
+#include "metrics.hpp"
+#include "presence.hpp"
+#include "rate_limiter.hpp"
+#include "session_token.hpp"
+#include "upload_manager.hpp"
+#include "voicemail_transcoder.hpp"
 
 #define SAMPLE_RATE 48000
 #define FRAMES_PER_BUFFER 480
 #define NUM_CHANNELS 2
 #define SAMPLE_TYPE int16_t
 #define OPUS_MAX_PACKET_SIZE 4000
+#define AUDIO_REINDEX_MAX_WORKERS 8  // Потоков для /reindex_audio
+#define VOICEMAIL_STREAM_FIRST_MS 60   // Первая часть мала: звук начнётся сразу
+#define VOICEMAIL_STREAM_CHUNK_MS 1000  // Остальные части
 
 struct AudioMessage {
   std::string timestamp;       // Время отправки
@@ -51,33 +68,68 @@ class Server {
   bool serverRunning = true;
   MySocket serverSocket;
   DataBase db;
+  SessionTokens sessionTokens;
+  AuthPool authPool;
+  UploadManager uploads;
+  VoicemailTranscoder transcoder{db.blobStore};
+  AdminServer admin{[this] { return prometheusReport(); }};
+  UserRateLimits userRateLimits;
+  // Соединения вошедших пользователей: все отправки по инициативе сервера
+  PresenceRegistry presence;
+  // Без файла кластера выключен: все каналы свои
+  ClusterNode cluster;
+  std::atomic<int> activeConnections{0};
+  // MAX_CLIENT_CONNECTIONS, но не больше, чем позволяет RLIMIT_NOFILE
+  int maxConnections = MAX_CLIENT_CONNECTIONS;
 
   std::mutex channelDataMutex;
-  std::mutex clients_mutex;
   std::mutex client_buffers_mutex;
-  std::mutex dbMutex;
+  MeteredMutex dbMutex{Metric::LOCK_DB};
 
-  std::vector<int> client_sockets;
   std::unordered_map<std::string, std::vector<AudioMessage>>
       channelAudioMessages;
   std::map<int, std::queue<AudioPacket>> client_buffers;
 
-  // Обработка и отправка голосовых сообщений в канале другим клиентам
+  // Отправка смешанного голоса остальным участникам канала в сети; канал
+  // другого узла - через его владельца
   void broadcast_audio(const std::vector<SAMPLE_TYPE> &audioData,
-                       int sender_socket, std::string &channel);
-  // Функция для получения списка сокетов подключенных клиентов
-  std::vector<int> getClientSocketsOptimized(
-      const std::unordered_set<std::string> &channel_members,
-      const std::unordered_map<std::string, int> &user_socket_map);
-  // Функция для отправки аудиофайла другому клиенту
-  void sendAudiofiletoClient(const std::string &audioId, MySocket &client);
+                       const User &sender, std::string &channel);
+  // Рассылка участникам канала, вошедшим на этот и другие узлы; senderId -
+  // UUID отправителя, которому кадр не нужен
+  void deliverToMembers(const std::unordered_set<LocalId> &members,
+                        const Message &message, const std::string &senderId);
+  // Функция для отправки аудиофайла другому клиенту; acceptsOpus - клиент
+  // сам декодирует сжатую копию
+  void sendAudiofiletoClient(const std::string &audioId, MySocket &client,
+                             bool acceptsOpus);
+  // Отправка частями для проигрывания по мере приёма; false, если файл
+  // нельзя отдать частями и его нужно отправить целиком
+  bool streamVoicemailToClient(const std::string &audioId, MySocket &client,
+                               bool acceptsOpus);
   void helpToUse(const char *programName);  // вывод справки
   bool addChannelOnServer(std::string &channel);
+  bool deleteChannelOnServer(std::string &channel);
+  // Каналы всех узлов кластера
+  std::string listChannels();
   void processAudioMessage(const Message &message, const std::string &senderIP,
-                           const std::string &senderNickname);
-  void proccessFileMessage(const Message &message,
-                           const std::string &senderNickname);
+                           LocalId senderId);
+  void proccessFileMessage(const Message &message, LocalId senderId);
+  // Запись сохранённого файла и голосового сообщения в историю канала
+  void storeFileMessage(LocalId senderId, const std::string &channel,
+                        const std::string &fileMessageIDStr,
+                        std::string fileName, uint32_t fileSize);
+  void storeAudioMessage(LocalId senderId, const std::string &senderIP,
+                         const std::string &channel,
+                         const std::string &audioMessageIDStr,
+                         const std::string &audioFilePath, double duration);
+  // Перестраивает channelAudioMessages по истории каналов; возвращает сводку
+  std::string reindexAudio();
+  // UPLOAD_BEGIN, UPLOAD_CHUNK и UPLOAD_END
+  void processUploadMessage(MySocket &client, User &user, Message &message);
   bool removeMembersFromDeleteChannel(std::string &channel);
+  // Проверка лимитов кадра; false - кадр отброшен, клиент предупреждён
+  bool admitMessage(MySocket &client, const User &user,
+                    ConnectionRateLimits &limits, Message &message);
   void messageProcessing(
       MySocket &client, User &user,
       std::string &channel);  // обработка сообщений от клиента
@@ -85,23 +137,37 @@ class Server {
                             std::string login,
                             std::string password);  // регистрация пользователя
   bool checkLogin(const std::string &login, User &user, int regOrlog);
-  bool loginInSet(std::string login, std::unordered_set<std::string> set);
   bool checkPasswordServer(const std::string &password, User &user);
   bool checkPasswordAthorization(const std::string &login,
                                  const std::string &password);
-  std::string hashPassword(const std::string &password,
-                           const std::string &salt);
   bool checkNickname(const std::string &nickname, User &user);
+  // Текст для порта администратора: metricsExposition и кэш истории
+  std::string prometheusReport();
+  // Кадр другого узла кластера; ответ нужен запросам с requestId
+  Message handleClusterMessage(const Message &message);
+  // Восстановление сессии по токену одним кадром RESUME
+  bool resumeSession(MySocket &client, User &user, std::string &channel,
+                     const std::string &body);
 
  private:
   void commandProcessing(MySocket &client, User &user,
                          Message &message);  // обработка команд
+  // Команда канала (слово 1 - канал) здесь или на узле-владельце
+  std::string runChannelCommand(const CommandEntry &entry,
+                                const CommandTokens &words,
+                                const std::string &command, User &user);
+  // Создание и удаление канала на узле-владельце; печатает его ответ
+  bool requestChannelChange(ClusterOp op, const std::string &channel);
 };
 
 void serverCommand(int port, Server &server);
+void snapshotLoop(Server &server);  // периодическая запись снимка
+void metricsDumpLoop(Server &server);  // периодическая запись METRICS_DUMP_FILE
 void handleClient(int clientSocket,
                   Server &server);  // обработка клиента
 void signalHandlerServer(
     int signal);  // обработка сигналов для правильного отключения клиента
+// Счётчик байт для MySocket::setTrafficCounter
+void recordTraffic(bool outgoing, DataType type, size_t bytes);
 bool writeAudioFile(const std::string &filename,
                     const std::vector<uint8_t> &data);
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#define SESSION_KEY_FILE "./users/session.key"
+#define SESSION_KEY_SIZE 32
+#define SESSION_TOKEN_TTL_SEC (7 * 24 * 60 * 60)  // Срок действия токена
+
+/**
+ * @brief Выдача и проверка подписанных токенов сессии
+ *
+ * @details
+ * Токен имеет вид "<uuid>.<срок действия, с>.<HMAC-SHA256 в hex>". Ключ
+ * подписи создаётся при первом запуске и хранится в ./users/session.key,
+ * поэтому токены остаются действительными после перезапуска сервера.
+ * Клиент предъявляет токен одним кадром RESUME вместо повторного входа.
+ */
+class SessionTokens {
+ public:
+  SessionTokens();
+  std::string issue(const std::string &userId);
+  // true, если подпись верна и срок не истёк; userId - владелец токена
+  bool verify(const std::string &token, std::string &userId);
+
+ private:
+  std::string key;
+
+  std::string sign(const std::string &payload);
+};
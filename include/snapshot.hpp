@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define SNAPSHOT_DIRECTORY "./snapshot/"
+#define SNAPSHOT_FILE "./snapshot/server.snap"
+#define SNAPSHOT_MAGIC 0x50414e5354414843ULL  // "CHATSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_INTERVAL_SEC 300  // Период записи снимка сервером
+
+/**
+ * @brief Запись двоичного снимка состояния сервера
+ *
+ * @details
+ * Данные копятся в памяти и записываются во временный файл, который затем
+ * переименовывается, поэтому прерванная запись не портит прежний снимок.
+ * Числа хранятся в порядке байтов машины: снимок читает тот же сервер.
+ */
+class SnapshotWriter {
+ public:
+  void writeU32(uint32_t value);
+  void writeU64(uint64_t value);
+  void writeString(const std::string &value);
+  void writeBytes(const void *data, size_t size);
+  bool commit(const std::string &path);
+
+ private:
+  std::string buffer;
+};
+
+/**
+ * @brief Чтение снимка, отображённого в память через mmap
+ *
+ * @details
+ * Все методы проверяют границы и возвращают false, если снимок обрезан.
+ */
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(const std::string &path);
+  ~SnapshotReader();
+  SnapshotReader(const SnapshotReader &) = delete;
+  SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+  bool isOpen() const { return data != nullptr; }
+  bool readU32(uint32_t &value);
+  bool readU64(uint64_t &value);
+  bool readString(std::string &value);
+  bool readBytes(void *out, size_t count);
+
+ private:
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  size_t position = 0;
+};
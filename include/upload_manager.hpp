@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "blob_store.hpp"
+#include "mysocket.hpp"
+#include "user_registry.hpp"
+
+#define UPLOAD_DIRECTORY "channels/uploads/"
+#define UPLOAD_IDLE_TIMEOUT_SEC (24 * 60 * 60)  // Брошенные загрузки удаляются
+#define UPLOAD_MAX_PER_USER 4                   // Незавершённых загрузок
+// Голосовое отдаётся клиенту одним кадром AUDIO вместе с именем файла
+#define UPLOAD_AUDIO_MAX_SIZE (MESSAGE_MAX_SIZE - 4096)
+
+enum class UploadKind { FILE, AUDIO };
+
+struct Upload {
+  uint64_t id = 0;
+  LocalId owner = INVALID_LOCAL_ID;
+  UploadKind kind = UploadKind::FILE;
+  std::string channel;
+  std::string filename;
+  std::string partPath;  // Принятые данные: channels/uploads/<id>.part
+  uint64_t totalSize = 0;
+  uint64_t received = 0;
+  bool writing = false;  // Часть уже пишется другим потоком
+  std::shared_ptr<Sha256> hash;  // SHA-256 принятых байт
+  std::time_t lastActivity = 0;
+};
+
+/**
+ * @brief Загрузки файлов и голосовых сообщений по частям
+ *
+ * @details
+ * Каждая часть дописывается в <id>.part сразу после приёма, поэтому на
+ * загрузку в памяти держится не больше одной части. Состояние загрузки
+ * живёт дольше соединения: после переподключения тот же пользователь
+ * продолжает её с подтверждённого смещения. При запуске сервера
+ * оставшиеся .part файлы удаляются.
+ */
+class UploadManager {
+ public:
+  UploadManager();
+
+  // UPLOAD_BEGIN: новая загрузка или продолжение существующей
+  bool begin(LocalId owner, const std::string &body, Upload &upload,
+             std::string &error);
+  // UPLOAD_CHUNK: часть пишется, только если её смещение совпадает с уже
+  // принятым; в received возвращается подтверждённое смещение
+  bool writeChunk(LocalId owner, const Message &chunk, uint64_t &uploadId,
+                  uint64_t &received, std::string &error);
+  // UPLOAD_END: загрузка забирается из списка, .part переносит вызывающий
+  bool finish(LocalId owner, uint64_t uploadId, Upload &upload,
+              std::string &error);
+
+ private:
+  std::mutex uploadsMutex;
+  std::unordered_map<uint64_t, Upload> uploads;
+  std::mt19937_64 random;
+
+  void expireLocked(std::time_t now);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <boost/functional/hash.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bloom_filter.hpp"
+#include "snapshot.hpp"
+
+// Плотный локальный номер пользователя (порядковый номер в users.txt)
+using LocalId = uint32_t;
+#define INVALID_LOCAL_ID UINT32_MAX
+
+bool parseUuid(const std::string &text, boost::uuids::uuid &uuid);
+
+/**
+ * @brief Сопоставление UUID пользователей с плотными 32-битными номерами
+ *
+ * @details
+ * Номер выдаётся в порядке строк users.txt, поэтому он постоянен между
+ * запусками и хранится вместо 36-символьного UUID в файлах участников,
+ * истории и индексах. UUID в виде строки используется только в протоколе.
+ * Логины и ники проиндексированы для проверки занятости при регистрации;
+ * перед индексом стоит фильтр Блума, отвечающий "свободен" без поиска.
+ */
+class UserRegistry {
+ public:
+  // Регистрирует UUID (если его ещё нет) и возвращает его номер
+  LocalId intern(const boost::uuids::uuid &uuid);
+  LocalId find(const std::string &text);
+  // Номер из строки файла: десятичный номер или UUID в старом формате;
+  // INVALID_LOCAL_ID, если такого пользователя нет
+  LocalId parseStored(const std::string &text);
+  std::string toString(LocalId localId);
+  // Ник без логина (заглушка с другого узла) в индекс ников не попадает
+  void setNickname(LocalId localId, const std::string &nickname);
+  std::string nickname(LocalId localId);
+  void setLogin(LocalId localId, const std::string &login);
+  bool loginExists(const std::string &login);
+  // false у заглушек участников с других узлов кластера
+  bool hasLogin(LocalId localId);
+  bool nicknameExists(const std::string &nickname);
+  LocalId findNickname(const std::string &nickname);
+  size_t size();
+  void saveSnapshot(SnapshotWriter &writer);
+  // Заменяет содержимое реестра данными снимка; false, если снимок повреждён
+  bool loadSnapshot(SnapshotReader &reader);
+
+ private:
+  std::mutex registryMutex;
+  std::vector<boost::uuids::uuid> uuids;  // Номер -> UUID
+  std::vector<std::string> nicknames;     // Номер -> ник
+  std::vector<std::string> logins;        // Номер -> логин
+  std::unordered_map<boost::uuids::uuid, LocalId,
+                     boost::hash<boost::uuids::uuid>>
+      localIds;
+  std::unordered_map<std::string, LocalId> loginIndex;
+  std::unordered_map<std::string, LocalId> nicknameIndex;
+  BloomFilter loginFilter;
+  BloomFilter nicknameFilter;
+
+  // Добавление ключа в фильтр; переполненный фильтр строится заново вдвое
+  // большим по точному индексу
+  static void addToFilter(BloomFilter &filter,
+                          const std::unordered_map<std::string, LocalId> &index,
+                          const std::string &key);
+  static bool existsIn(const BloomFilter &filter,
+                       const std::unordered_map<std::string, LocalId> &index,
+                       const std::string &key);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <opus/opus.h>
+#include <sndfile.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define VOICEMAIL_CODEC_NAME "opus"        // Клиент дописывает к /voicemail_on
+#define VOICEMAIL_STREAM_OPTION "stream"   // Отдавать частями по мере чтения
+#define VOICEMAIL_OPUS_EXTENSION ".opus"
+#define VOICEMAIL_OPUS_MAGIC "VMOP"
+#define VOICEMAIL_OPUS_VERSION 1
+#define VOICEMAIL_OPUS_HEADER_SIZE 20
+#define VOICEMAIL_OPUS_FRAMES_PER_SECOND 50    // Пакет на 20 мс
+#define VOICEMAIL_OPUS_BITRATE_PER_CHANNEL 24000
+#define VOICEMAIL_OPUS_MAX_PACKET 4000
+
+/*
+ * Контейнер сжатого голосового сообщения:
+ *   "VMOP", версия u8, каналы u8, pre-skip u16,
+ *   частота u32, число кадров PCM u64 (все в сетевом порядке),
+ *   далее пакеты Opus по 20 мс, каждый с длиной u16.
+ * Pre-skip - задержка кодера, столько первых кадров декодер отбрасывает;
+ * число кадров обрезает дополнение нулями в последнем пакете.
+ */
+
+struct VoicemailHeader {
+  int channels = 0;
+  int sampleRate = 0;
+  uint16_t preSkip = 0;
+  uint64_t frames = 0;
+};
+
+bool parseVoicemailHeader(const uint8_t *data, size_t size,
+                          VoicemailHeader &header);
+// Кодирует WAV-файл; false, если формат не подходит для Opus
+bool encodeVoicemail(const std::string &wavPath, std::vector<uint8_t> &encoded,
+                     std::string &error);
+// Восстанавливает PCM (int16, каналы чередуются)
+bool decodeVoicemail(const std::vector<uint8_t> &encoded,
+                     std::vector<int16_t> &pcm, int &sampleRate,
+                     int &channels);
+// Длительность по заголовку контейнера, 0 при ошибке
+double encodedVoicemailDuration(const std::string &path);
+// WAV PCM 16 бит в памяти
+std::vector<uint8_t> pcmToWav(const std::vector<int16_t> &pcm, int sampleRate,
+                              int channels);
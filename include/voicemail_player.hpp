@@ -0,0 +1,149 @@
+#pragma once
+
+#include <opus/opus.h>
+#include <portaudio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define VOICEMAIL_RING_SECONDS 2        // Декодированный звук впереди вывода
+#define VOICEMAIL_OUTPUT_FRAMES 240     // Кадров на вызов PortAudio, 5 мс
+#define VOICEMAIL_RING_WAIT_MS 5        // Пауза декодера при полном буфере
+#define VOICE_RING_MS 400     // Ёмкость буфера живого голоса
+#define VOICE_MAX_LAG_MS 120  // Уже столько в буфере - новый кадр опоздал
+
+// Pa_Initialize и Pa_Terminate нельзя вызывать из нескольких потоков сразу:
+// пользователи PortAudio считаются под мьютексом, Pa_Terminate вызывается
+// при уходе последнего
+PaError acquirePortAudio();
+void releasePortAudio();
+
+/**
+ * @brief Кольцевой буфер сэмплов на одного писателя и одного читателя
+ *
+ * @details
+ * Пишет поток декодирования, читает обратный вызов PortAudio, которому
+ * нельзя ждать мьютекс. Позиции только растут, ёмкость - степень двойки.
+ */
+class SampleRing {
+ public:
+  explicit SampleRing(size_t capacity);
+
+  size_t write(const int16_t *data, size_t count);
+  size_t read(int16_t *data, size_t count);
+  size_t available() const;
+
+ private:
+  std::vector<int16_t> buffer;
+  size_t mask;
+  std::atomic<size_t> head{0};  // Следующая запись
+  std::atomic<size_t> tail{0};  // Следующее чтение
+};
+
+/**
+ * @brief Вывод живого голоса канала
+ *
+ * @details
+ * Поток вывода открывается на первом кадре и остаётся открытым до выхода:
+ * кадры VOICE приходят каждые 10 мс, открывать устройство на каждый дольше,
+ * чем играть сам кадр. play вызывает только исполнитель голоса, он пишет
+ * сэмплы в SampleRing, откуда их забирает PortAudio. Если в буфере уже
+ * больше VOICE_MAX_LAG_MS, кадр отбрасывается: опоздавший голос не нужен,
+ * а задержка иначе только растёт.
+ */
+class VoiceOutput {
+ public:
+  VoiceOutput(int sampleRate, int channels);
+  ~VoiceOutput();
+
+  // Чередующиеся сэмплы всех каналов; false - кадр отброшен
+  bool play(const int16_t *samples, size_t count);
+
+ private:
+  int sampleRate;
+  int channels;
+  SampleRing ring;
+  PaStream *stream = nullptr;
+  bool unavailable = false;  // Устройство не открылось: не пытаемся снова
+  uint64_t dropped = 0;
+
+  static int playbackCallback(const void *input, void *output,
+                              unsigned long frameCount,
+                              const PaStreamCallbackTimeInfo *timeInfo,
+                              PaStreamCallbackFlags statusFlags,
+                              void *userData);
+  bool open();
+};
+
+/**
+ * @brief Воспроизведение голосового сообщения по мере приёма
+ *
+ * @details
+ * Поток приёма только складывает части в очередь и сразу возвращается.
+ * Поток декодирования превращает их в PCM и пишет в SampleRing, откуда
+ * звук забирает PortAudio. Вывод запускается на первом кадре, поэтому
+ * звук начинается с первой частью, а не после загрузки всего файла.
+ * Сохранение на диск необязательно и выполняется тем же потоком
+ * декодирования после последней части.
+ */
+class VoicemailPlayer {
+ public:
+  ~VoicemailPlayer();
+
+  // /voicemail_on отправлен: засекаем время и запоминаем, куда сохранить
+  void expect(const std::string &saveDirectory);
+  // VOICEMAIL_STREAM_BEGIN: "<id> <opus|pcm> <частота> <каналы> <кадры>
+  // [pre-skip]"
+  bool begin(const std::string &header);
+  // Части VOICEMAIL_STREAM_CHUNK; не блокирует поток приёма
+  void push(std::vector<uint8_t> chunk);
+  void end();
+  // Целиком принятый файл проигрывается так же, одной частью
+  bool playPcm(const std::string &id, const std::vector<int16_t> &pcm,
+               int sampleRate, int channels);
+  void stop();
+
+ private:
+  std::mutex streamMutex;  // begin/stop из разных потоков
+  std::mutex chunksMutex;
+  std::condition_variable chunksCondition;
+  std::deque<std::vector<uint8_t>> chunks;
+  bool finished = false;
+  std::atomic<bool> stopping{false};
+
+  std::string id;
+  bool opusCodec = false;
+  int sampleRate = 0;
+  int channels = 0;
+  uint64_t totalFrames = 0;
+  uint64_t skipFrames = 0;  // Задержка кодера Opus
+  std::string saveDirectory;
+  std::string pendingSaveDirectory;
+  std::chrono::steady_clock::time_point requested;
+  std::chrono::steady_clock::time_point playbackRequested;
+
+  std::unique_ptr<SampleRing> ring;
+  std::atomic<bool> heard{false};
+  std::chrono::steady_clock::time_point firstAudio;
+  PaStream *stream = nullptr;
+  OpusDecoder *decoder = nullptr;
+  std::thread decodeThread;
+
+  static int playbackCallback(const void *input, void *output,
+                              unsigned long frameCount,
+                              const PaStreamCallbackTimeInfo *timeInfo,
+                              PaStreamCallbackFlags statusFlags,
+                              void *userData);
+  void decodeLoop();
+  void writeSamples(const int16_t *samples, size_t frames,
+                    std::vector<int16_t> &saved, uint64_t &written);
+  void closeStream();
+};
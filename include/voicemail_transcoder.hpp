@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "blob_store.hpp"
+#include "voicemail_codec.hpp"
+
+#define VOICEMAIL_TRANSCODE_QUEUE_CAPACITY 256  // Лишние остаются в WAV
+
+/**
+ * @brief Фоновое перекодирование голосовых сообщений в Opus
+ *
+ * @details
+ * Новое голосовое сообщение сначала сохраняется как есть и сразу доступно.
+ * Отдельный поток кодирует его в Opus, после чего сжатая копия заменяет WAV
+ * в хранилище вложений. WAV для клиентов без поддержки Opus собирается при
+ * запросе и на диске не хранится. Файлы, которые Opus не принимает
+ * (нестандартная частота, больше двух каналов), остаются в WAV. Исходные
+ * байты, на которые ссылается и вложение, хранятся рядом со сжатой копией.
+ * При запуске в очередь попадают голосовые без сжатой копии: очередь
+ * остановленного сервера теряется.
+ */
+class VoicemailTranscoder {
+ public:
+  explicit VoicemailTranscoder(BlobStore &blobStore);
+  ~VoicemailTranscoder();
+
+  void enqueue(const std::string &digest);
+  std::string stats();
+
+ private:
+  BlobStore &blobStore;
+  bool stopping = false;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::deque<std::string> queue;
+  std::thread worker;
+
+  uint64_t transcoded = 0;
+  uint64_t skipped = 0;
+  uint64_t wavBytes = 0;
+  uint64_t opusBytes = 0;
+
+  void workerLoop();
+};
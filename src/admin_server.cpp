@@ -0,0 +1,112 @@
+#include "../include/admin_server.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+
+AdminServer::AdminServer(std::function<std::string()> render)
+    : render(std::move(render)) {}
+
+AdminServer::~AdminServer() { stop(); }
+
+bool AdminServer::start(int port) {
+  listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenSocket < 0) {
+    return false;
+  }
+  int opt = 1;
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(listenSocket, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listenSocket, 8) < 0) {
+    close(listenSocket);
+    listenSocket = -1;
+    return false;
+  }
+  running = true;
+  worker = std::thread(&AdminServer::run, this);
+  return true;
+}
+
+void AdminServer::stop() {
+  running = false;
+  if (worker.joinable()) {
+    worker.join();
+  }
+  if (listenSocket >= 0) {
+    close(listenSocket);
+    listenSocket = -1;
+  }
+}
+
+void AdminServer::run() {
+  while (running) {
+    pollfd listener{listenSocket, POLLIN, 0};
+    if (poll(&listener, 1, ADMIN_POLL_MS) <= 0) {
+      continue;
+    }
+    int client = accept(listenSocket, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    timeval timeout{ADMIN_IO_TIMEOUT_MS / 1000,
+                    (ADMIN_IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    serve(client);
+    close(client);
+  }
+}
+
+void AdminServer::serve(int socket) {
+  // Тело запроса не нужно: читаем только строку запроса и заголовки
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < ADMIN_REQUEST_MAX) {
+    ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+    if (received <= 0) {
+      return;
+    }
+    request.append(buffer, received);
+  }
+
+  std::istringstream line(request.substr(0, request.find("\r\n")));
+  std::string method, target;
+  line >> method >> target;
+  std::string status = "200 OK";
+  std::string body;
+  if (method != "GET") {
+    status = "405 Method Not Allowed";
+  } else if (target != "/metrics") {
+    status = "404 Not Found";
+  } else {
+    body = render();
+  }
+
+  std::ostringstream response;
+  response << "HTTP/1.1 " << status << "\r\n"
+           << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << body;
+  std::string data = response.str();
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t written =
+        send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (written <= 0) {
+      return;
+    }
+    sent += written;
+  }
+}
@@ -0,0 +1,21 @@
+#include "../include/audio_mix.hpp"
+
+#include <cstring>
+
+void mix_audio_buffers(std::vector<int16_t *> &buffers, int16_t *output,
+                       int frame_count, int channels) {
+  memset(output, 0, frame_count * channels * sizeof(int16_t));
+
+  for (int i = 0; i < frame_count * channels; ++i) {
+    int32_t mixed_sample = 0;
+    for (auto &buffer : buffers) {
+      mixed_sample += buffer[i];
+    }
+
+    // Ограничение значений, чтобы избежать переполнения
+    if (mixed_sample > INT16_MAX) mixed_sample = INT16_MAX;
+    if (mixed_sample < INT16_MIN) mixed_sample = INT16_MIN;
+
+    output[i] = static_cast<int16_t>(mixed_sample);
+  }
+}
@@ -0,0 +1,218 @@
+#include "../include/auth_pool.hpp"
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <future>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "../include/metrics.hpp"
+
+static std::string toHex(const unsigned char *data, size_t size) {
+  std::ostringstream oss;
+  for (size_t i = 0; i < size; ++i) {
+    oss << std::hex << std::setw(2) << std::setfill('0')
+        << static_cast<int>(data[i]);
+  }
+  return oss.str();
+}
+
+static std::string fromHex(const std::string &hex) {
+  std::string bytes;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    bytes += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+  }
+  return bytes;
+}
+
+AuthWorkerContext::AuthWorkerContext() {
+  mdContext = EVP_MD_CTX_new();
+  EVP_KDF *kdf = EVP_KDF_fetch(nullptr, "PBKDF2", nullptr);
+  if (kdf != nullptr) {
+    kdfContext = EVP_KDF_CTX_new(kdf);
+    EVP_KDF_free(kdf);
+  }
+  if (mdContext == nullptr || kdfContext == nullptr) {
+    throw std::runtime_error("Failed to create OpenSSL contexts");
+  }
+}
+
+AuthWorkerContext::~AuthWorkerContext() {
+  EVP_MD_CTX_free(mdContext);
+  EVP_KDF_CTX_free(kdfContext);
+}
+
+std::string AuthWorkerContext::sha256(const std::string &data) {
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int hashLength = 0;
+  if (!EVP_DigestInit_ex(mdContext, EVP_sha256(), nullptr) ||
+      !EVP_DigestUpdate(mdContext, data.data(), data.size()) ||
+      !EVP_DigestFinal_ex(mdContext, hash, &hashLength)) {
+    throw std::runtime_error("SHA-256 failed");
+  }
+  return toHex(hash, hashLength);
+}
+
+std::string AuthWorkerContext::pbkdf2(const std::string &password,
+                                      const std::string &salt,
+                                      uint32_t iterations) {
+  unsigned char key[32];
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST,
+                                       const_cast<char *>("SHA256"), 0),
+      OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PASSWORD,
+                                        const_cast<char *>(password.data()),
+                                        password.size()),
+      OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+                                        const_cast<char *>(salt.data()),
+                                        salt.size()),
+      OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ITER, &iterations),
+      OSSL_PARAM_construct_end()};
+  EVP_KDF_CTX_reset(kdfContext);
+  if (EVP_KDF_derive(kdfContext, key, sizeof(key), params) != 1) {
+    throw std::runtime_error("PBKDF2 failed");
+  }
+  return toHex(key, sizeof(key));
+}
+
+std::string makePasswordHash(AuthWorkerContext &context,
+                             const std::string &password) {
+  unsigned char salt[AUTH_SALT_SIZE];
+  if (RAND_bytes(salt, sizeof(salt)) != 1) {
+    throw std::runtime_error("RAND_bytes failed");
+  }
+  std::string saltBytes(reinterpret_cast<char *>(salt), sizeof(salt));
+  return "pbkdf2$" + std::to_string(AUTH_PBKDF2_ITERATIONS) + "$" +
+         toHex(salt, sizeof(salt)) + "$" +
+         context.pbkdf2(password, saltBytes, AUTH_PBKDF2_ITERATIONS);
+}
+
+bool checkPasswordHash(AuthWorkerContext &context, const std::string &password,
+                       const std::string &stored) {
+  std::string expected;
+  if (stored.rfind("pbkdf2$", 0) == 0) {
+    std::istringstream iss(stored.substr(7));
+    std::string iterations, salt, hash;
+    if (!std::getline(iss, iterations, '$') || !std::getline(iss, salt, '$') ||
+        !std::getline(iss, hash)) {
+      return false;
+    }
+    expected = "pbkdf2$" + iterations + "$" + salt + "$" +
+               context.pbkdf2(password, fromHex(salt), std::stoul(iterations));
+  } else {
+    // Пароли, сохранённые до перехода на PBKDF2
+    expected = context.sha256(password + LEGACY_PASSWORD_SALT);
+  }
+  return expected.size() == stored.size() &&
+         CRYPTO_memcmp(expected.data(), stored.data(), stored.size()) == 0;
+}
+
+AuthPool::AuthPool(size_t workers, size_t capacity)
+    : capacity(capacity), latencies(AUTH_LATENCY_SAMPLES, 0.0) {
+  for (size_t i = 0; i < workers; ++i) {
+    threads.emplace_back(&AuthPool::workerLoop, this);
+  }
+}
+
+AuthPool::~AuthPool() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void AuthPool::workerLoop() {
+  AuthWorkerContext context;
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+
+    bool success = true;
+    try {
+      task.function(context);
+    } catch (const std::exception &e) {
+      success = false;
+    }
+    recordLatency(std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - task.enqueued)
+                      .count());
+    task.done(success);
+  }
+}
+
+bool AuthPool::run(const std::function<void(AuthWorkerContext &)> &task) {
+  std::promise<bool> result;
+  std::future<bool> future = result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    recordMetric(Metric::QUEUE_AUTH, tasks.size());
+    if (tasks.size() >= capacity) {
+      std::lock_guard<std::mutex> latencyLock(latencyMutex);
+      ++rejected;
+      return false;
+    }
+    tasks.push({task, std::chrono::steady_clock::now(),
+                [&result](bool success) { result.set_value(success); }});
+  }
+  queueCondition.notify_one();
+  return future.get();
+}
+
+void AuthPool::recordLatency(double milliseconds) {
+  std::lock_guard<std::mutex> lock(latencyMutex);
+  latencies[latencyPosition] = milliseconds;
+  latencyPosition = (latencyPosition + 1) % latencies.size();
+  ++completed;
+}
+
+size_t AuthPool::queueDepth() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return tasks.size();
+}
+
+double AuthPool::p99LatencyMs() {
+  std::vector<double> samples;
+  {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    size_t count = std::min<uint64_t>(completed, latencies.size());
+    samples.assign(latencies.begin(), latencies.begin() + count);
+  }
+  if (samples.empty()) {
+    return 0.0;
+  }
+  size_t index = (samples.size() * 99 + 99) / 100 - 1;
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+std::string AuthPool::stats() {
+  uint64_t done, refused;
+  {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    done = completed;
+    refused = rejected;
+  }
+  std::ostringstream oss;
+  oss << "Auth pool: queue " << queueDepth() << "/" << capacity << ", workers "
+      << threads.size() << ", completed " << done << ", rejected " << refused
+      << ", p99 " << std::fixed << std::setprecision(1) << p99LatencyMs()
+      << " ms";
+  return oss.str();
+}
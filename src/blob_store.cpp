@@ -0,0 +1,256 @@
+#include "../include/blob_store.hpp"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+Sha256::Sha256() {
+  context = EVP_MD_CTX_new();
+  EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+}
+
+Sha256::~Sha256() { EVP_MD_CTX_free(context); }
+
+void Sha256::update(const uint8_t *data, size_t size) {
+  EVP_DigestUpdate(context, data, size);
+}
+
+std::string Sha256::finalHex() {
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int hashLength = 0;
+  EVP_DigestFinal_ex(context, hash, &hashLength);
+
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(hashLength * 2);
+  for (unsigned int i = 0; i < hashLength; ++i) {
+    hex += digits[hash[i] >> 4];
+    hex += digits[hash[i] & 0x0f];
+  }
+  return hex;
+}
+
+BlobStore::BlobStore() {
+  std::error_code ec;
+  std::filesystem::create_directories(BLOB_DIRECTORY, ec);
+
+  std::ifstream refsFile(BLOB_REFS_FILE);
+  std::string line;
+  while (std::getline(refsFile, line)) {
+    std::istringstream iss(line);
+    std::string first, digest, kind;
+    Blob blob;
+    if (!(iss >> first)) {
+      continue;
+    }
+    // Запись без вида - из журнала до голосовых: считаем вложением
+    if (first == "+") {
+      if (iss >> digest >> blob.size) {
+        iss >> kind;
+        Blob &known = blobs[digest];
+        ++known.refs;
+        known.fileRefs += kind != "voicemail";
+        known.size = blob.size;
+      }
+    } else if (first == "-") {
+      auto it = iss >> digest ? blobs.find(digest) : blobs.end();
+      iss >> kind;
+      if (it != blobs.end()) {
+        if (kind != "voicemail" && it->second.fileRefs > 0) {
+          --it->second.fileRefs;
+        }
+        if (--it->second.refs == 0) {
+          blobs.erase(it);
+        }
+      }
+    } else if (iss >> blob.refs >> blob.size) {
+      if (!(iss >> blob.fileRefs)) {
+        blob.fileRefs = blob.refs;
+      }
+      blobs[first] = blob;
+    }
+  }
+  refsFile.close();
+  for (auto it = blobs.begin(); it != blobs.end();) {
+    if (isDigest(it->first) && it->second.refs > 0 &&
+        (std::filesystem::exists(path(it->first), ec) ||
+         std::filesystem::exists(transcodedPath(it->first), ec))) {
+      ++it;
+    } else {
+      it = blobs.erase(it);
+    }
+  }
+  // Оборванная последняя строка или старый формат: начинаем журнал заново
+  compactRefs();
+}
+
+std::string BlobStore::path(const std::string &digest) const {
+  return BLOB_DIRECTORY + digest;
+}
+
+std::string BlobStore::transcodedPath(const std::string &digest) const {
+  return BLOB_DIRECTORY + digest + BLOB_TRANSCODED_SUFFIX;
+}
+
+bool BlobStore::isDigest(const std::string &id) {
+  if (id.size() != BLOB_DIGEST_LENGTH) {
+    return false;
+  }
+  for (char c : id) {
+    if (!std::isxdigit(static_cast<unsigned char>(c)) || std::isupper(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void BlobStore::logRefLocked(char change, const std::string &digest,
+                             BlobRef ref, uint64_t size) {
+  refsLog << change << ' ' << digest;
+  if (change == '+') {
+    refsLog << ' ' << size;
+  }
+  refsLog << (ref == BlobRef::FILE ? " file\n" : " voicemail\n");
+  refsLog.flush();
+}
+
+bool BlobStore::needsRawLocked(const std::string &digest, BlobRef ref) {
+  std::error_code ec;
+  return ref == BlobRef::FILE && !std::filesystem::exists(path(digest), ec);
+}
+
+bool BlobStore::compactRefs() {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  std::string tmpPath = std::string(BLOB_REFS_FILE) + ".tmp";
+  {
+    std::ofstream refsFile(tmpPath, std::ios::trunc);
+    for (const auto &[digest, blob] : blobs) {
+      refsFile << digest << ' ' << blob.refs << ' ' << blob.size << ' '
+               << blob.fileRefs << '\n';
+    }
+    if (!refsFile.flush()) {
+      return false;
+    }
+  }
+  refsLog.close();
+  bool renamed = std::rename(tmpPath.c_str(), BLOB_REFS_FILE) == 0;
+  refsLog.open(BLOB_REFS_FILE, std::ios::app);
+  return renamed;
+}
+
+bool BlobStore::addFile(const std::string &tempPath, const std::string &digest,
+                        uint64_t size, BlobRef ref) {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  auto it = blobs.find(digest);
+  std::error_code ec;
+  if (it != blobs.end() && !needsRawLocked(digest, ref)) {
+    // Повтор: копия не нужна
+    std::remove(tempPath.c_str());
+    savedBytes += size;
+  } else {
+    std::filesystem::rename(tempPath, path(digest), ec);
+    if (ec) {
+      return false;
+    }
+  }
+  Blob &blob = blobs[digest];
+  ++blob.refs;
+  blob.fileRefs += ref == BlobRef::FILE;
+  blob.size = size;
+  logRefLocked('+', digest, ref, size);
+  return true;
+}
+
+std::string BlobStore::addBuffer(const std::vector<uint8_t> &data,
+                                 BlobRef ref) {
+  Sha256 hash;
+  hash.update(data.data(), data.size());
+  std::string digest = hash.finalHex();
+
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  auto it = blobs.find(digest);
+  if (it != blobs.end() && !needsRawLocked(digest, ref)) {
+    savedBytes += data.size();
+  } else {
+    std::string tmpPath = path(digest) + ".tmp";
+    std::ofstream blobFile(tmpPath, std::ios::binary | std::ios::trunc);
+    blobFile.write(reinterpret_cast<const char *>(data.data()), data.size());
+    blobFile.close();
+    if (blobFile.fail() || std::rename(tmpPath.c_str(), path(digest).c_str())) {
+      std::remove(tmpPath.c_str());
+      return "";
+    }
+  }
+  Blob &blob = blobs[digest];
+  ++blob.refs;
+  blob.fileRefs += ref == BlobRef::FILE;
+  blob.size = data.size();
+  logRefLocked('+', digest, ref, data.size());
+  return digest;
+}
+
+void BlobStore::release(const std::string &digest, BlobRef ref) {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  auto it = blobs.find(digest);
+  if (it == blobs.end()) {
+    return;
+  }
+  Blob &blob = it->second;
+  std::error_code ec;
+  if (--blob.refs == 0) {
+    std::remove(path(digest).c_str());
+    std::remove(transcodedPath(digest).c_str());
+    blobs.erase(it);
+  } else if (ref == BlobRef::FILE && blob.fileRefs > 0 &&
+             --blob.fileRefs == 0 &&
+             std::filesystem::exists(transcodedPath(digest), ec)) {
+    // Остались только голосовые, им хватает сжатой копии
+    std::remove(path(digest).c_str());
+  }
+  logRefLocked('-', digest, ref);
+}
+
+bool BlobStore::storeTranscoded(const std::string &digest,
+                                const std::string &tempPath) {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  // Блоб мог быть удалён, пока шло перекодирование
+  if (blobs.count(digest) == 0 ||
+      std::rename(tempPath.c_str(), transcodedPath(digest).c_str()) != 0) {
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  // Те же байты отправлены и как вложение - его отдают без перекодирования
+  if (blobs[digest].fileRefs == 0) {
+    std::remove(path(digest).c_str());
+  }
+  return true;
+}
+
+std::vector<std::string> BlobStore::untranscodedVoicemails() {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  std::vector<std::string> digests;
+  std::error_code ec;
+  for (const auto &[digest, blob] : blobs) {
+    if (blob.refs > blob.fileRefs &&
+        !std::filesystem::exists(transcodedPath(digest), ec) &&
+        std::filesystem::exists(path(digest), ec)) {
+      digests.push_back(digest);
+    }
+  }
+  return digests;
+}
+
+std::string BlobStore::stats() {
+  std::lock_guard<std::mutex> lock(blobsMutex);
+  uint64_t refs = 0, storedBytes = 0;
+  for (const auto &[digest, blob] : blobs) {
+    refs += blob.refs;
+    storedBytes += blob.size;
+  }
+  std::ostringstream oss;
+  oss << "Blobs: " << blobs.size() << ", references " << refs << ", stored "
+      << storedBytes << " bytes, deduplicated " << savedBytes
+      << " bytes since start";
+  return oss.str();
+}
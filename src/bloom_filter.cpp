@@ -0,0 +1,43 @@
+#include "../include/bloom_filter.hpp"
+
+#include <algorithm>
+
+static uint64_t fnv1a(const std::string &key, uint64_t seed) {
+  uint64_t hash = 14695981039346656037ULL ^ seed;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+BloomFilter::BloomFilter(size_t expectedKeys) { reset(expectedKeys); }
+
+void BloomFilter::reset(size_t newExpectedKeys) {
+  expectedKeys = std::max<size_t>(newExpectedKeys, BLOOM_MIN_KEYS);
+  bitCount = expectedKeys * BLOOM_BITS_PER_KEY;
+  bits.assign((bitCount + 63) / 64, 0);
+  keyCount = 0;
+}
+
+void BloomFilter::add(const std::string &key) {
+  uint64_t h1 = fnv1a(key, 0);
+  uint64_t h2 = fnv1a(key, 0x9e3779b97f4a7c15ULL) | 1;
+  for (int i = 0; i < BLOOM_HASHES; ++i) {
+    uint64_t bit = (h1 + i * h2) % bitCount;
+    bits[bit / 64] |= 1ULL << (bit % 64);
+  }
+  ++keyCount;
+}
+
+bool BloomFilter::mightContain(const std::string &key) const {
+  uint64_t h1 = fnv1a(key, 0);
+  uint64_t h2 = fnv1a(key, 0x9e3779b97f4a7c15ULL) | 1;
+  for (int i = 0; i < BLOOM_HASHES; ++i) {
+    uint64_t bit = (h1 + i * h2) % bitCount;
+    if (!(bits[bit / 64] & (1ULL << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -37,17 +37,145 @@ std::string helloWindow() {
 }
 
 /**
- * Receives messages from the server and prints them to the console. If an ID
- * message is received, it is processed and sent back to the server. The
- * function continues to receive messages until the client is shut down.
+ * Handles replies to commands: in pipeline mode they are printed at once with
+ * their request id, otherwise they are shown before the next prompt.
+ *
+ * @param message The reply received from the server.
+ * @param client The client the reply belongs to.
+ */
+static void handleTextMessage(Message &message, Client &client) {
+  if (client.pipelineMode) {
+    std::cout << "#" << message.header.requestId << " "
+              << messageToString(message) << std::endl;
+  } else {
+    client.printReply(messageToString(message));
+  }
+  // Ответ на команду из конвейера обработан
+  if (message.header.requestId != 0) {
+    client.completeRequest();
+  }
+}
+
+/**
+ * Handles service flags: login and registration steps, session state,
+ * channel changes and upload acknowledgements.
+ *
+ * @param message The message received from the server.
+ * @param id A reference to the client ID, filled in on the ID request.
+ * @param client The client the message belongs to.
+ */
+static void handleControlMessage(Message &message, std::string &id,
+                                 Client &client) {
+  if (message.header.flag == Flags::ID) {
+    id = messageToString(message);
+    client.id = id;
+    message.clearMessage(message);
+    message = stringToMessage(id, message);
+    message = flagOn(message, Flags::ID);
+    if (!client.clientSocket.sendMessage(message)) {
+      std::cerr << "Failed to send ID." << std::endl;
+    }
+  } else if (message.header.flag == Flags::ID_CORRECT) {
+    std::string nick = messageToString(message);
+    client.setNickname(nick);
+    client.signalReady();
+  } else if (message.header.flag == Flags::COMPRESSION) {
+    if (messageToString(message) == COMPRESSION_NAME) {
+      client.clientSocket.enableCompression();
+    }
+  } else if (message.header.flag == Flags::UPLOAD_ACK ||
+             message.header.flag == Flags::UPLOAD_END ||
+             message.header.flag == Flags::UPLOAD_ERROR) {
+    client.uploadReply(message);
+  } else if (message.header.flag == Flags::SESSION_TOKEN) {
+    client.setSessionToken(messageToString(message));
+  } else if (message.header.flag == Flags::RESUME_FAILED) {
+    std::cout << messageToString(message) << std::endl;
+    client.resumeFailed();
+  } else if (message.header.flag == Flags::DEL_CHANNEL or
+             message.header.flag == Flags::NO_CHANNEL) {
+    // Канал приглашения принадлежит основному потоку: он применит ответ
+    // перед следующим приглашением
+    if (message.header.flag == Flags::NO_CHANNEL) {
+      client.channelRejected();
+    } else {
+      client.channelDeleted();
+    }
+    client.printReply(messageToString(message));
+  } else if (message.header.flag == Flags::CHECK_LOGIN) {
+    client.loginCorrect = true;
+    std::cout << messageToString(message) << std::endl;
+  } else if (message.header.flag == Flags::CHECK_PASSWORD) {
+    client.passwordCorrect = true;
+
+    std::cout << messageToString(message) << std::endl;
+  } else if (message.header.flag == Flags::CHECK_NICKNAME) {
+    client.nicknameCorrect = true;
+
+    std::cout << messageToString(message) << std::endl;
+  } else if (message.header.flag == Flags::REGISTERED) {
+    client.passwordCorrect = true;
+
+    client.cv.notify_all();
+  } else if (message.header.flag == Flags::AUTHORIZED) {
+    std::string nickname = messageToString(message);
+    client.setNickname(nickname);
+
+    client.passwordCorrect = true;
+  } else if (message.header.flag == Flags::CHANGE_NICK) {
+    std::string newNickname = messageToString(message);
+    client.setNickname(newNickname);
+    std::cout << "Nickname changed to: " << messageToString(message)
+              << std::endl;
+    client.signalReady();
+  } else if (message.header.flag == Flags::TIME_ON) {
+    client.timeFlag = true;
+    client.printReply(messageToString(message));
+  } else if (message.header.flag == Flags::TIME_OFF) {
+    client.timeFlag = false;
+    client.printReply(messageToString(message));
+  } else if (message.header.flag == Flags::AUDIOFILE_ERROR ||
+             message.header.flag == Flags::THROTTLED) {
+    client.printReply(messageToString(message));
+  } else if (message.header.flag == Flags::FILE_ERROR) {
+  } else {
+    std::cout << "Unknown flag: " << message.header.flag << std::endl;
+    client.signalReady();
+  }
+  if (message.header.requestId != 0) {
+    client.completeRequest();
+  }
+}
+
+/**
+ * Reads messages from the server and hands them to typed executors: command
+ * replies, live voice, voicemails and service flags each run on their own
+ * thread, so a long voicemail or a slow console does not hold up voice frames
+ * or replies. The reader itself only parses frames. It runs until the client
+ * is shut down or the connection is lost.
  *
  * @param id a reference to a string to store the ID message received from the
  * server
+ * @param client the client that owns the connection
  *
  * @throws None
  */
-void ReceiveMessage(std::string &id, std::string &currentChannel,
-                    Client &client) {
+void ReceiveMessage(std::string &id, Client &client) {
+  ClientExecutor textExecutor("text", [&client](Message &message) {
+    handleTextMessage(message, client);
+  });
+  // Голос не копится: при отстающем выводе лишние кадры отбрасываются
+  ClientExecutor voiceExecutor(
+      "voice",
+      [&client](Message &message) { client.processVoiceMessage(message); },
+      CLIENT_VOICE_INBOX_CAPACITY);
+  ClientExecutor voicemailExecutor("voicemail", [&client](Message &message) {
+    client.processAudioMessage(message);
+  });
+  ClientExecutor controlExecutor("control", [&id, &client](Message &message) {
+    handleControlMessage(message, id, client);
+  });
+
   Message message;
   while (client.clientRunning) {
     if (!client.clientSocket.receiveMessage(message)) {
@@ -56,125 +184,98 @@ void ReceiveMessage(std::string &id, std::string &currentChannel,
       break;
     }
     if (message.header.type == DataType::AUDIO) {
-      client.processAudioMessage(message);
-
+      voicemailExecutor.post(std::move(message));
     } else if (message.header.type == DataType::VOICE) {
+      voiceExecutor.post(std::move(message));
+    } else if (message.header.flag == Flags::COMMAND) {
+      textExecutor.post(std::move(message));
     } else {
-      if (message.header.flag == Flags::ID) {
-        id = messageToString(message);
-        client.id = id;
-        message.clearMessage(message);
-        message = stringToMessage(id, message);
-        message = flagOn(message, Flags::ID);
-        if (!client.clientSocket.sendMessage(message)) {
-          std::cerr << "Failed to send ID." << std::endl;
-        }
-      } else if (message.header.flag == Flags::ID_CORRECT) {
-        // std::cout << "ID CORRECT, nickname: " << messageToString(message)
-        //          << std::endl;
-        std::string nick = messageToString(message);
-        client.setNickname(nick);
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::DEL_CHANNEL or
-                 message.header.flag == Flags::NO_CHANNEL) {
-        if (message.header.flag == Flags::NO_CHANNEL) {
-          if (!client.lastChannel.empty()) {
-            currentChannel = client.lastChannel;
-            client.lastChannel = "";
-          } else {
-            currentChannel = "";
-          }
-        } else {
-          currentChannel = "";
-        }
+      controlExecutor.post(std::move(message));
+    }
+    message = Message();
+  }
+  client.cv.notify_all();
+  client.clientSocket.closeSocket();
+}
 
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
-          client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::CHECK_LOGIN) {
-        client.loginCorrect = true;
-        std::cout << messageToString(message) << std::endl;
-      } else if (message.header.flag == Flags::CHECK_PASSWORD) {
-        client.passwordCorrect = true;
-
-        std::cout << messageToString(message) << std::endl;
-      } else if (message.header.flag == Flags::CHECK_NICKNAME) {
-        client.nicknameCorrect = true;
-
-        std::cout << messageToString(message) << std::endl;
-      } else if (message.header.flag == Flags::REGISTERED) {
-        client.passwordCorrect = true;
-
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::AUTHORIZED) {
-        std::string nickname = messageToString(message);
-        client.setNickname(nickname);
-
-        client.passwordCorrect = true;
-      } else if (message.header.flag == Flags::CHANGE_NICK) {
-        std::string newNickname = messageToString(message);
-        client.setNickname(newNickname);
-        std::cout << "Nickname changed to: " << messageToString(message)
-                  << std::endl;
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
+/**
+ * Queues a reply to be printed before the next prompt and wakes the input
+ * loop.
+ *
+ * @param text The reply text.
+ */
+void Client::printReply(const std::string &text) {
+  messageQueue.push(text);
+  signalReady();
+}
 
-          // client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::TIME_ON) {
-        client.timeFlag = true;
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
-
-          client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::TIME_OFF) {
-        client.timeFlag = false;
+void Client::signalReady() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    ready = true;
+  }
+  cv.notify_all();
+}
 
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
+/**
+ * Stamps the message with a new request id and sends it. The id is echoed
+ * back in the server reply, so several commands may be in flight at once.
+ *
+ * @param message The command message to send.
+ *
+ * @return True if the message was sent, false otherwise.
+ */
+bool Client::sendCommand(Message &message) {
+  message.header.requestId = ++nextRequestId;
+  if (message.header.requestId == 0) {  // 0 - запрос без номера
+    message.header.requestId = ++nextRequestId;
+  }
+  ++inFlight;
+  if (!clientSocket.sendMessage(message)) {
+    completeRequest();
+    return false;
+  }
+  return true;
+}
 
-          client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::COMMAND) {
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
-          client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-        client.cv.notify_all();
-      } else if (message.header.flag == Flags::AUDIOFILE_ERROR) {
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
-          client.messageQueue.push(messageToString(message));
-          ready = true;
-        }
-      } else if (message.header.flag == Flags::FILE_ERROR) {
-      } else {
-        std::cout << "Unknown flag: " << message.header.flag << std::endl;
-        {
-          std::lock_guard<std::mutex> lock(client.mtx);  // Захват мьютекса
+void Client::completeRequest() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (inFlight > 0) {
+      --inFlight;
+    }
+  }
+  cv.notify_all();
+}
 
-          ready = true;
-        }
-        client.cv.notify_all();
-      }
+/**
+ * Waits until every command sent with sendCommand is answered. Gives up if
+ * no reply arrives for CLIENT_REPLY_TIMEOUT_SEC, so a lost reply does not
+ * hang the client at the end of input.
+ */
+void Client::waitForReplies() {
+  std::unique_lock<std::mutex> lock(mtx);
+  while (inFlight != 0 && clientRunning) {
+    uint32_t remaining = inFlight;
+    if (!cv.wait_for(lock, std::chrono::seconds(CLIENT_REPLY_TIMEOUT_SEC),
+                     [this, remaining] {
+                       return inFlight != remaining || !clientRunning;
+                     })) {
+      std::cerr << "No reply to " << remaining << " commands." << std::endl;
+      return;
     }
   }
-  client.clientSocket.closeSocket();
+}
+
+/**
+ * Offers frame compression to the server. A server that supports it answers
+ * with the same codec name; an old one ignores the unknown flag.
+ */
+void Client::requestCompression() {
+  Message message;
+  message = stringToMessage(COMPRESSION_NAME, message);
+  message = flagOn(message, Flags::COMPRESSION);
+  clientSocket.sendMessage(message);
 }
 
 /**
@@ -361,7 +462,7 @@ bool Client::parseArgc(int argc, char *argv[], std::string &ipPort,
 bool handleConnectCommand(const std::string &input, std::string &ipPort,
                           std::string &ip, int &port, std::string &nick,
                           std::string &channel, std::string &id,
-                          std::string &currentChannel, Client &client) {
+                          Client &client) {
   int size = input.size();
   if (size < 2) {
     return false;
@@ -388,19 +489,21 @@ bool handleConnectCommand(const std::string &input, std::string &ipPort,
     }
 
     client.clientRunning = true;
-    std::thread receiveThread(ReceiveMessage, std::ref(id),
-                              std::ref(currentChannel), std::ref(client));
+    std::thread receiveThread(ReceiveMessage, std::ref(id), std::ref(client));
     receiveThread.detach();
 
-    // Присоединение к каналу, если указан
-    if (!channel.empty()) {
-      Message message;
-      message = stringToMessage(channel, message);
-      message = flagOn(message, Flags::CHANNEL);
-      client.clientSocket.sendMessage(message);
-    }
-    if (!nick.empty()) {
-      client.registration(nick);
+    // Один кадр вместо повторного входа: сервер вернёт ID_CORRECT
+    if (!client.resumeSession(channel)) {
+      // Присоединение к каналу, если указан
+      if (!channel.empty()) {
+        Message message;
+        message = stringToMessage(channel, message);
+        message = flagOn(message, Flags::CHANNEL);
+        client.clientSocket.sendMessage(message);
+      }
+      if (!nick.empty()) {
+        client.registration(nick);
+      }
     }
 
     std::cout << "Connected to " << ip << ":" << port << " as " << nick
@@ -425,6 +528,17 @@ void helpToUse() {
             << std::endl;
   std::cout << "Also you can use command: /send <channel> <message>."
             << std::endl;
+  std::cout << "To read channel history, use command: /read <channel>"
+            << std::endl;
+  std::cout << "To read only new messages, use command: /read <channel> since "
+               "<#number|HH:MM:SS|YYYY-MM-DDTHH:MM:SS>"
+            << std::endl;
+  std::cout << "To read older messages, use command: /read <channel> before "
+               "<#number>"
+            << std::endl;
+  std::cout << "To search channel history, use command: /search <channel> "
+               "<terms> (from:<nickname> filters by sender)"
+            << std::endl;
   std::cout << "To leave a channel, use command: /exit <channel>" << std::endl;
   std::cout << "To see all available channels, use command: /channels"
             << std::endl;
@@ -448,6 +562,22 @@ bool isCommand(std::string &input) {
 #include <vector>
 
 void Client::processAudioMessage(const Message &message) {
+  // Голосовое частями: проигрывание начинается с первой частью
+  if (message.header.flag == Flags::VOICEMAIL_STREAM_BEGIN) {
+    voicemailPlayer.begin(
+        std::string(message.body.begin(), message.body.end()));
+    signalReady();
+    return;
+  }
+  if (message.header.flag == Flags::VOICEMAIL_STREAM_CHUNK) {
+    voicemailPlayer.push(message.body);
+    return;
+  }
+  if (message.header.flag == Flags::VOICEMAIL_STREAM_END) {
+    voicemailPlayer.end();
+    return;
+  }
+
   const uint8_t *dataPtr = message.body.data();
   size_t dataSize = message.body.size();
 
@@ -477,32 +607,68 @@ void Client::processAudioMessage(const Message &message) {
 
   // Оставшиеся данные — это аудиоданные
   std::vector<uint8_t> audioData(dataPtr, dataPtr + dataSize);
-  std::cout << "Enter path for saving:";
-  std::string path;
-  std::cin >> path;
-  if (!saveFile(path, fileName, audioData)) {
-    std::cerr << "Error saving audio file" << std::endl;
-    return;
-  }
-  std::cout << path + fileName << std::endl;
-  double duration = getAudioDuration(path + "/" + fileName);
-  std::cout << "Audio file saved successfully. Duration: " << duration
-            << " seconds" << std::endl;
 
-  play_audio(audioData);
-  {
-    std::lock_guard<std::mutex> lock(mtx);  // Захват мьютекса
-
-    ready = true;
+  // Сервер без отдачи частями прислал файл целиком: проигрываем тем же
+  // плеером, он же сохраняет файл, если при запросе указан каталог
+  std::vector<int16_t> pcm;
+  int sampleRate = 0, channels = 0;
+  std::string opusExtension = VOICEMAIL_OPUS_EXTENSION;
+  std::string audioId = fileName.substr(0, fileName.find('.'));
+  bool encoded = fileName.size() > opusExtension.size() &&
+                 fileName.compare(fileName.size() - opusExtension.size(),
+                                  opusExtension.size(), opusExtension) == 0;
+  if (encoded) {
+    if (!decodeVoicemail(audioData, pcm, sampleRate, channels)) {
+      std::cerr << "Invalid AUDIO message: broken Opus voicemail" << std::endl;
+    }
+  } else {
+    WavInfo info;
+    std::string error;
+    if (!parseWavHeader(audioData.data(), audioData.size(), audioData.size(),
+                        info, error) ||
+        info.format != 1 || info.bitsPerSample != 16) {
+      std::cerr << "Invalid AUDIO message: "
+                << (error.empty() ? "not 16-bit PCM" : error) << std::endl;
+    } else {
+      sampleRate = static_cast<int>(info.sampleRate);
+      channels = info.channels;
+      size_t count = static_cast<size_t>(info.dataSize) / sizeof(int16_t);
+      pcm.resize(count);
+      for (size_t i = 0; i < count; ++i) {
+        uint16_t sample;
+        std::memcpy(&sample,
+                    audioData.data() + info.dataOffset + i * sizeof(int16_t),
+                    sizeof(sample));
+        pcm[i] = static_cast<int16_t>(le16toh(sample));
+      }
+    }
   }
-  cv.notify_all();
+  if (!pcm.empty()) {
+    voicemailPlayer.playPcm(audioId, pcm, sampleRate, channels);
+  }
+  signalReady();
 }
 
 void Client::processVoiceMessage(const Message &message) {
   const uint8_t *dataPtr = message.body.data();
   size_t dataSize = message.body.size();
-  std::vector<int16_t> audioData(dataPtr, dataPtr + dataSize);
-  play_audio(audioData);
+
+  // Пропускаем имя канала: [длина u32][имя][сэмплы]
+  if (dataSize < sizeof(uint32_t)) {
+    return;
+  }
+  uint32_t netChannelLength;
+  std::memcpy(&netChannelLength, dataPtr, sizeof(uint32_t));
+  size_t channelLength = ntohl(netChannelLength);
+  if (dataSize - sizeof(uint32_t) < channelLength) {
+    return;
+  }
+  dataPtr += sizeof(uint32_t) + channelLength;
+  dataSize -= sizeof(uint32_t) + channelLength;
+
+  std::vector<int16_t> audioData(dataSize / sizeof(int16_t));
+  std::memcpy(audioData.data(), dataPtr, audioData.size() * sizeof(int16_t));
+  voiceOutput.play(audioData.data(), audioData.size());
 }
 
 void Client::record_audio(int recOrVoice, std::string &channel) {
@@ -512,7 +678,7 @@ void Client::record_audio(int recOrVoice, std::string &channel) {
   PaError err;
   short buffer[FRAMES_PER_BUFFER * NUM_CHANNELS];
 
-  err = Pa_Initialize();
+  err = acquirePortAudio();
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
     return;
@@ -530,7 +696,7 @@ void Client::record_audio(int recOrVoice, std::string &channel) {
                       FRAMES_PER_BUFFER, paClipOff, NULL, NULL);
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -538,7 +704,7 @@ void Client::record_audio(int recOrVoice, std::string &channel) {
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
     Pa_CloseStream(stream);
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -560,7 +726,7 @@ void Client::record_audio(int recOrVoice, std::string &channel) {
       if (error != OPUS_OK) {
         std::cerr << "Failed to create Opus encoder: " << opus_strerror(error)
                   << std::endl;
-        return;
+        break;
       }
       int opus_length =
           opus_encode(encoder, (const opus_int16 *)buffer, FRAMES_PER_BUFFER,
@@ -590,16 +756,15 @@ void Client::record_audio(int recOrVoice, std::string &channel) {
 
   Pa_StopStream(stream);
   Pa_CloseStream(stream);
-  Pa_Terminate();
+  releasePortAudio();
 
   std::cout << "Recording stopped." << std::endl;
 }
 void play_audio(const std::vector<int16_t> &audioData) {
-  std::cout << "Playing audio..." << std::endl;
   PaError err;
   PaStream *stream;
 
-  err = Pa_Initialize();
+  err = acquirePortAudio();
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
     return;
@@ -609,7 +774,7 @@ void play_audio(const std::vector<int16_t> &audioData) {
   outputParameters.device = Pa_GetDefaultOutputDevice();
   if (outputParameters.device == paNoDevice) {
     std::cerr << "Error: No default output device." << std::endl;
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
   outputParameters.channelCount = NUM_CHANNELS;
@@ -622,7 +787,7 @@ void play_audio(const std::vector<int16_t> &audioData) {
                       FRAMES_PER_BUFFER, paClipOff, NULL, NULL);
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -630,7 +795,7 @@ void play_audio(const std::vector<int16_t> &audioData) {
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
     Pa_CloseStream(stream);
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -642,14 +807,14 @@ void play_audio(const std::vector<int16_t> &audioData) {
 
   Pa_StopStream(stream);
   Pa_CloseStream(stream);
-  Pa_Terminate();
+  releasePortAudio();
 }
 void play_audio(const std::vector<uint8_t> &audioData) {
   PaError err;
   PaStream *stream;
 
   // Инициализация PortAudio
-  err = Pa_Initialize();
+  err = acquirePortAudio();
   if (err != paNoError) {
     std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
     return;
@@ -660,7 +825,7 @@ void play_audio(const std::vector<uint8_t> &audioData) {
   outputParameters.device = Pa_GetDefaultOutputDevice();
   if (outputParameters.device == paNoDevice) {
     std::cerr << "Error: No default output device." << std::endl;
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
   outputParameters.channelCount = NUM_CHANNELS;
@@ -675,7 +840,7 @@ void play_audio(const std::vector<uint8_t> &audioData) {
   if (err != paNoError) {
     std::cerr << "PortAudio error during OpenStream: " << Pa_GetErrorText(err)
               << std::endl;
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -685,7 +850,7 @@ void play_audio(const std::vector<uint8_t> &audioData) {
     std::cerr << "PortAudio error during StartStream: " << Pa_GetErrorText(err)
               << std::endl;
     Pa_CloseStream(stream);
-    Pa_Terminate();
+    releasePortAudio();
     return;
   }
 
@@ -736,7 +901,7 @@ void play_audio(const std::vector<uint8_t> &audioData) {
   }
 
   // Завершение работы PortAudio
-  Pa_Terminate();
+  releasePortAudio();
 }
 
 void Client::save_audio_to_file(const std::string &filename) {
@@ -773,56 +938,210 @@ std::string generateFilename(const std::string &nick) {
   return filename;
 }
 
-bool MySocket::sendFileIfExists(const std::string &filePath,
-                                const std::string &channel,
-                                const std::string &id) {
-  // Проверяем, существует ли файл
-  if (!std::filesystem::exists(filePath)) {
+/**
+ * Reads the resume record left by an interrupted upload of the same file.
+ *
+ * @return The upload id to continue, or 0 to start a new upload.
+ */
+uint64_t Client::loadUploadResume(const std::string &kind,
+                                  const std::string &channel,
+                                  const std::string &filePath,
+                                  uint64_t fileSize) {
+  std::ifstream state(UPLOAD_STATE_FILE);
+  std::string id, savedKind, savedChannel, savedPath, savedSize;
+  if (!std::getline(state, id) || !std::getline(state, savedKind) ||
+      !std::getline(state, savedChannel) || !std::getline(state, savedPath) ||
+      !std::getline(state, savedSize)) {
+    return 0;
+  }
+  if (savedKind != kind || savedChannel != channel || savedPath != filePath ||
+      savedSize != std::to_string(fileSize)) {
+    return 0;
+  }
+  try {
+    return std::stoull(id);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+void Client::saveUploadResume(uint64_t uploadId, const std::string &kind,
+                              const std::string &channel,
+                              const std::string &filePath, uint64_t fileSize) {
+  std::ofstream state(UPLOAD_STATE_FILE, std::ios::trunc);
+  state << uploadId << '\n'
+        << kind << '\n'
+        << channel << '\n'
+        << filePath << '\n'
+        << fileSize << '\n';
+}
+
+/**
+ * Handles UPLOAD_ACK, UPLOAD_END and UPLOAD_ERROR replies. The body starts
+ * with the upload id; the first UPLOAD_ACK after UPLOAD_BEGIN assigns it.
+ */
+void Client::uploadReply(Message &message) {
+  std::istringstream iss(messageToString(message));
+  uint64_t uploadId = 0;
+  std::string rest;
+  iss >> uploadId;
+  std::getline(iss >> std::ws, rest);
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (message.header.flag == Flags::UPLOAD_ACK) {
+      if (!upload.begun) {
+        upload.id = uploadId;
+        upload.begun = true;
+        upload.acked = std::strtoull(rest.c_str(), nullptr, 10);
+      } else if (uploadId == upload.id && !upload.sent.empty()) {
+        upload.acked = std::strtoull(rest.c_str(), nullptr, 10);
+        auto [end, pass] = upload.sent.front();
+        upload.sent.pop_front();
+        // Часть не записана - следующие за ней сервер тоже отбросит.
+        // Возвращаемся один раз за проход, ответы на старые части пропускаем
+        if (upload.acked < end && pass == upload.pass) {
+          ++upload.pass;
+          upload.rewind = true;
+        }
+      }
+    } else if (message.header.flag == Flags::UPLOAD_END) {
+      upload.done = true;
+      std::cout << rest << std::endl;
+    } else {
+      upload.failed = true;
+      std::cerr << "Upload failed: " << rest << std::endl;
+    }
+  }
+  cv.notify_all();
+}
+
+/**
+ * Sends a file to the server in UPLOAD_CHUNK_SIZE parts, holding at most one
+ * part in memory. Up to UPLOAD_WINDOW parts may wait for acknowledgement. If
+ * the same file was interrupted earlier, the upload continues from the last
+ * offset the server acknowledged.
+ *
+ * @param filePath Path to the file.
+ * @param channel Channel the file is sent to.
+ * @param kind "file" or "audio" (voicemail).
+ *
+ * @return True if the server stored the file.
+ */
+bool Client::uploadFile(const std::string &filePath, const std::string &channel,
+                        const std::string &kind) {
+  std::error_code ec;
+  uint64_t fileSize = std::filesystem::file_size(filePath, ec);
+  if (ec) {
     std::cerr << "Файл не найден: " << filePath << std::endl;
     return false;
   }
-
-  // Открываем файл в бинарном режиме
+  if (fileSize > UPLOAD_MAX_SIZE) {
+    std::cerr << "Файл слишком большой: " << filePath << std::endl;
+    return false;
+  }
   std::ifstream file(filePath, std::ios::binary);
   if (!file.is_open()) {
     std::cerr << "Не удалось открыть файл: " << filePath << std::endl;
     return false;
   }
 
-  // Получаем размер файла
-  file.seekg(0, std::ios::end);
-  std::streamsize fileSize = file.tellg();
-  file.seekg(0, std::ios::beg);
-
-  // Читаем содержимое файла в буфер
-  std::vector<uint8_t> fileData(static_cast<size_t>(fileSize));
-  if (!file.read(reinterpret_cast<char *>(fileData.data()), fileSize)) {
-    std::cerr << "Ошибка при чтении файла: " << filePath << std::endl;
+  uint64_t resumeId = loadUploadResume(kind, channel, filePath, fileSize);
+  // Части ждут подтверждений, копить их в пакете нельзя
+  clientSocket.flushBatch();
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    upload = UploadState{};
+  }
+  Message message;
+  message = stringToMessage(
+      kind + "\n" + channel + "\n" +
+          std::filesystem::path(filePath).filename().string() + "\n" +
+          std::to_string(fileSize) + "\n" + std::to_string(resumeId),
+      message);
+  message = flagOn(message, Flags::UPLOAD_BEGIN);
+  if (!clientSocket.sendMessage(message)) {
     return false;
   }
 
-  // Создаем FilePacket
-  FilePacket packet;
-  // Извлекаем только имя файла из пути
-  packet.filename = std::filesystem::path(filePath).filename().string();
-  packet.file_size = static_cast<uint32_t>(fileSize);
-  packet.file_data = std::move(fileData);
+  auto replied = [this] {
+    return upload.failed || upload.done || !clientRunning;
+  };
+  uint64_t uploadId, offset;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait_for(lock, std::chrono::seconds(UPLOAD_REPLY_TIMEOUT_SEC),
+                [&] { return upload.begun || replied(); });
+    if (!upload.begun || upload.failed) {
+      return false;
+    }
+    uploadId = upload.id;
+    offset = upload.acked;
+  }
+  saveUploadResume(uploadId, kind, channel, filePath, fileSize);
+  if (offset > 0) {
+    std::cout << "Resuming upload at " << offset << " of " << fileSize
+              << " bytes" << std::endl;
+  }
 
-  // Создаем сообщение
-  Message message;
-  if (!message.setFileMessage(packet, channel, id)) {
-    std::cerr << "Не удалось установить FileMessage." << std::endl;
-    return false;
+  file.seekg(offset);
+  std::vector<uint8_t> chunk(UPLOAD_CHUNK_SIZE);
+  while (true) {
+    {
+      // Не больше UPLOAD_WINDOW неподтверждённых частей; после последней
+      // ждём все ответы, ведь любая часть могла быть отброшена
+      std::unique_lock<std::mutex> lock(mtx);
+      if (!cv.wait_for(lock, std::chrono::seconds(UPLOAD_REPLY_TIMEOUT_SEC),
+                       [&] {
+                         return (offset < fileSize
+                                     ? upload.sent.size() < UPLOAD_WINDOW
+                                     : upload.sent.empty()) ||
+                                upload.rewind || replied();
+                       }) ||
+          replied()) {
+        return false;
+      }
+      if (upload.rewind) {
+        upload.rewind = false;
+        offset = upload.acked;
+        file.clear();
+        file.seekg(offset);
+      } else if (offset >= fileSize) {
+        break;
+      }
+      if (offset >= fileSize) {
+        continue;
+      }
+    }
+    size_t size = static_cast<size_t>(
+        std::min<uint64_t>(UPLOAD_CHUNK_SIZE, fileSize - offset));
+    if (!file.read(reinterpret_cast<char *>(chunk.data()), size)) {
+      std::cerr << "Ошибка при чтении файла: " << filePath << std::endl;
+      return false;
+    }
+    message.setUploadChunk(uploadId, offset, chunk.data(), size);
+    {
+      // До отправки: ответ может прийти раньше, чем вернётся sendMessage
+      std::lock_guard<std::mutex> lock(mtx);
+      upload.sent.emplace_back(offset + size, upload.pass);
+    }
+    if (!clientSocket.sendMessage(message)) {
+      return false;
+    }
+    offset += size;
   }
 
-  // Отправляем сообщение
-  if (!sendMessage(message)) {
-    std::cerr << "Не удалось отправить сообщение с файлом." << std::endl;
+  message.clearMessage(message);
+  message = stringToMessage(std::to_string(uploadId), message);
+  message = flagOn(message, Flags::UPLOAD_END);
+  if (!clientSocket.sendMessage(message)) {
     return false;
   }
-
-  std::cout << "Файл успешно отправлен: " << filePath << std::endl;
-  return true;
+  std::unique_lock<std::mutex> lock(mtx);
+  cv.wait_for(lock, std::chrono::seconds(UPLOAD_REPLY_TIMEOUT_SEC), replied);
+  if (upload.done) {
+    std::remove(UPLOAD_STATE_FILE);
+  }
+  return upload.done;
 }
 
 /**
@@ -861,7 +1180,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
       command = "/join " + currentChannel;
       message = stringToMessage(command, message);
 
-      client.clientSocket.sendMessage(message);
+      client.sendCommand(message);
     } else {
       std::cout << "Invalid join command. Usage: join <channel>" << std::endl;
       return false;
@@ -871,9 +1190,23 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
     iss >> channel;
     if (!channel.empty()) {
       message = stringToMessage(command, message);
-      client.clientSocket.sendMessage(message);
+      client.sendCommand(message);
     } else {
-      std::cout << "Invalid read command. Usage: read <channel>" << std::endl;
+      std::cout << "Invalid read command. Usage: read <channel> [since "
+                   "<seq|time> | before <seq>]"
+                << std::endl;
+      return false;
+    }
+  } else if (word == "/search") {
+    std::string channel, terms;
+    iss >> channel;
+    std::getline(iss, terms);
+    if (!channel.empty() && !terms.empty()) {
+      message = stringToMessage(command, message);
+      client.sendCommand(message);
+    } else {
+      std::cout << "Invalid search command. Usage: search <channel> <terms>"
+                << std::endl;
       return false;
     }
   } else if (word == "/exit") {
@@ -883,7 +1216,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
     if (!channel.empty()) {
       if (currentChannel == channel) currentChannel = "";
       message = stringToMessage(command, message);
-      client.clientSocket.sendMessage(message);
+      client.sendCommand(message);
     } else {
       std::cout << "Invalid exit command. Usage: exit <channel>" << std::endl;
       return false;
@@ -894,7 +1227,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
 
     if (!newNickname.empty()) {
       message = stringToMessage(command, message);
-      client.clientSocket.sendMessage(message);
+      client.sendCommand(message);
     } else {
       std::cout << "Invalid /nick command. Usage: /nick <new "
                    "nickname >"
@@ -910,8 +1243,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
       std::string filePath;
       iss >> filePath;
       if (!filePath.empty()) {
-        FilePacket packet;
-        if (!client.clientSocket.sendFileIfExists(filePath, sendChannel, id)) {
+        if (!client.uploadFile(filePath, sendChannel, "file")) {
           std::cerr << "Failed to send file." << std::endl;
           return false;
         }
@@ -923,7 +1255,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
 
       if (!sendChannel.empty() && !sendMessage.empty()) {
         message = stringToMessage(command, message);
-        client.clientSocket.sendMessage(message);
+        client.sendCommand(message);
       } else {
         std::cout << "Invalid send command. Usage: send <channel> <message>"
                   << std::endl;
@@ -934,7 +1266,7 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
   } else if (word == "/connect") {
     std::string nickname = client.getNickname();
     if (!handleConnectCommand(command, ipPort, ip, port, nickname, channel, id,
-                              currentChannel, client)) {
+                              client)) {
       return false;
     };
     currentChannel = channel;
@@ -944,14 +1276,14 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
     helpToUse();
   } else if (word == "/channels") {
     message = stringToMessage(command, message);
-    client.clientSocket.sendMessage(message);
+    client.sendCommand(message);
   } else if (word == "/time_on") {
     message = stringToMessage(command, message);
-    client.clientSocket.sendMessage(message);
+    client.sendCommand(message);
     client.timeFlag = true;
   } else if (word == "/time_off") {
     message = stringToMessage(command, message);
-    client.clientSocket.sendMessage(message);
+    client.sendCommand(message);
     client.timeFlag = false;
   } else if (word == "/rec") {
     std::string filename = "";
@@ -971,8 +1303,9 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
           client.recording_start = false;
           filename = generateFilename(client.getNickname());
           client.save_audio_to_file(filename);
-          message.setAudioMessage(filename, id, currentChannel);
-          client.clientSocket.sendMessage(message);
+          if (!client.uploadFile(filename, currentChannel, "audio")) {
+            std::cerr << "Failed to send voicemail." << std::endl;
+          }
           if (std::remove(filename.c_str()) != 0) {
             std::cerr << "Ошибка при удалении файла: " << filename << std::endl;
           }
@@ -984,14 +1317,20 @@ bool commandHandler(std::string &command, Message &message, std::string &ipPort,
     ready = true;
 
   } else if (word == "/voicemail_on") {
-    std::string audioId = "";
-    iss >> audioId;
+    std::string audioId = "", saveDirectory = "";
+    iss >> audioId >> saveDirectory;
     if (!audioId.empty()) {
-      message = stringToMessage(command, message);
+      // Сервер может отдать сжатую копию вместо WAV и прислать её частями
+      client.voicemailPlayer.expect(saveDirectory);
+      message = stringToMessage("/voicemail_on " + audioId + " " +
+                                    VOICEMAIL_CODEC_NAME + " " +
+                                    VOICEMAIL_STREAM_OPTION,
+                                message);
       client.clientSocket.sendMessage(message);
     } else {
       std::cout
-          << "Invalid voicemail_on command. Usage: /voicemail_on <audioId>"
+          << "Invalid voicemail_on command. Usage: /voicemail_on <audioId> "
+             "[save directory]"
           << std::endl;
       return false;
     }
@@ -1230,9 +1569,77 @@ std::string Client::getNickname() {
   return nickname;
 }
 
+void Client::setSessionToken(const std::string &token) {
+  std::lock_guard<std::mutex> lock(mtx);
+  sessionToken = token;
+}
+
+bool Client::resumeSession(const std::string &channel) {
+  std::string token;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    token = sessionToken;
+    resumeChannel = channel;
+  }
+  if (token.empty()) {
+    return false;
+  }
+  Message message;
+  message = stringToMessage(token + "\n" + channel, message);
+  message = flagOn(message, Flags::RESUME);
+  clientSocket.sendMessage(message);
+  return true;
+}
+
+void Client::resumeFailed() {
+  std::string channel;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    sessionToken = "";
+    channel = resumeChannel;
+  }
+  if (!channel.empty()) {
+    Message message;
+    message = stringToMessage(channel, message);
+    message = flagOn(message, Flags::CHANNEL);
+    clientSocket.sendMessage(message);
+  }
+  registration(getNickname());
+}
+
+void Client::channelRejected() {
+  std::lock_guard<std::mutex> lock(mtx);
+  channelEvent = ChannelEvent::REJECTED;
+}
+
+void Client::channelDeleted() {
+  std::lock_guard<std::mutex> lock(mtx);
+  channelEvent = ChannelEvent::DELETED;
+}
+
+void Client::applyChannelEvent(std::string &currentChannel) {
+  ChannelEvent event;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    event = channelEvent;
+    channelEvent = ChannelEvent::NONE;
+  }
+  if (event == ChannelEvent::REJECTED) {
+    // Сервер не пустил в канал: возвращаемся в прежний
+    currentChannel = lastChannel;
+    lastChannel = "";
+  } else if (event == ChannelEvent::DELETED) {
+    currentChannel = "";
+  }
+}
+
 int main(int argc, char *argv[]) {
   Client client;
   globalClient = &client;
+  if (!isatty(STDIN_FILENO)) {
+    // Без синхронизации с stdio in_avail() видит уже прочитанный ввод
+    std::ios::sync_with_stdio(false);
+  }
   // Обрабатываем сигнал Ctrl+C
   signal(SIGINT, signalHandler);
 
@@ -1269,36 +1676,63 @@ int main(int argc, char *argv[]) {
     return 2;
   }
 
-  std::thread receiveThread(ReceiveMessage, std::ref(id),
-                            std::ref(currentChannel), std::ref(client));
+  std::thread receiveThread(ReceiveMessage, std::ref(id), std::ref(client));
+  client.requestCompression();
   Message message;
 
   std::cout << helloWindow();
 
+  client.pipelineMode = !isatty(STDIN_FILENO);
+  if (client.pipelineMode) {
+    // Сервер с номерами запросов понимает и BATCH
+    client.clientSocket.enableBatchSend();
+  }
   if (client.clientRunning) {
     client.enterOnServer();
   }
   std::string upperNick = "";
+  bool loggedIn = false;
   while (client.clientRunning) {  // основной поток ввода сообщений
     // Ник в верхнем регистре
     {
       std::unique_lock<std::mutex> lock(client.mtx);
 
-      // Ожидание, пока есть новые сообщения
-      client.cv.wait(lock, [] { return ready; });
+      if (client.pipelineMode && loggedIn) {
+        // Конвейер: ответы не ждём, ограничиваем только число команд в пути
+        if (client.inFlight >= CLIENT_MAX_IN_FLIGHT) {
+          client.clientSocket.flushBatch();
+        }
+        client.cv.wait(lock, [&client] {
+          return client.inFlight < CLIENT_MAX_IN_FLIGHT ||
+                 !client.clientRunning;
+        });
+      } else {
+        // Ожидание, пока есть новые сообщения
+        client.cv.wait(lock, [] { return ready.load(); });
+        loggedIn = true;
+      }
+      if (client.pipelineMode) {
+        // Команды из ввода, прочитанные вместе, уходят одним кадром BATCH
+        client.clientSocket.beginBatch();
+      }
 
-      while (!client.messageQueue.empty()) {
-        std::cout << client.messageQueue.front() << std::endl;
-        client.messageQueue.pop();
+      std::string reply;
+      while (client.messageQueue.pop(reply)) {
+        std::cout << reply << std::endl;
       }
       ready = false;  // Сброс флага готовности
     }
+    client.applyChannelEvent(currentChannel);
     std::string currentNickname = client.getNickname();
     upperNick = toUpper(currentNickname);
 
     std::string command;
+    // Номер запроса прошлой команды не должен уйти с кадром без ответа
+    message.clearMessage(message);
     message = flagOff(message);
-    if (currentChannel.empty()) {
+    if (client.pipelineMode) {
+      // Приглашение не выводим, ответы печатаются с номером запроса
+    } else if (currentChannel.empty()) {
       if (client.timeFlag) {
         std::time_t currentTime = std::time(nullptr);
         char timeBuffer[9];
@@ -1321,7 +1755,17 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    std::getline(std::cin, command);
+    if (!std::getline(std::cin, command)) {
+      // Конец ввода: дожидаемся ответов на отправленные команды
+      client.clientSocket.flushBatch();
+      client.waitForReplies();
+      std::lock_guard<std::mutex> lock(client.mtx);
+      std::string reply;
+      while (client.messageQueue.pop(reply)) {
+        std::cout << reply << std::endl;
+      }
+      break;
+    }
 
     if (isCommand(command)) {
       if (!commandHandler(command, message, ipPort, ip, port, channel,
@@ -1333,16 +1777,21 @@ int main(int argc, char *argv[]) {
     } else if (!currentChannel.empty() && !command.empty()) {
       command = "/send " + currentChannel + " " + command;
       message = stringToMessage(command, message);
-      client.clientSocket.sendMessage(message);
+      client.sendCommand(message);
     } else {
       std::cout << "Wrong command. Usage: /help" << std::endl;
       ready = true;
       continue;
     }
+    if (client.pipelineMode && std::cin.rdbuf()->in_avail() <= 0) {
+      client.clientSocket.flushBatch();
+    }
   }
 
   client.clientRunning = false;
   client.clientSocket.closeSocket();
+  // Поток приёма может оставаться в recv на закрытом сокете
+  receiveThread.detach();
 
   std::cout << "Client shut down successfully." << std::endl;
   return 0;
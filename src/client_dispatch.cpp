@@ -0,0 +1,68 @@
+#include "../include/client_dispatch.hpp"
+
+#include <iostream>
+
+ClientExecutor::ClientExecutor(std::string executorName,
+                               std::function<void(Message &)> messageHandler,
+                               size_t inboxCapacity)
+    : name(std::move(executorName)),
+      handler(std::move(messageHandler)),
+      capacity(inboxCapacity) {
+  worker = std::thread(&ClientExecutor::run, this);
+}
+
+ClientExecutor::~ClientExecutor() { stop(); }
+
+bool ClientExecutor::post(Message message) {
+  // Граница приблизительная: одновременные писатели могут превысить её на
+  // несколько сообщений
+  if (capacity != 0 && pending.load(std::memory_order_relaxed) >= capacity) {
+    return false;
+  }
+  pending.fetch_add(1, std::memory_order_relaxed);
+  inbox.push(std::move(message));
+  // Будим, только если поток уже спит: обычно мьютекс не нужен. Барьер
+  // парный с барьером в run: либо мы увидим sleeping, либо поток - сообщение
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wakeUp.notify_one();
+  }
+  return true;
+}
+
+void ClientExecutor::stop() {
+  if (!worker.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    running = false;
+  }
+  wakeUp.notify_one();
+  worker.join();
+}
+
+void ClientExecutor::run() {
+  Message message;
+  while (true) {
+    if (inbox.pop(message)) {
+      pending.fetch_sub(1, std::memory_order_relaxed);
+      try {
+        handler(message);
+      } catch (const std::exception &e) {
+        std::cerr << "Error in " << name << " handler: " << e.what()
+                  << std::endl;
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wakeUp.wait(lock, [this] { return !inbox.empty() || !running; });
+    sleeping.store(false, std::memory_order_relaxed);
+    if (!running && inbox.empty()) {
+      break;
+    }
+  }
+}
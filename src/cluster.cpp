@@ -0,0 +1,581 @@
+#include "../include/cluster.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "../include/other.hpp"
+
+namespace {
+
+uint64_t ringHash(std::string_view text) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+using AddressList = std::unique_ptr<addrinfo, decltype(&freeaddrinfo)>;
+
+// Адреса узла из файла кластера: IP-литерал или имя
+AddressList resolve(const std::string &host, int port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *result = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                  &result) != 0) {
+    result = nullptr;
+  }
+  return AddressList(result, &freeaddrinfo);
+}
+
+// IPv4 из адреса вида ::ffff:a.b.c.d сравнивается как IPv4
+bool sameAddress(const sockaddr_storage &peer, const sockaddr *candidate) {
+  const sockaddr_in6 *peer6 = reinterpret_cast<const sockaddr_in6 *>(&peer);
+  if (peer.ss_family == AF_INET6 && candidate->sa_family == AF_INET6) {
+    return std::memcmp(&peer6->sin6_addr,
+                       &reinterpret_cast<const sockaddr_in6 *>(candidate)
+                            ->sin6_addr,
+                       sizeof(in6_addr)) == 0;
+  }
+  if (candidate->sa_family != AF_INET) {
+    return false;
+  }
+  const in_addr &address =
+      reinterpret_cast<const sockaddr_in *>(candidate)->sin_addr;
+  if (peer.ss_family == AF_INET) {
+    return reinterpret_cast<const sockaddr_in *>(&peer)->sin_addr.s_addr ==
+           address.s_addr;
+  }
+  return peer.ss_family == AF_INET6 &&
+         IN6_IS_ADDR_V4MAPPED(&peer6->sin6_addr) &&
+         std::memcmp(peer6->sin6_addr.s6_addr + 12, &address,
+                     sizeof(address)) == 0;
+}
+
+bool hostMatches(const sockaddr_storage &peer, const std::string &host) {
+  AddressList addresses = resolve(host, 0);
+  for (addrinfo *ai = addresses.get(); ai != nullptr; ai = ai->ai_next) {
+    if (sameAddress(peer, ai->ai_addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string addressText(const sockaddr_storage &address) {
+  char host[NI_MAXHOST];
+  if (getnameinfo(reinterpret_cast<const sockaddr *>(&address),
+                  sizeof(address), host, sizeof(host), nullptr, 0,
+                  NI_NUMERICHOST) != 0) {
+    return "?";
+  }
+  return host;
+}
+
+// Сравнение без раннего выхода: время не подсказывает совпавшую часть
+bool sameSecret(const std::string &given, const std::string &expected) {
+  unsigned char difference = given.size() != expected.size();
+  for (size_t i = 0; i < expected.size(); ++i) {
+    difference |= static_cast<unsigned char>(
+        expected[i] ^ (i < given.size() ? given[i] : 0));
+  }
+  return difference == 0;
+}
+
+// Неблокирующее подключение: недоступный узел держит поток не дольше
+// CLUSTER_CONNECT_TIMEOUT_MS, остановка узла замечается за CLUSTER_POLL_MS
+bool connectTo(const std::string &host, int port, int &socketFd,
+               const std::atomic<bool> &running) {
+  AddressList addresses = resolve(host, port);
+  for (addrinfo *ai = addresses.get(); ai != nullptr && running;
+       ai = ai->ai_next) {
+    socketFd = socket(ai->ai_family, SOCK_STREAM, 0);
+    if (socketFd < 0) {
+      continue;
+    }
+    int flags = fcntl(socketFd, F_GETFL, 0);
+    fcntl(socketFd, F_SETFL, flags | O_NONBLOCK);
+    bool connected = connect(socketFd, ai->ai_addr, ai->ai_addrlen) == 0;
+    if (!connected && errno == EINPROGRESS) {
+      for (int waited = 0;
+           running && waited < CLUSTER_CONNECT_TIMEOUT_MS && !connected;
+           waited += CLUSTER_POLL_MS) {
+        pollfd pending{socketFd, POLLOUT, 0};
+        int ready = poll(&pending, 1, CLUSTER_POLL_MS);
+        if (ready < 0) {
+          break;
+        }
+        if (ready > 0) {
+          int error = 0;
+          socklen_t length = sizeof(error);
+          getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &error, &length);
+          connected = error == 0;
+          break;
+        }
+      }
+    }
+    if (connected) {
+      // Дальше сокет читает и пишет MySocket в блокирующем режиме
+      fcntl(socketFd, F_SETFL, flags);
+      return true;
+    }
+    close(socketFd);
+  }
+  socketFd = -1;
+  return false;
+}
+
+}  // namespace
+
+void appendField(std::vector<uint8_t> &body, std::string_view field) {
+  uint32_t netLength = htonl(static_cast<uint32_t>(field.size()));
+  const uint8_t *length = reinterpret_cast<const uint8_t *>(&netLength);
+  body.insert(body.end(), length, length + sizeof(netLength));
+  body.insert(body.end(), field.begin(), field.end());
+}
+
+bool readFields(const std::vector<uint8_t> &body,
+                std::vector<std::string> &fields) {
+  fields.clear();
+  size_t position = 0;
+  while (position < body.size()) {
+    uint32_t netLength;
+    if (body.size() - position < sizeof(netLength)) {
+      return false;
+    }
+    std::memcpy(&netLength, body.data() + position, sizeof(netLength));
+    position += sizeof(netLength);
+    uint32_t length = ntohl(netLength);
+    if (body.size() - position < length) {
+      return false;
+    }
+    fields.emplace_back(reinterpret_cast<const char *>(body.data()) + position,
+                        length);
+    position += length;
+  }
+  return true;
+}
+
+Message clusterMessage(ClusterOp op, const std::vector<std::string> &fields,
+                       DataType type) {
+  Message message;
+  message.header.type = type;
+  message.header.flag = static_cast<uint32_t>(op);
+  for (const std::string &field : fields) {
+    appendField(message.body, field);
+  }
+  message.header.size = message.body.size();
+  return message;
+}
+
+HashRing::HashRing(const std::vector<std::string> &nodes) {
+  points.reserve(nodes.size() * CLUSTER_VIRTUAL_NODES);
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (int replica = 0; replica < CLUSTER_VIRTUAL_NODES; ++replica) {
+      points.emplace_back(
+          ringHash(nodes[node] + "#" + std::to_string(replica)), node);
+    }
+  }
+  std::sort(points.begin(), points.end());
+}
+
+size_t HashRing::owner(std::string_view key) const {
+  if (points.empty()) {
+    return 0;
+  }
+  auto it = std::lower_bound(points.begin(), points.end(),
+                             std::make_pair(ringHash(key), size_t{0}));
+  return it == points.end() ? points.front().second : it->second;
+}
+
+ClusterNode::~ClusterNode() { stop(); }
+
+bool ClusterNode::load(const std::string &path, const std::string &selfId,
+                       std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+  std::vector<ClusterPeer> loaded;
+  std::string loadedSecret;
+  std::string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream iss(line);
+    ClusterPeer peer;
+    if (!(iss >> peer.id)) {
+      continue;
+    }
+    if (peer.id == "secret") {
+      if (!(iss >> loadedSecret)) {
+        error = "malformed line: " + line;
+        return false;
+      }
+      continue;
+    }
+    if (!(iss >> peer.host >> peer.port) || peer.port <= 0) {
+      error = "malformed line: " + line;
+      return false;
+    }
+    for (const ClusterPeer &other : loaded) {
+      if (other.id == peer.id) {
+        error = "duplicate node " + peer.id;
+        return false;
+      }
+    }
+    loaded.push_back(peer);
+  }
+  auto selfIt = std::find_if(
+      loaded.begin(), loaded.end(),
+      [&selfId](const ClusterPeer &peer) { return peer.id == selfId; });
+  if (selfIt == loaded.end()) {
+    error = "node " + selfId + " is not listed in " + path;
+    return false;
+  }
+  if (loadedSecret.empty()) {
+    error = "no secret in " + path;
+    return false;
+  }
+
+  self = selfId;
+  secret = loadedSecret;
+  listenHost = selfIt->host;
+  listenPort = selfIt->port;
+  nodes = loaded;
+  std::vector<std::string> ids;
+  for (const ClusterPeer &peer : nodes) {
+    ids.push_back(peer.id);
+    if (peer.id != self) {
+      links.push_back(std::make_unique<PeerLink>());
+      links.back()->peer = peer;
+      links.back()->socket.setSocket(-1);
+    }
+  }
+  ring = HashRing(ids);
+  return true;
+}
+
+bool ClusterNode::start(Handler newHandler) {
+  handler = std::move(newHandler);
+  // Только адрес узла из файла кластера: порт связей не виден снаружи
+  AddressList addresses = resolve(listenHost, listenPort);
+  for (addrinfo *ai = addresses.get(); ai != nullptr && listenSocket < 0;
+       ai = ai->ai_next) {
+    listenSocket = socket(ai->ai_family, SOCK_STREAM, 0);
+    if (listenSocket < 0) {
+      continue;
+    }
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listenSocket, ai->ai_addr, ai->ai_addrlen) < 0 ||
+        listen(listenSocket, 16) < 0) {
+      close(listenSocket);
+      listenSocket = -1;
+    }
+  }
+  if (listenSocket < 0) {
+    return false;
+  }
+  running = true;
+  acceptor = std::thread(&ClusterNode::acceptLoop, this);
+  for (std::unique_ptr<PeerLink> &link : links) {
+    link->thread = std::thread(&ClusterNode::runLink, this, std::ref(*link));
+  }
+  return true;
+}
+
+void ClusterNode::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  for (std::unique_ptr<PeerLink> &link : links) {
+    {
+      std::lock_guard<std::mutex> lock(link->mutex);
+      if (link->socket.getSocket() >= 0) {
+        shutdown(link->socket.getSocket(), SHUT_RDWR);
+      }
+    }
+    if (link->thread.joinable()) {
+      link->thread.join();
+    }
+  }
+  if (acceptor.joinable()) {
+    acceptor.join();
+  }
+  reapInbound(true);
+  if (listenSocket >= 0) {
+    close(listenSocket);
+    listenSocket = -1;
+  }
+}
+
+const std::string &ClusterNode::ownerOf(std::string_view channel) const {
+  return enabled() ? nodes[ring.owner(channel)].id : self;
+}
+
+bool ClusterNode::ownsChannel(std::string_view channel) const {
+  return !enabled() || nodes[ring.owner(channel)].id == self;
+}
+
+std::vector<std::string> ClusterNode::peers() const {
+  std::vector<std::string> ids;
+  for (const std::unique_ptr<PeerLink> &link : links) {
+    ids.push_back(link->peer.id);
+  }
+  return ids;
+}
+
+ClusterNode::PeerLink *ClusterNode::findLink(const std::string &node) const {
+  for (const std::unique_ptr<PeerLink> &link : links) {
+    if (link->peer.id == node) {
+      return link.get();
+    }
+  }
+  return nullptr;
+}
+
+bool ClusterNode::request(const std::string &node, Message message,
+                          Message &reply) {
+  PeerLink *link = findLink(node);
+  if (link == nullptr) {
+    return false;
+  }
+  uint32_t requestId;
+  std::future<Message> future;
+  {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (!link->writer) {
+      return false;
+    }
+    // 0 означает кадр без requestId
+    do {
+      requestId = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+    } while (requestId == 0);
+    message.header.requestId = requestId;
+    future = link->pending[requestId].get_future();
+    if (!link->writer->post(message)) {
+      link->pending.erase(requestId);
+      return false;
+    }
+  }
+  if (future.wait_for(std::chrono::milliseconds(
+          CLUSTER_REQUEST_TIMEOUT_MS)) != std::future_status::ready) {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    link->pending.erase(requestId);
+    return false;
+  }
+  reply = future.get();
+  return reply.header.flag == static_cast<uint32_t>(ClusterOp::REPLY);
+}
+
+bool ClusterNode::post(const std::string &node, const Message &message) {
+  PeerLink *link = findLink(node);
+  if (link == nullptr) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(link->mutex);
+  return link->writer && link->writer->post(message);
+}
+
+size_t ClusterNode::linksUp() const {
+  size_t up = 0;
+  for (const std::unique_ptr<PeerLink> &link : links) {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    up += link->writer != nullptr;
+  }
+  return up;
+}
+
+std::string ClusterNode::status() const {
+  if (!enabled()) {
+    return "Cluster mode is off.";
+  }
+  std::ostringstream oss;
+  oss << "Node " << self << ", " << nodes.size() << " nodes";
+  for (const std::unique_ptr<PeerLink> &link : links) {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    oss << "\n  " << link->peer.id << " " << link->peer.host << ":"
+        << link->peer.port << (link->writer ? " up" : " down");
+  }
+  return oss.str();
+}
+
+void ClusterNode::runLink(PeerLink &link) {
+  while (running) {
+    if (!connectLink(link)) {
+      for (int waited = 0; running && waited < CLUSTER_RECONNECT_MS;
+           waited += CLUSTER_POLL_MS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(CLUSTER_POLL_MS));
+      }
+      continue;
+    }
+    logMessage("Cluster link to " + link.peer.id + " is up", SERVER_LOG_FILE);
+    // По исходящей связи приходят только ответы на наши запросы
+    Message reply;
+    while (running && link.socket.receiveMessage(reply)) {
+      std::promise<Message> promise;
+      {
+        std::lock_guard<std::mutex> lock(link.mutex);
+        auto it = link.pending.find(reply.header.requestId);
+        if (it == link.pending.end()) {
+          continue;  // Запрос уже отменён по таймауту
+        }
+        promise = std::move(it->second);
+        link.pending.erase(it);
+      }
+      promise.set_value(std::move(reply));
+    }
+    dropLink(link);
+    logMessage("Cluster link to " + link.peer.id + " is down",
+               SERVER_LOG_FILE);
+  }
+}
+
+bool ClusterNode::connectLink(PeerLink &link) {
+  int socketFd;
+  if (!connectTo(link.peer.host, link.peer.port, socketFd, running)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(link.mutex);
+  if (!running) {
+    close(socketFd);
+    return false;
+  }
+  link.socket.setSocket(socketFd);
+  Message hello = clusterMessage(ClusterOp::HELLO, {self, secret});
+  if (!link.socket.sendMessage(hello)) {
+    link.socket.closeSocket();
+    return false;
+  }
+  link.writer = std::make_unique<Connection>(link.socket);
+  return true;
+}
+
+void ClusterNode::dropLink(PeerLink &link) {
+  std::unique_ptr<Connection> writer;
+  std::unordered_map<uint32_t, std::promise<Message>> pending;
+  {
+    std::lock_guard<std::mutex> lock(link.mutex);
+    writer = std::move(link.writer);
+    pending.swap(link.pending);
+  }
+  // Пустой ответ без флага REPLY - отказ ждущему запросу
+  for (auto &[requestId, promise] : pending) {
+    promise.set_value(Message{});
+  }
+  if (writer) {
+    writer->close();
+  }
+  std::lock_guard<std::mutex> lock(link.mutex);
+  link.socket.closeSocket();
+}
+
+void ClusterNode::acceptLoop() {
+  while (running) {
+    reapInbound(false);
+    pollfd listener{listenSocket, POLLIN, 0};
+    if (poll(&listener, 1, CLUSTER_POLL_MS) <= 0) {
+      continue;
+    }
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    int peerSocket =
+        accept(listenSocket, reinterpret_cast<sockaddr *>(&address), &length);
+    if (peerSocket < 0) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(inboundMutex);
+    // Поток на каждое подключение: без предела молчащие подключения
+    // до HELLO занимали бы потоки без ограничения
+    size_t pending = std::count_if(
+        inbound.begin(), inbound.end(), [](const auto &link) {
+          return !link->authenticated && !link->finished;
+        });
+    if (pending >= CLUSTER_MAX_PENDING_INBOUND) {
+      close(peerSocket);
+      logMessage("Rejected cluster connection from " + addressText(address) +
+                     ": too many pending",
+                 SERVER_LOG_FILE);
+      continue;
+    }
+    // Снимается в serveInbound после проверки HELLO
+    timeval timeout{CLUSTER_HELLO_TIMEOUT_MS / 1000,
+                    (CLUSTER_HELLO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(peerSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    inbound.push_back(std::make_unique<InboundLink>());
+    InboundLink &link = *inbound.back();
+    link.address = address;
+    link.socket.setSocket(peerSocket);
+    link.thread = std::thread(&ClusterNode::serveInbound, this, std::ref(link));
+  }
+}
+
+void ClusterNode::serveInbound(InboundLink &link) {
+  Message message;
+  std::vector<std::string> fields;
+  // Узел из файла кластера, с его адреса и с общим секретом
+  PeerLink *claimed = nullptr;
+  if (link.socket.receiveMessage(message) &&
+      message.header.flag == static_cast<uint32_t>(ClusterOp::HELLO) &&
+      readFields(message.body, fields) && fields.size() == 2) {
+    claimed = findLink(fields[0]);
+  }
+  bool known = claimed != nullptr && sameSecret(fields[1], secret) &&
+               hostMatches(link.address, claimed->peer.host);
+  if (known) {
+    std::string peer = fields[0];
+    timeval noTimeout{0, 0};
+    setsockopt(link.socket.getSocket(), SOL_SOCKET, SO_RCVTIMEO, &noTimeout,
+               sizeof(noTimeout));
+    link.authenticated = true;
+    logMessage("Cluster node " + peer + " connected", SERVER_LOG_FILE);
+    while (running && link.socket.receiveMessage(message)) {
+      Message reply = handler(message);
+      if (message.header.requestId != 0) {
+        reply.header.flag = static_cast<uint32_t>(ClusterOp::REPLY);
+        reply.header.requestId = message.header.requestId;
+        link.socket.sendMessage(reply);
+      }
+    }
+    logMessage("Cluster node " + peer + " disconnected", SERVER_LOG_FILE);
+  } else {
+    logMessage("Rejected cluster connection from " + addressText(link.address),
+               SERVER_LOG_FILE);
+  }
+  link.finished = true;
+}
+
+void ClusterNode::reapInbound(bool all) {
+  std::lock_guard<std::mutex> lock(inboundMutex);
+  for (auto it = inbound.begin(); it != inbound.end();) {
+    InboundLink &link = **it;
+    if (all && !link.finished) {
+      shutdown(link.socket.getSocket(), SHUT_RDWR);
+    }
+    if (all || link.finished) {
+      link.thread.join();
+      it = inbound.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
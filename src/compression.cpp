@@ -0,0 +1,52 @@
+#include "../include/compression.hpp"
+
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include <cstring>
+
+bool compressBody(const std::vector<uint8_t> &body, std::vector<uint8_t> &out,
+                  int level) {
+  if (body.size() > 4 * COMPRESSION_PROBE_SIZE) {
+    uint8_t probe[COMPRESSION_PROBE_SIZE + 64];
+    uLongf probeSize = sizeof(probe);
+    if (compress2(probe, &probeSize, body.data(), COMPRESSION_PROBE_SIZE,
+                  level) != Z_OK ||
+        probeSize > COMPRESSION_PROBE_SIZE * COMPRESSION_PROBE_RATIO) {
+      return false;
+    }
+  }
+  uLongf bound = compressBound(body.size());
+  out.resize(sizeof(uint32_t) + bound);
+  uint32_t netSize = htonl(static_cast<uint32_t>(body.size()));
+  std::memcpy(out.data(), &netSize, sizeof(uint32_t));
+
+  if (compress2(out.data() + sizeof(uint32_t), &bound, body.data(),
+                body.size(), level) != Z_OK) {
+    return false;
+  }
+  out.resize(sizeof(uint32_t) + bound);
+  return out.size() < body.size();
+}
+
+bool decompressBody(const std::vector<uint8_t> &body,
+                    std::vector<uint8_t> &out) {
+  if (body.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t netSize;
+  std::memcpy(&netSize, body.data(), sizeof(uint32_t));
+  uLongf size = ntohl(netSize);
+  if (size > COMPRESSION_MAX_SIZE) {
+    return false;
+  }
+
+  out.resize(size);
+  uLongf produced = size;
+  if (uncompress(out.data(), &produced, body.data() + sizeof(uint32_t),
+                 body.size() - sizeof(uint32_t)) != Z_OK ||
+      produced != size) {
+    return false;
+  }
+  return true;
+}
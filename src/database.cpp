@@ -9,10 +9,12 @@ std::unordered_set<std::string> DataBase::addFile(const std::string &path) {
   }
   return set;
 }
-std::vector<User> DataBase::addFileNicknames(const std::string &path) {
+std::vector<User> DataBase::addFileNicknames(const std::string &path,
+                                            uint64_t offset) {
   User user;
   std::vector<User> users_map;
   std::ifstream dbFile(path);
+  dbFile.seekg(offset);
   std::string line;
   while (std::getline(dbFile, line)) {
     std::istringstream iss(line);
@@ -26,6 +28,12 @@ std::vector<User> DataBase::addFileNicknames(const std::string &path) {
       user.socketNumber = socketNumber;
       user.login = login;
       user.password = password;
+      boost::uuids::uuid uuid;
+      user.localId =
+          parseUuid(id, uuid) ? userRegistry.intern(uuid) : INVALID_LOCAL_ID;
+      // Логин первым: по нему setNickname отличает заглушки
+      userRegistry.setLogin(user.localId, login);
+      userRegistry.setNickname(user.localId, nickname);
       users_map.push_back(user);
     }
   }
@@ -53,6 +61,18 @@ std::string DataBase::pathToChannelsHistory(const std::string &channel) {
   return directory + channel + "_history.txt";
 }
 
+std::string DataBase::pathToChannelsIndex(const std::string &channel) {
+  std::string directory = "./channels/history/";
+  createDirectoryIfNeeded(directory);
+  return directory + channel + "_index.txt";
+}
+
+std::string DataBase::pathToChannelsHistoryIndex(const std::string &channel) {
+  std::string directory = "./channels/history/";
+  createDirectoryIfNeeded(directory);
+  return directory + channel + "_history.idx";
+}
+
 std::string DataBase::pathToChannels() {
   std::string directory = "./channels/";
   createDirectoryIfNeeded(directory);
@@ -60,94 +80,84 @@ std::string DataBase::pathToChannels() {
 }
 
 std::vector<User> DataBase::nicknamesFile() {
+  ScopedLatency latency(Metric::DB_READ_USERS);
   std::string directory = "./users/";
   createDirectoryIfNeeded(directory);
   return addFileNicknames(directory + users_file);
 }
 
 std::unordered_set<std::string> DataBase::channelsFile() {
+  ScopedLatency latency(Metric::DB_READ_CHANNELS);
   std::string directory = "./channels/";
   createDirectoryIfNeeded(directory);
   return addFile(directory + channels_file);
 }
 
-std::unordered_set<std::string> DataBase::channelsMembersFile(
+std::unordered_set<LocalId> DataBase::channelsMembersFile(
     const std::string &channel) {
-  std::string path = pathToChannelsMembers(channel);
-  return addFile(path);
+  ScopedLatency latency(Metric::DB_READ_MEMBERS);
+  std::unordered_set<LocalId> members;
+  std::ifstream dbFile(pathToChannelsMembers(channel));
+  std::string elem;
+  while (dbFile >> elem) {
+    LocalId id = userRegistry.parseStored(elem);
+    if (id != INVALID_LOCAL_ID) {
+      members.insert(id);
+    }
+  }
+  return members;
 }
 
-int DataBase::channelsMembersCount(const std::string &channel) {
-  std::string path = pathToChannelsMembers(channel);
-  std::ifstream dbFile(path);
-  std::string line;
-  int count = 0;
-  while (std::getline(dbFile, line)) {
-    count++;
+std::unordered_set<LocalId> DataBase::channelMembers(
+    const std::string &channel) {
+  std::lock_guard<std::mutex> lock(membersMutex);
+  auto it = membersCache.find(channel);
+  if (it == membersCache.end()) {
+    it = membersCache.emplace(channel, channelsMembersFile(channel)).first;
   }
-  return count;
+  return it->second;
+}
+
+void DataBase::dropChannelMembers(const std::string &channel) {
+  std::lock_guard<std::mutex> lock(membersMutex);
+  // Пустой список, а не удаление: кадр голоса между этим вызовом и удалением
+  // файла не должен снова прочитать старый файл
+  membersCache[channel].clear();
 }
 
-#include <regex>
+int DataBase::channelsMembersCount(const std::string &channel) {
+  return static_cast<int>(channelMembers(channel).size());
+}
 
 std::vector<History> DataBase::channelsHistoryFile(const std::string &channel) {
+  ScopedLatency latency(Metric::DB_READ_HISTORY);
   std::string path = pathToChannelsHistory(channel);
   std::vector<History> container;
   std::ifstream dbFile(path);
   std::string line;
 
-  // Регулярные выражения для текстовых, аудиосообщений и файловых сообщений
-  std::regex textMessagePattern(R"(\[(.+?)\] (.+?): (.+))");
-  std::regex audioMessagePattern(
-      R"(\[(.+?)\] (.+?): \[Voicemail_ID: (.+), duration: (.+)\])");
-  std::regex fileMessagePattern(
-      R"(\[(.+?)\] (.+?): \[File_ID: (.+?), Name: (.+?),(?: Extension: (.+?),)? Size: (\d+) \])");
-
+  uint64_t seq = 0;
   while (std::getline(dbFile, line)) {
-    std::smatch matches;
     History historyEntry;
+    historyEntry.seq = ++seq;  // Номер записи - номер строки в файле
+    if (parseHistoryLine(line, historyEntry)) {
+      container.push_back(historyEntry);
+    } else {
+      std::cerr << "Failed to parse line: " << line << std::endl;
+    }
+  }
+  return container;
+}
 
-    if (std::regex_match(line, matches, textMessagePattern)) {
-      // Текстовое сообщение
-      if (matches.size() == 4) {
-        historyEntry.time = matches[1].str();
-        historyEntry.id = matches[2].str();
-        historyEntry.message = matches[3].str();
-        historyEntry.isAudio = false;
-        historyEntry.isFile = false;
-        container.push_back(historyEntry);
-      }
-    } else if (std::regex_match(line, matches, audioMessagePattern)) {
-      // Аудиосообщение
-      if (matches.size() == 5) {
-        historyEntry.time = matches[1].str();
-        historyEntry.id = matches[2].str();
-        historyEntry.voicemailID = matches[3].str();
-        historyEntry.duration = matches[4].str();
-        historyEntry.isAudio = true;
-        historyEntry.isFile = false;
-        container.push_back(historyEntry);
-      }
-    } else if (std::regex_match(line, matches, fileMessagePattern)) {
-      // Файловое сообщение
-      // matches:
-      // 1 - time
-      // 2 - id
-      // 3 - fileID
-      // 4 - filename
-      // 5 - extension (опционально)
-      // 6 - fileSize
-      if (matches.size() >= 6) {
-        historyEntry.time = matches[1].str();
-        historyEntry.id = matches[2].str();
-        historyEntry.fileID = matches[3].str();
-        historyEntry.filename = matches[4].str();
-        historyEntry.extension = matches[5].matched ? matches[5].str() : "";
-        historyEntry.fileSize = std::stoul(matches[6].str());
-        historyEntry.isAudio = false;
-        historyEntry.isFile = true;
-        container.push_back(historyEntry);
-      }
+std::vector<History> DataBase::parseHistoryRecords(
+    const std::vector<HistoryRecord> &records) {
+  std::vector<History> container;
+  container.reserve(records.size());
+  for (const auto &[seq, line] : records) {
+    History historyEntry;
+    historyEntry.seq = seq;
+    if (parseHistoryLine(line, historyEntry)) {
+      container.push_back(historyEntry);
     } else {
       std::cerr << "Failed to parse line: " << line << std::endl;
     }
@@ -155,8 +165,33 @@ std::vector<History> DataBase::channelsHistoryFile(const std::string &channel) {
   return container;
 }
 
+std::vector<History> DataBase::channelsHistorySince(const std::string &channel,
+                                                    uint64_t seq) {
+  ScopedLatency latency(Metric::DB_READ_HISTORY);
+  return parseHistoryRecords(
+      historyIndex.readSince(channel, pathToChannelsHistory(channel),
+                             pathToChannelsHistoryIndex(channel), seq));
+}
+
+std::vector<History> DataBase::channelsHistorySinceTime(
+    const std::string &channel, uint64_t timestampMs) {
+  ScopedLatency latency(Metric::DB_READ_HISTORY);
+  return parseHistoryRecords(historyIndex.readSinceTime(
+      channel, pathToChannelsHistory(channel),
+      pathToChannelsHistoryIndex(channel), timestampMs));
+}
+
+std::vector<History> DataBase::channelsHistoryBefore(const std::string &channel,
+                                                     uint64_t seq) {
+  ScopedLatency latency(Metric::DB_READ_HISTORY);
+  return parseHistoryRecords(
+      historyIndex.readBefore(channel, pathToChannelsHistory(channel),
+                              pathToChannelsHistoryIndex(channel), seq));
+}
+
 void DataBase::addUser(const std::string &username, int socketNumber,
                        const std::string &login, const std::string &password) {
+  ScopedLatency latency(Metric::DB_APPEND_USER);
   std::string directory = "./users/";
   std::string colon = ":";
   boost::uuids::random_generator generator;
@@ -165,6 +200,34 @@ void DataBase::addUser(const std::string &username, int socketNumber,
   std::ofstream UsersFile(directory + users_file, std::ios_base::app);
   UsersFile << uuid << colon << username << colon << socketNumber << colon
             << login << colon << password << std::endl;
+  LocalId localId = userRegistry.intern(uuid);
+  userRegistry.setLogin(localId, login);
+  userRegistry.setNickname(localId, username);
+}
+
+LocalId DataBase::addRemoteUser(const std::string &id,
+                                const std::string &nickname) {
+  LocalId localId = userRegistry.find(id);
+  if (localId != INVALID_LOCAL_ID) {
+    if (!userRegistry.hasLogin(localId) &&
+        userRegistry.nickname(localId) != nickname) {
+      changeNickname(id, nickname);
+    }
+    return localId;
+  }
+  boost::uuids::uuid uuid;
+  if (!parseUuid(id, uuid)) {
+    return INVALID_LOCAL_ID;
+  }
+  ScopedLatency latency(Metric::DB_APPEND_USER);
+  std::string directory = "./users/";
+  createDirectoryIfNeeded(directory);
+  std::ofstream UsersFile(directory + users_file, std::ios_base::app);
+  // Пароль "-" не совпадает ни с одним хешем; пустой логин не ищется
+  UsersFile << id << ":" << nickname << ":0::-" << std::endl;
+  localId = userRegistry.intern(uuid);
+  userRegistry.setNickname(localId, nickname);
+  return localId;
 }
 
 void DataBase::addChannel(const std::string &channel) {
@@ -174,55 +237,107 @@ void DataBase::addChannel(const std::string &channel) {
   ChannelsFile << channel << std::endl;
 }
 
-void DataBase::addChannelMember(const std::string &id,
-                                const std::string &channel) {
+void DataBase::addChannelMember(LocalId id, const std::string &channel) {
+  if (id == INVALID_LOCAL_ID) {
+    return;
+  }
+  ScopedLatency latency(Metric::DB_APPEND_MEMBER);
+  std::lock_guard<std::mutex> lock(membersMutex);
   std::string channel_members_file = pathToChannelsMembers(channel);
   std::ofstream ChannelMembersFile(channel_members_file, std::ios_base::app);
 
   ChannelMembersFile << id << std::endl;
+  // Ещё не прочитанный список прочитается из файла уже с этой записью
+  auto it = membersCache.find(channel);
+  if (it != membersCache.end()) {
+    it->second.insert(id);
+  }
 }
 
-void DataBase::addMessageInChannel(const std::string &id,
-                                   const std::string &channel,
+void DataBase::addMessageInChannel(LocalId id, const std::string &channel,
                                    const std::string &message) {
-  std::string channel_members_file = pathToChannelsHistory(channel);
-  // database_names = nicknamesFile();
-  std::string nickname;
-  std::ofstream ChannelHistoryFile(channel_members_file, std::ios_base::app);
   std::time_t currentTime = std::time(nullptr);
   char timeBuffer[9];
   std::strftime(timeBuffer, sizeof(timeBuffer), "%H:%M:%S",
                 std::localtime(&currentTime));
-  ChannelHistoryFile << "[" << timeBuffer << "] " << id << ": " << message
-                     << std::endl;
+  appendHistoryRecord(channel, "[" + std::string(timeBuffer) + "] " +
+                                   std::to_string(id) + ": " + message);
+}
+
+std::string DataBase::appendHistoryRecord(const std::string &channel,
+                                          const std::string &record) {
+  ScopedLatency latency(Metric::DB_APPEND_HISTORY);
+  std::string line =
+      historyIndex.appendRecord(channel, pathToChannelsHistory(channel),
+                                pathToChannelsHistoryIndex(channel), record);
+  if (line.empty()) {
+    std::cerr << "Не удалось открыть файл истории канала: "
+              << pathToChannelsHistory(channel) << std::endl;
+    return line;
+  }
+  indexHistoryLine(channel, line);
+  return line;
 }
 
 bool DataBase::parseHistoryLine(const std::string &lineStr,
                                 History &historyEntry) {
-  // Regex patterns for matching text and audio messages
-  std::regex textMessagePattern(R"(\[(.+?)\] (.+?): (.+))");
-  std::regex audioMessagePattern(
+  // Регулярные выражения для текстовых, аудиосообщений и файловых сообщений
+  static const std::regex textMessagePattern(R"(\[(.+?)\] (.+?): (.+))");
+  static const std::regex audioMessagePattern(
       R"(\[(.+?)\] (.+?): \[Voicemail_ID: (.+), duration: (.+)\])");
+  static const std::regex fileMessagePattern(
+      R"(\[(.+?)\] (.+?): \[File_ID: (.+?), Name: (.+?),(?: Extension: (.+?),)? Size: (\d+) \])");
+
+  // Новые записи начинаются с "#<seq>@<epoch-ms> "
+  uint64_t seq = 0, timestampMs = 0;
+  size_t prefixLength = parseRecordPrefix(lineStr, seq, timestampMs);
+  if (prefixLength != 0) {
+    historyEntry.seq = seq;
+    historyEntry.timestampMs = timestampMs;
+  }
+  const std::string record = lineStr.substr(prefixLength);
 
   std::smatch matches;
 
-  if (std::regex_match(lineStr, matches, textMessagePattern)) {
-    // It's a text message
+  if (std::regex_match(record, matches, textMessagePattern)) {
+    // Текстовое сообщение
     if (matches.size() == 4) {
       historyEntry.time = matches[1].str();
-      historyEntry.id = matches[2].str();
+      historyEntry.userId = userRegistry.parseStored(matches[2].str());
       historyEntry.message = matches[3].str();
       historyEntry.isAudio = false;
+      historyEntry.isFile = false;
       return true;
     }
-  } else if (std::regex_match(lineStr, matches, audioMessagePattern)) {
-    // It's an audio message
+  } else if (std::regex_match(record, matches, audioMessagePattern)) {
+    // Аудиосообщение
     if (matches.size() == 5) {
       historyEntry.time = matches[1].str();
-      historyEntry.id = matches[2].str();
+      historyEntry.userId = userRegistry.parseStored(matches[2].str());
       historyEntry.voicemailID = matches[3].str();
       historyEntry.duration = matches[4].str();
       historyEntry.isAudio = true;
+      historyEntry.isFile = false;
+      return true;
+    }
+  } else if (std::regex_match(record, matches, fileMessagePattern)) {
+    // Файловое сообщение
+    // matches:
+    // 1 - time
+    // 2 - id
+    // 3 - fileID
+    // 4 - filename
+    // 5 - extension (опционально)
+    // 6 - fileSize
+    if (matches.size() >= 6) {
+      historyEntry.time = matches[1].str();
+      historyEntry.userId = userRegistry.parseStored(matches[2].str());
+      historyEntry.fileID = matches[3].str();
+      historyEntry.filename = matches[4].str();
+      historyEntry.extension = matches[5].matched ? matches[5].str() : "";
+      historyEntry.fileSize = std::stoul(matches[6].str());
+      historyEntry.isAudio = false;
+      historyEntry.isFile = true;
       return true;
     }
   }
@@ -230,6 +345,47 @@ bool DataBase::parseHistoryLine(const std::string &lineStr,
   return false;  // Failed to parse
 }
 
+bool DataBase::loadSearchIndex(const std::string &channel) {
+  if (searchIndex.isLoaded(channel)) {
+    return false;
+  }
+  std::string indexPath = pathToChannelsIndex(channel);
+  if (searchIndex.loadChannel(channel, indexPath, userRegistry)) {
+    return false;
+  }
+  // Индекса ещё нет (канал создан до его появления) - строим по истории
+  for (const History &entry : channelsHistoryFile(channel)) {
+    searchIndex.addMessage(
+        channel, indexPath,
+        {entry.time, entry.userId,
+         entry.isFile ? entry.filename : entry.message});
+  }
+  return true;
+}
+
+void DataBase::indexHistoryLine(const std::string &channel,
+                                const std::string &line) {
+  History historyEntry;
+  if (!parseHistoryLine(line, historyEntry)) {
+    historyCache.invalidate(channel);
+    return;
+  }
+  // Если индекс был построен по истории, эта строка в нём уже есть
+  if (!loadSearchIndex(channel)) {
+    searchIndex.addMessage(channel, pathToChannelsIndex(channel),
+                           {historyEntry.time, historyEntry.userId,
+                            historyEntry.isFile ? historyEntry.filename
+                                                : historyEntry.message});
+  }
+  // Если автор неизвестен, безопаснее пересобрать ответ при следующем /read
+  std::string nickname = userRegistry.nickname(historyEntry.userId);
+  if (nickname.empty()) {
+    historyCache.invalidate(channel);
+    return;
+  }
+  historyCache.append(channel, historyEntry, nickname);
+}
+
 std::string formatFileSize(uint32_t fileSize) {
   double sizeInMB = static_cast<double>(fileSize) / (1024 * 1024);
   char buffer[50];
@@ -237,19 +393,11 @@ std::string formatFileSize(uint32_t fileSize) {
   return std::string(buffer);
 }
 
-void DataBase::addFileMessageToChannelHistory(const std::string &senderNickname,
+void DataBase::addFileMessageToChannelHistory(LocalId senderId,
                                               const std::string &channel,
                                               const std::string &fileMessageID,
                                               std::string &filename,
                                               uint32_t &fileSize) {
-  std::string channelHistoryFilePath = pathToChannelsHistory(channel);
-  std::ofstream channelHistoryFile(channelHistoryFilePath, std::ios_base::app);
-  if (!channelHistoryFile.is_open()) {
-    std::cerr << "Не удалось открыть файл истории канала: "
-              << channelHistoryFilePath << std::endl;
-    return;
-  }
-
   // Получаем текущее время в формате YYYY-MM-DD HH:MM:SS
   std::time_t currentTime = std::time(nullptr);
   char timeBuffer[20];
@@ -257,23 +405,15 @@ void DataBase::addFileMessageToChannelHistory(const std::string &senderNickname,
                 std::localtime(&currentTime));
 
   // Записываем в файл истории
-  channelHistoryFile << "[" << timeBuffer << "] " << senderNickname << ": "
-                     << "[File_ID: " << fileMessageID << ", Name: " << filename
-                     << ", Size: " << formatFileSize(fileSize) << "]"
-                     << std::endl;
-  channelHistoryFile.close();
+  appendHistoryRecord(channel, "[" + std::string(timeBuffer) + "] " +
+                                   std::to_string(senderId) + ": " +
+                                   "[File_ID: " +
+                                   fileMessageID + ", Name: " + filename +
+                                   ", Size: " + formatFileSize(fileSize) + "]");
 }
 void DataBase::addAudioMessageToChannelHistory(
-    const std::string &senderNickname, const std::string &channel,
+    LocalId senderId, const std::string &channel,
     const std::string &audioMessageID, double duration) {
-  std::string channelHistoryFilePath = pathToChannelsHistory(channel);
-  std::ofstream channelHistoryFile(channelHistoryFilePath, std::ios_base::app);
-  if (!channelHistoryFile.is_open()) {
-    std::cerr << "Не удалось открыть файл истории канала: "
-              << channelHistoryFilePath << std::endl;
-    return;
-  }
-
   // Получаем текущее время в формате YYYY-MM-DD HH:MM:SS
   std::time_t currentTime = std::time(nullptr);
   char timeBuffer[20];
@@ -289,15 +429,19 @@ void DataBase::addAudioMessageToChannelHistory(
   std::string durationStr = durationStream.str();
 
   // Записываем в файл истории
-  channelHistoryFile << "[" << timeBuffer << "] " << senderNickname << ": "
-                     << "[Voicemail_ID: " << audioMessageID
-                     << ", duration: " << durationStr << "]" << std::endl;
-
-  channelHistoryFile.close();
+  appendHistoryRecord(channel, "[" + std::string(timeBuffer) + "] " +
+                                   std::to_string(senderId) + ": " +
+                                   "[Voicemail_ID: " +
+                                   audioMessageID + ", duration: " +
+                                   durationStr + "]");
 }
 
-void DataBase::deleteChannelMember(const std::string &id,
-                                   const std::string &channel) {
+void DataBase::deleteChannelMember(LocalId id, const std::string &channel) {
+  std::lock_guard<std::mutex> lock(membersMutex);
+  auto it = membersCache.find(channel);
+  if (it != membersCache.end()) {
+    it->second.erase(id);
+  }
   std::string channel_members_file = pathToChannelsMembers(channel);
   std::ifstream ChannelMembersFile(channel_members_file);
   if (!ChannelMembersFile.is_open()) {
@@ -308,8 +452,10 @@ void DataBase::deleteChannelMember(const std::string &id,
   temp_file.open("temp.txt");
   std::string line;
   while (std::getline(ChannelMembersFile, line)) {
-    if (line != id) {
-      temp_file << line << std::endl;
+    // Старые записи с UUID при перезаписи переводятся в номера
+    LocalId member = userRegistry.parseStored(line);
+    if (member != id && member != INVALID_LOCAL_ID) {
+      temp_file << member << std::endl;
     }
   }
   temp_file.close();
@@ -327,7 +473,27 @@ void DataBase::deleteChannelMember(const std::string &id,
   }
 }
 
+void DataBase::releaseChannelBlobs(const std::string &channel) {
+  static const std::regex blobReference(
+      R"(\[(File_ID|Voicemail_ID): ([0-9a-f]{64}),)");
+  std::ifstream historyFile(pathToChannelsHistory(channel));
+  std::string line;
+  std::smatch match;
+  while (std::getline(historyFile, line)) {
+    if (std::regex_search(line, match, blobReference)) {
+      blobStore.release(match[2], match[1] == "File_ID" ? BlobRef::FILE
+                                                        : BlobRef::VOICEMAIL);
+    }
+  }
+}
+
 void DataBase::deleteChannel(const std::string &channel) {
+  releaseChannelBlobs(channel);
+  historyCache.invalidate(channel);
+  searchIndex.dropChannel(channel);
+  historyIndex.dropChannel(channel);
+  std::remove(pathToChannelsIndex(channel).c_str());
+  std::remove(pathToChannelsHistoryIndex(channel).c_str());
   std::string channels_file = pathToChannels();
   std::ifstream ChannelsFile(channels_file);
   if (!ChannelsFile.is_open()) {
@@ -360,6 +526,11 @@ void DataBase::deleteChannel(const std::string &channel) {
 
 void DataBase::changeNickname(const std::string &id,
                               const std::string &newUsername) {
+  // Ник входит в каждую строку готовых ответов /read
+  historyCache.clear();
+  userRegistry.setNickname(userRegistry.find(id), newUsername);
+  // users.txt переписывается целиком, смещение в снимке становится неверным
+  std::remove(SNAPSHOT_FILE);
   std::string users_file = "./users/users.txt";
   std::ifstream UsersFile(users_file);
 
@@ -443,19 +614,18 @@ bool DataBase::removeChannelFiles(const std::string &pathMembers,
 }
 
 bool DataBase::ChannelExists(std::string &channel) {
-  std::lock_guard<std::mutex> lock(dbMutex);
+  std::lock_guard<MeteredMutex> lock(dbMutex);
   return database_channels.find(channel) != database_channels.end();
 }
 
-bool DataBase::nickameInSet(std::string nickname,
-                            std::unordered_set<std::string> set) {
-  return set.find(nickname) != set.end();
-}
-
 std::string DataBase::userId(std::string &login) {
   std::string id;
+  // Пустой логин только у заглушек с других узлов: под ними не входят
+  if (login.empty()) {
+    return id;
+  }
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     database_names = nicknamesFile();
     for (User user : database_names) {
       if (user.login == login) {
@@ -473,7 +643,7 @@ std::string DataBase::userId(std::string &login) {
 std::string DataBase::userNickbyId(std::string &id) {
   std::string nickname;
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     database_names = nicknamesFile();
     for (User user : database_names) {
       if (user.id == id) {
@@ -490,11 +660,11 @@ void DataBase::channelMessage(Message &message, std::string &channel,
   logMessage("CHANNEL FLAG.............", SERVER_LOG_FILE);
   channel = messageToString(message);
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    database_channels_members = channelsMembersFile(channel);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    database_channels_members = channelMembers(channel);
   }
   if (!ChannelExists(channel)) {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     addChannel(channel);
   }
 
@@ -520,7 +690,7 @@ bool DataBase::idMessage(bool &idReceived, Message &message, std::string &id) {
 std::string DataBase::listOfChannelsOnServer() {
   std::string output;
   int countMembers = 0;
-  std::lock_guard<std::mutex> lock(dbMutex);
+  std::lock_guard<MeteredMutex> lock(dbMutex);
   database_channels = channelsFile();
   if (database_channels.empty()) {
     output += "No existing channels.\n";
@@ -535,7 +705,74 @@ std::string DataBase::listOfChannelsOnServer() {
   return output;
 }
 
-bool DataBase::MemberInChannel(const std::string &id) {
-  std::lock_guard<std::mutex> lock(dbMutex);
+bool DataBase::MemberInChannel(LocalId id) {
+  std::lock_guard<MeteredMutex> lock(dbMutex);
   return database_channels_members.find(id) != database_channels_members.end();
-}
\ No newline at end of file
+}
+
+std::vector<SearchDocument> DataBase::searchInChannel(
+    const std::string &channel, const std::vector<std::string> &terms) {
+  loadSearchIndex(channel);
+  return searchIndex.search(channel, terms);
+}
+
+bool DataBase::saveSnapshot(MeteredMutex &writersMutex) {
+  std::string usersPath = "./users/" + users_file;
+  SnapshotWriter writer;
+  {
+    // addUser дописывает строку в users.txt раньше, чем заносит её в реестр:
+    // без блокировки пользователь между чтением смещения и сериализацией
+    // не попадёт ни в снимок, ни в дочитываемый хвост файла
+    std::lock_guard<MeteredMutex> lock(writersMutex);
+    std::error_code ec;
+    uint64_t usersOffset =
+        fs::exists(usersPath, ec) ? fs::file_size(usersPath, ec) : 0;
+    writer.writeU64(SNAPSHOT_MAGIC);
+    writer.writeU32(SNAPSHOT_VERSION);
+    writer.writeU64(usersOffset);
+    userRegistry.saveSnapshot(writer);
+    historyIndex.saveSnapshot(writer);
+  }
+
+  blobStore.compactRefs();
+
+  createDirectoryIfNeeded(SNAPSHOT_DIRECTORY);
+  if (!writer.commit(SNAPSHOT_FILE)) {
+    logMessage("Failed to write snapshot", SERVER_LOG_FILE);
+    return false;
+  }
+  logMessage("Snapshot saved: " + std::to_string(userRegistry.size()) +
+                 " users",
+             SERVER_LOG_FILE);
+  return true;
+}
+
+bool DataBase::loadSnapshot() {
+  SnapshotReader reader(SNAPSHOT_FILE);
+  uint64_t magic, usersOffset;
+  uint32_t version;
+  if (!reader.isOpen() || !reader.readU64(magic) || magic != SNAPSHOT_MAGIC ||
+      !reader.readU32(version) || version != SNAPSHOT_VERSION ||
+      !reader.readU64(usersOffset)) {
+    return false;
+  }
+
+  // Снимок старше файла пользователей: users.txt только дописывается
+  std::string usersPath = "./users/" + users_file;
+  std::error_code ec;
+  uint64_t usersSize = fs::exists(usersPath, ec) ? fs::file_size(usersPath, ec)
+                                                  : 0;
+  if (usersSize < usersOffset || !userRegistry.loadSnapshot(reader) ||
+      !historyIndex.loadSnapshot(reader)) {
+    logMessage("Snapshot is stale or damaged, loading text files",
+               SERVER_LOG_FILE);
+    return false;
+  }
+
+  // Пользователи, зарегистрированные после снимка
+  addFileNicknames(usersPath, usersOffset);
+  logMessage("Snapshot loaded: " + std::to_string(userRegistry.size()) +
+                 " users",
+             SERVER_LOG_FILE);
+  return true;
+}
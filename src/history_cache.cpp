@@ -0,0 +1,111 @@
+#include "../include/history_cache.hpp"
+
+#include "../include/database.hpp"
+
+std::string renderHistoryLine(const History &line, const std::string &nickname,
+                              bool timeFlag) {
+  std::ostringstream oss;
+  if (timeFlag) {
+    oss << "[" << line.time << "] ";
+  }
+
+  oss << nickname << ": ";
+
+  if (line.isAudio) {
+    oss << "[Voicemail_ID: " << line.voicemailID
+        << ", Duration: " << line.duration << "]";
+  } else if (line.isFile) {
+    oss << "[File_ID: " << line.fileID << ", Name: " << line.filename;
+    if (!line.extension.empty()) {
+      oss << ", Extension: " << line.extension;
+    }
+    oss << ", Size: " << line.fileSize << " bytes]";
+  } else {
+    oss << line.message;
+  }
+  return oss.str();
+}
+
+void HistoryCache::touch(Entry &entry) {
+  lru.splice(lru.begin(), lru, entry.lruPosition);
+}
+
+bool HistoryCache::get(const std::string &channel, bool timeFlag,
+                       std::string &rendered) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = entries.find(channel);
+  if (it == entries.end() || !it->second.valid[timeFlag]) {
+    missCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  touch(it->second);
+  rendered = it->second.rendered[timeFlag];
+  hitCount.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void HistoryCache::put(const std::string &channel, bool timeFlag,
+                       const std::string &rendered) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = entries.find(channel);
+  if (it == entries.end()) {
+    // Вытесняем самый давно использованный канал
+    if (entries.size() >= capacity && !lru.empty()) {
+      entries.erase(lru.back());
+      lru.pop_back();
+    }
+    lru.push_front(channel);
+    it = entries.emplace(channel, Entry{}).first;
+    it->second.lruPosition = lru.begin();
+  } else {
+    touch(it->second);
+  }
+  it->second.rendered[timeFlag] = rendered;
+  it->second.valid[timeFlag] = true;
+}
+
+void HistoryCache::append(const std::string &channel, const History &line,
+                          const std::string &nickname) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = entries.find(channel);
+  if (it == entries.end()) {
+    return;
+  }
+  for (int timeFlag = 0; timeFlag < 2; ++timeFlag) {
+    Entry &entry = it->second;
+    if (!entry.valid[timeFlag]) {
+      continue;
+    }
+    if (!entry.rendered[timeFlag].empty()) {
+      entry.rendered[timeFlag] += '\n';
+    }
+    entry.rendered[timeFlag] += renderHistoryLine(line, nickname, timeFlag);
+  }
+}
+
+void HistoryCache::invalidate(const std::string &channel) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = entries.find(channel);
+  if (it == entries.end()) {
+    return;
+  }
+  lru.erase(it->second.lruPosition);
+  entries.erase(it);
+}
+
+void HistoryCache::clear() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  entries.clear();
+  lru.clear();
+}
+
+std::string HistoryCache::stats() {
+  size_t cached;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cached = entries.size();
+  }
+  return "History cache: hits " + std::to_string(hits()) + ", misses " +
+         std::to_string(misses()) + ", channels " + std::to_string(cached) +
+         "/" + std::to_string(capacity);
+}
@@ -0,0 +1,295 @@
+#include "../include/history_index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+uint64_t currentTimeMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool parseHistoryTime(const std::string &text, uint64_t &timestampMs) {
+  std::time_t now = std::time(nullptr);
+  std::tm tm = *std::localtime(&now);
+  std::istringstream iss(text);
+
+  if (text.find('T') != std::string::npos) {
+    iss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+  } else {
+    iss >> std::get_time(&tm, "%H:%M:%S");
+  }
+  if (iss.fail()) {
+    return false;
+  }
+  tm.tm_isdst = -1;
+  std::time_t seconds = std::mktime(&tm);
+  if (seconds < 0) {
+    return false;
+  }
+  timestampMs = static_cast<uint64_t>(seconds) * 1000;
+  return true;
+}
+
+size_t parseRecordPrefix(const std::string &line, uint64_t &seq,
+                         uint64_t &timestampMs) {
+  if (line.empty() || line[0] != '#') {
+    return 0;
+  }
+  size_t at = line.find('@');
+  size_t space = line.find(' ');
+  if (at == std::string::npos || space == std::string::npos || at > space) {
+    return 0;
+  }
+  try {
+    seq = std::stoull(line.substr(1, at - 1));
+    timestampMs = std::stoull(line.substr(at + 1, space - at - 1));
+  } catch (const std::exception &e) {
+    return 0;
+  }
+  return space + 1;
+}
+
+void HistoryIndex::addCheckpoint(ChannelState &state,
+                                 const std::string &indexPath,
+                                 const HistoryCheckpoint &checkpoint) {
+  state.checkpoints.push_back(checkpoint);
+  std::ofstream indexFile(indexPath, std::ios::binary | std::ios::app);
+  indexFile.write(reinterpret_cast<const char *>(&checkpoint),
+                  sizeof(checkpoint));
+}
+
+HistoryIndex::ChannelState &HistoryIndex::loadState(
+    const std::string &channel, const std::string &historyPath,
+    const std::string &indexPath) {
+  auto it = channels.find(channel);
+  if (it != channels.end()) {
+    return it->second;
+  }
+
+  ChannelState state;
+  state.historyPath = historyPath;
+  state.indexPath = indexPath;
+  std::error_code ec;
+  uint64_t historySize = std::filesystem::exists(historyPath, ec)
+                             ? std::filesystem::file_size(historyPath, ec)
+                             : 0;
+
+  // Загружаем сохранённые контрольные точки, если они не устарели
+  std::ifstream indexFile(indexPath, std::ios::binary);
+  HistoryCheckpoint checkpoint;
+  while (indexFile.read(reinterpret_cast<char *>(&checkpoint),
+                        sizeof(checkpoint))) {
+    state.checkpoints.push_back(checkpoint);
+  }
+  indexFile.close();
+  if (!state.checkpoints.empty() &&
+      state.checkpoints.back().offset >= historySize) {
+    state.checkpoints.clear();
+    std::remove(indexPath.c_str());
+  }
+
+  // Досчитываем записи после последней контрольной точки
+  HistoryCheckpoint from{1, 0, 0};
+  if (!state.checkpoints.empty()) {
+    from = state.checkpoints.back();
+  }
+  std::ifstream historyFile(historyPath, std::ios::binary);
+  historyFile.seekg(from.offset);
+  uint64_t seq = from.seq;
+  uint64_t offset = from.offset;
+  std::string line;
+  while (std::getline(historyFile, line)) {
+    uint64_t prefixSeq = 0, timestampMs = 0;
+    parseRecordPrefix(line, prefixSeq, timestampMs);
+    if ((seq - 1) % HISTORY_INDEX_INTERVAL == 0 &&
+        (state.checkpoints.empty() || state.checkpoints.back().seq < seq)) {
+      addCheckpoint(state, indexPath, {seq, timestampMs, offset});
+    }
+    state.lastSeq = seq;
+    state.lastTimestampMs = std::max(state.lastTimestampMs, timestampMs);
+    offset += line.size() + 1;
+    ++seq;
+  }
+  state.endOffset = offset;
+
+  return channels.emplace(channel, std::move(state)).first->second;
+}
+
+std::string HistoryIndex::appendRecord(const std::string &channel,
+                                       const std::string &historyPath,
+                                       const std::string &indexPath,
+                                       const std::string &record) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  ChannelState &state = loadState(channel, historyPath, indexPath);
+
+  uint64_t seq = state.lastSeq + 1;
+  // Время не убывает, даже если системные часы перевели назад
+  uint64_t timestampMs = std::max(currentTimeMs(), state.lastTimestampMs);
+  std::string line = "#" + std::to_string(seq) + "@" +
+                     std::to_string(timestampMs) + " " + record;
+
+  std::ofstream historyFile(historyPath, std::ios_base::app);
+  if (!historyFile.is_open()) {
+    return "";
+  }
+  historyFile << line << std::endl;
+
+  if ((seq - 1) % HISTORY_INDEX_INTERVAL == 0) {
+    addCheckpoint(state, indexPath, {seq, timestampMs, state.endOffset});
+  }
+  state.lastSeq = seq;
+  state.lastTimestampMs = timestampMs;
+  state.endOffset += line.size() + 1;
+  return line;
+}
+
+template <typename Filter, typename Stop>
+std::vector<HistoryRecord> HistoryIndex::scanFrom(
+    const std::string &historyPath, const HistoryCheckpoint &from,
+    Filter filter, Stop stop) {
+  std::vector<HistoryRecord> records;
+  std::ifstream historyFile(historyPath, std::ios::binary);
+  historyFile.seekg(from.offset);
+
+  uint64_t seq = from.seq;
+  std::string line;
+  while (std::getline(historyFile, line)) {
+    uint64_t prefixSeq = 0, timestampMs = 0;
+    parseRecordPrefix(line, prefixSeq, timestampMs);
+    if (stop(seq)) {
+      break;
+    }
+    if (filter(seq, timestampMs)) {
+      records.emplace_back(seq, line);
+    }
+    ++seq;
+  }
+  return records;
+}
+
+std::vector<HistoryRecord> HistoryIndex::readSince(
+    const std::string &channel, const std::string &historyPath,
+    const std::string &indexPath, uint64_t seq) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  ChannelState &state = loadState(channel, historyPath, indexPath);
+  seq = std::max<uint64_t>(seq, 1);
+  if (state.checkpoints.empty() || seq > state.lastSeq) {
+    return {};
+  }
+
+  // Последняя контрольная точка с номером не больше искомого
+  auto it = std::upper_bound(
+      state.checkpoints.begin(), state.checkpoints.end(), seq,
+      [](uint64_t value, const HistoryCheckpoint &c) { return value < c.seq; });
+  return scanFrom(
+      historyPath, *std::prev(it),
+      [seq](uint64_t current, uint64_t) { return current >= seq; },
+      [](uint64_t) { return false; });
+}
+
+std::vector<HistoryRecord> HistoryIndex::readSinceTime(
+    const std::string &channel, const std::string &historyPath,
+    const std::string &indexPath, uint64_t timestampMs) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  ChannelState &state = loadState(channel, historyPath, indexPath);
+  if (state.checkpoints.empty() || timestampMs > state.lastTimestampMs) {
+    return {};
+  }
+
+  // Записи с нужным временем могут начаться до первой точки не раньше него
+  auto it = std::lower_bound(state.checkpoints.begin(), state.checkpoints.end(),
+                             timestampMs,
+                             [](const HistoryCheckpoint &c, uint64_t value) {
+                               return c.timestampMs < value;
+                             });
+  if (it != state.checkpoints.begin()) {
+    --it;
+  }
+  return scanFrom(
+      historyPath, *it,
+      [timestampMs](uint64_t, uint64_t current) {
+        return current >= timestampMs;
+      },
+      [](uint64_t) { return false; });
+}
+
+std::vector<HistoryRecord> HistoryIndex::readBefore(
+    const std::string &channel, const std::string &historyPath,
+    const std::string &indexPath, uint64_t seq, size_t limit) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  ChannelState &state = loadState(channel, historyPath, indexPath);
+  if (state.checkpoints.empty() || seq <= 1) {
+    return {};
+  }
+
+  uint64_t first = seq > limit ? seq - limit : 1;
+  auto it = std::upper_bound(
+      state.checkpoints.begin(), state.checkpoints.end(), first,
+      [](uint64_t value, const HistoryCheckpoint &c) { return value < c.seq; });
+  return scanFrom(
+      historyPath, *std::prev(it),
+      [first](uint64_t current, uint64_t) { return current >= first; },
+      [seq](uint64_t current) { return current >= seq; });
+}
+
+void HistoryIndex::dropChannel(const std::string &channel) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  channels.erase(channel);
+}
+
+void HistoryIndex::saveSnapshot(SnapshotWriter &writer) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  writer.writeU32(static_cast<uint32_t>(channels.size()));
+  for (const auto &[channel, state] : channels) {
+    writer.writeString(channel);
+    writer.writeString(state.historyPath);
+    writer.writeString(state.indexPath);
+    writer.writeU64(state.lastSeq);
+    writer.writeU64(state.lastTimestampMs);
+    writer.writeU64(state.endOffset);
+    writer.writeU32(static_cast<uint32_t>(state.checkpoints.size()));
+    writer.writeBytes(state.checkpoints.data(),
+                      state.checkpoints.size() * sizeof(HistoryCheckpoint));
+  }
+}
+
+bool HistoryIndex::loadSnapshot(SnapshotReader &reader) {
+  uint32_t count;
+  if (!reader.readU32(count)) {
+    return false;
+  }
+  std::unordered_map<std::string, ChannelState> loaded;
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string channel;
+    ChannelState state;
+    uint32_t checkpointCount;
+    if (!reader.readString(channel) || !reader.readString(state.historyPath) ||
+        !reader.readString(state.indexPath) || !reader.readU64(state.lastSeq) ||
+        !reader.readU64(state.lastTimestampMs) ||
+        !reader.readU64(state.endOffset) || !reader.readU32(checkpointCount)) {
+      return false;
+    }
+    state.checkpoints.resize(checkpointCount);
+    if (!reader.readBytes(state.checkpoints.data(),
+                          checkpointCount * sizeof(HistoryCheckpoint))) {
+      return false;
+    }
+
+    // Если в историю писали после снимка, её хвост дочитает loadState
+    std::error_code ec;
+    uint64_t historySize = std::filesystem::file_size(state.historyPath, ec);
+    if (!ec && historySize == state.endOffset) {
+      loaded.emplace(channel, std::move(state));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  channels = std::move(loaded);
+  return true;
+}
@@ -0,0 +1,411 @@
+#include "../include/metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+struct MetricInfo {
+  const char *name;
+  bool nanoseconds;  // false - глубина очереди
+};
+
+const MetricInfo metricInfo[] = {
+    {"command_read", true},        {"command_send", true},
+    {"command_join", true},        {"command_search", true},
+    {"command_exit", true},        {"command_nick", true},
+    {"command_connect", true},     {"command_channels", true},
+    {"command_time_on", true},     {"command_time_off", true},
+    {"command_voicemail_on", true}, {"command_unknown", true},
+    {"message_text", true},        {"message_number", true},
+    {"message_audio", true},       {"message_file", true},
+    {"message_voice", true},       {"message_batch", true},
+    {"db_read_users", true},       {"db_read_channels", true},
+    {"db_read_members", true},     {"db_read_history", true},
+    {"db_append_user", true},      {"db_append_member", true},
+    {"db_append_history", true},   {"lock_wait_db", true},
+    {"lock_wait_clients", true},   {"queue_auth", false},
+    {"queue_transcode", false},    {"queue_voice", false},
+    {"queue_outbound", false},
+};
+static_assert(sizeof(metricInfo) / sizeof(metricInfo[0]) ==
+                  static_cast<size_t>(Metric::COUNT),
+              "metricInfo must list every Metric");
+
+constexpr size_t METRIC_COUNT = static_cast<size_t>(Metric::COUNT);
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+constexpr uint64_t SUB_BUCKETS = 1ULL << METRICS_SUB_BUCKET_BITS;
+
+// Пишет только поток-владелец, поэтому вместо fetch_add - load и store
+struct ShardHistogram {
+  std::atomic<uint64_t> buckets[METRICS_BUCKETS] = {};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+};
+
+/**
+ * Метрики одного потока. Гистограмма создаётся при первой записи. Шарды
+ * не удаляются: после завершения потока шард достаётся следующему новому
+ * потоку и продолжает копить значения, поэтому суммы монотонны, а число
+ * шардов не больше числа одновременно живших потоков.
+ */
+struct ThreadShard {
+  std::atomic<ShardHistogram *> histograms[METRIC_COUNT] = {};
+  std::atomic<uint64_t> counters[COUNTER_COUNT] = {};
+  std::atomic<bool> owned{true};
+  ThreadShard *next = nullptr;  // Не меняется после публикации
+};
+
+// Список всех шардов; читатели проходят его без блокировок
+std::atomic<ThreadShard *> shardList{nullptr};
+
+ThreadShard *acquireShard() {
+  for (ThreadShard *shard = shardList.load(std::memory_order_acquire);
+       shard != nullptr; shard = shard->next) {
+    bool expected = false;
+    if (!shard->owned.load(std::memory_order_relaxed) &&
+        shard->owned.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      return shard;
+    }
+  }
+  ThreadShard *shard = new ThreadShard;
+  shard->next = shardList.load(std::memory_order_relaxed);
+  while (!shardList.compare_exchange_weak(shard->next, shard,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  return shard;
+}
+
+size_t bucketIndex(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  int msb = 63 - __builtin_clzll(value);
+  if (msb > METRICS_MAX_EXPONENT) {
+    return METRICS_BUCKETS - 1;
+  }
+  int shift = msb - METRICS_SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t bucketUpperBound(size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int shift = index / SUB_BUCKETS - 1;
+  uint64_t lower = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+  return lower + (1ULL << shift) - 1;
+}
+
+// Освобождает шард при завершении потока
+struct ShardHandle {
+  ThreadShard *shard = nullptr;
+
+  ~ShardHandle() {
+    if (shard != nullptr) {
+      shard->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+thread_local ShardHandle localShard;
+
+ThreadShard &threadShard() {
+  if (localShard.shard == nullptr) {
+    localShard.shard = acquireShard();
+  }
+  return *localShard.shard;
+}
+
+void increment(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+std::string formatValue(uint64_t value, bool nanoseconds) {
+  if (!nanoseconds) {
+    return std::to_string(value);
+  }
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1);
+  if (value < 1000) {
+    oss << value << "ns";
+  } else if (value < 1000000) {
+    oss << value / 1e3 << "us";
+  } else if (value < 1000000000) {
+    oss << value / 1e6 << "ms";
+  } else {
+    oss << value / 1e9 << "s";
+  }
+  return oss.str();
+}
+
+}  // namespace
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return std::min(bucketUpperBound(i), max);
+    }
+  }
+  return max;
+}
+
+void recordMetric(Metric metric, uint64_t value) {
+  std::atomic<ShardHistogram *> &slot =
+      threadShard().histograms[static_cast<size_t>(metric)];
+  ShardHistogram *histogram = slot.load(std::memory_order_relaxed);
+  if (histogram == nullptr) {
+    histogram = new ShardHistogram;
+    slot.store(histogram, std::memory_order_release);
+  }
+  increment(histogram->buckets[bucketIndex(value)], 1);
+  increment(histogram->count, 1);
+  increment(histogram->sum, value);
+  if (value > histogram->max.load(std::memory_order_relaxed)) {
+    histogram->max.store(value, std::memory_order_relaxed);
+  }
+}
+
+void addCounter(Counter counter, uint64_t value) {
+  increment(threadShard().counters[static_cast<size_t>(counter)], value);
+}
+
+HistogramSnapshot metricSnapshot(Metric metric) {
+  size_t index = static_cast<size_t>(metric);
+  HistogramSnapshot snapshot;
+  for (ThreadShard *shard = shardList.load(std::memory_order_acquire);
+       shard != nullptr; shard = shard->next) {
+    ShardHistogram *histogram =
+        shard->histograms[index].load(std::memory_order_acquire);
+    if (histogram == nullptr) {
+      continue;
+    }
+    for (size_t i = 0; i < METRICS_BUCKETS; ++i) {
+      snapshot.buckets[i] +=
+          histogram->buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count += histogram->count.load(std::memory_order_relaxed);
+    snapshot.sum += histogram->sum.load(std::memory_order_relaxed);
+    snapshot.max =
+        std::max(snapshot.max, histogram->max.load(std::memory_order_relaxed));
+  }
+  return snapshot;
+}
+
+uint64_t counterValue(Counter counter) {
+  size_t index = static_cast<size_t>(counter);
+  uint64_t total = 0;
+  for (ThreadShard *shard = shardList.load(std::memory_order_acquire);
+       shard != nullptr; shard = shard->next) {
+    total += shard->counters[index].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+const char *metricName(Metric metric) {
+  return metricInfo[static_cast<size_t>(metric)].name;
+}
+
+std::string metricsReport() {
+  std::ostringstream oss;
+  oss << std::left << std::setw(22) << "metric" << std::right << std::setw(10)
+      << "count" << std::setw(10) << "p50" << std::setw(10) << "p90"
+      << std::setw(10) << "p99" << std::setw(10) << "max" << std::setw(10)
+      << "mean";
+  for (size_t i = 0; i < METRIC_COUNT; ++i) {
+    HistogramSnapshot snapshot = metricSnapshot(static_cast<Metric>(i));
+    if (snapshot.count == 0) {
+      continue;
+    }
+    bool nanoseconds = metricInfo[i].nanoseconds;
+    oss << "\n"
+        << std::left << std::setw(22) << metricInfo[i].name << std::right
+        << std::setw(10) << snapshot.count << std::setw(10)
+        << formatValue(snapshot.percentile(0.5), nanoseconds) << std::setw(10)
+        << formatValue(snapshot.percentile(0.9), nanoseconds) << std::setw(10)
+        << formatValue(snapshot.percentile(0.99), nanoseconds)
+        << std::setw(10) << formatValue(snapshot.max, nanoseconds)
+        << std::setw(10)
+        << formatValue(snapshot.sum / snapshot.count, nanoseconds);
+  }
+  return oss.str();
+}
+
+bool dumpMetrics(const std::string &path) {
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    std::time_t now = std::time(nullptr);
+    char timeBuffer[32];
+    std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S",
+                  std::localtime(&now));
+    file << "# " << timeBuffer << "\n" << metricsReport() << "\n";
+    if (!file.good()) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+  return !ec;
+}
+
+namespace {
+
+// Семейства Prometheus: метрики с префиксом prefix становятся сводкой name
+// с меткой label, равной остатку имени
+struct MetricFamily {
+  const char *prefix;
+  const char *name;
+  const char *label;
+  const char *help;
+};
+
+const MetricFamily metricFamilies[] = {
+    {"command_", "chat_command_duration_seconds", "command",
+     "Command handling time in commandProcessing."},
+    {"message_", "chat_message_duration_seconds", "type",
+     "Time from receiving a frame to flushing the replies."},
+    {"db_", "chat_db_duration_seconds", "op",
+     "DataBase file I/O time; append_history is the history commit."},
+    {"lock_wait_", "chat_lock_wait_seconds", "lock",
+     "Time spent waiting for a server mutex."},
+    {"queue_", "chat_queue_depth", "queue",
+     "Queue length seen by a new item."},
+};
+
+const char *dataTypeLabels[] = {"text", "number", "audio",
+                                "file", "voice",  "batch"};
+
+std::string formatSample(double value) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  std::ostringstream oss;
+  oss << std::setprecision(9) << value;
+  return oss.str();
+}
+
+void writeHeader(std::ostringstream &oss, const char *name, const char *type,
+                 const char *help) {
+  oss << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n";
+}
+
+}  // namespace
+
+std::string metricsExposition() {
+  std::ostringstream oss;
+
+  uint64_t accepted = counterValue(Counter::CONNECTIONS_ACCEPTED);
+  uint64_t closed = counterValue(Counter::CONNECTIONS_CLOSED);
+  writeHeader(oss, "chat_connections_accepted_total", "counter",
+              "Accepted client connections.");
+  oss << "chat_connections_accepted_total " << accepted << "\n";
+  writeHeader(oss, "chat_connections_active", "gauge",
+              "Client connections being served.");
+  oss << "chat_connections_active " << (accepted > closed ? accepted - closed : 0)
+      << "\n";
+
+  writeHeader(oss, "chat_connections_rejected_total", "counter",
+              "Connections refused at accept by the connection limit.");
+  oss << "chat_connections_rejected_total "
+      << counterValue(Counter::CONNECTIONS_REJECTED) << "\n";
+  writeHeader(oss, "chat_throttled_total", "counter",
+              "Frames over rate limits by message class; upload chunks are "
+              "delayed, the rest dropped.");
+  oss << "chat_throttled_total{class=\"command\"} "
+      << counterValue(Counter::THROTTLED_COMMAND) << "\n"
+      << "chat_throttled_total{class=\"voice\"} "
+      << counterValue(Counter::THROTTLED_VOICE) << "\n"
+      << "chat_throttled_total{class=\"upload\"} "
+      << counterValue(Counter::THROTTLED_UPLOAD) << "\n";
+  writeHeader(oss, "chat_outbound_dropped_total", "counter",
+              "Voice frames dropped because a receiver's queue was full.");
+  oss << "chat_outbound_dropped_total "
+      << counterValue(Counter::OUTBOUND_DROPPED) << "\n";
+  writeHeader(oss, "chat_cluster_forwarded_total", "counter",
+              "Channel commands sent to the node owning the channel.");
+  oss << "chat_cluster_forwarded_total{result=\"ok\"} "
+      << counterValue(Counter::CLUSTER_FORWARDED) << "\n"
+      << "chat_cluster_forwarded_total{result=\"failed\"} "
+      << counterValue(Counter::CLUSTER_FORWARD_FAILED) << "\n";
+  writeHeader(oss, "chat_cluster_relayed_total", "counter",
+              "Voice and notification frames posted to other nodes.");
+  oss << "chat_cluster_relayed_total "
+      << counterValue(Counter::CLUSTER_RELAYED) << "\n";
+
+  writeHeader(oss, "chat_bytes_total", "counter",
+              "Frame bytes on the wire by direction and DataType.");
+  for (size_t type = 0; type < 6; ++type) {
+    oss << "chat_bytes_total{direction=\"in\",type=\"" << dataTypeLabels[type]
+        << "\"} "
+        << counterValue(static_cast<Counter>(
+               static_cast<size_t>(Counter::BYTES_IN_TEXT) + type))
+        << "\n";
+  }
+  for (size_t type = 0; type < 6; ++type) {
+    oss << "chat_bytes_total{direction=\"out\",type=\"" << dataTypeLabels[type]
+        << "\"} "
+        << counterValue(static_cast<Counter>(
+               static_cast<size_t>(Counter::BYTES_OUT_TEXT) + type))
+        << "\n";
+  }
+
+  uint64_t started = counterValue(Counter::VOICE_STREAMS_STARTED);
+  uint64_t ended = counterValue(Counter::VOICE_STREAMS_ENDED);
+  writeHeader(oss, "chat_voice_streams_active", "gauge",
+              "Clients with an open voice buffer.");
+  oss << "chat_voice_streams_active " << (started > ended ? started - ended : 0)
+      << "\n";
+  writeHeader(oss, "chat_mixer_ticks_total", "counter",
+              "Voice frames decoded, mixed and broadcast.");
+  oss << "chat_mixer_ticks_total " << counterValue(Counter::MIXER_TICKS)
+      << "\n";
+  writeHeader(oss, "chat_mixer_overruns_total", "counter",
+              "Voice frames that took longer than the frame duration.");
+  oss << "chat_mixer_overruns_total " << counterValue(Counter::MIXER_OVERRUNS)
+      << "\n";
+
+  for (const MetricFamily &family : metricFamilies) {
+    writeHeader(oss, family.name, "summary", family.help);
+    size_t prefixLength = std::strlen(family.prefix);
+    for (size_t i = 0; i < METRIC_COUNT; ++i) {
+      if (std::strncmp(metricInfo[i].name, family.prefix, prefixLength) != 0) {
+        continue;
+      }
+      HistogramSnapshot snapshot = metricSnapshot(static_cast<Metric>(i));
+      double scale = metricInfo[i].nanoseconds ? 1e-9 : 1.0;
+      std::string label = std::string(family.label) + "=\"" +
+                          (metricInfo[i].name + prefixLength) + "\"";
+      for (double q : {0.5, 0.9, 0.99}) {
+        oss << family.name << "{" << label << ",quantile=\"" << q << "\"} "
+            << formatSample(snapshot.count == 0
+                                ? NAN
+                                : snapshot.percentile(q) * scale)
+            << "\n";
+      }
+      oss << family.name << "_sum{" << label << "} "
+          << formatSample(snapshot.sum * scale) << "\n"
+          << family.name << "_count{" << label << "} " << snapshot.count
+          << "\n";
+    }
+  }
+  return oss.str();
+}
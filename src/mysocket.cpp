@@ -1,5 +1,9 @@
 #include "../include/mysocket.hpp"
 
+#include <algorithm>
+
+#include "../include/compression.hpp"
+
 bool MySocket::createSocket() {
   if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
     std::cerr << "Socket creation error" << std::endl;
@@ -65,14 +69,17 @@ int MySocket::acceptSocket() {
 }
 
 void Message::serialize(std::vector<uint8_t>& buffer) const {
-  // Размер заголовка: type (1 байт) + size (4 байта) + flag (4 байта)
-  size_t headerSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
+  bool extended = header.requestId != 0;
+  size_t headerSize =
+      MESSAGE_HEADER_SIZE + (extended ? MESSAGE_REQUEST_ID_SIZE : 0);
 
   buffer.resize(headerSize + body.size());
   uint8_t* ptr = buffer.data();
 
-  // Сериализуем поле type
-  *ptr = static_cast<uint8_t>(header.type);
+  // Сериализуем поле type (старшие биты - requestId и сжатие)
+  *ptr = static_cast<uint8_t>(header.type) |
+         (extended ? MESSAGE_EXTENDED_HEADER : 0) |
+         (header.compressed ? MESSAGE_COMPRESSED : 0);
   ptr += sizeof(uint8_t);
 
   // Сериализуем поле size (в сетевом порядке байтов)
@@ -85,6 +92,12 @@ void Message::serialize(std::vector<uint8_t>& buffer) const {
   std::memcpy(ptr, &netFlag, sizeof(uint32_t));
   ptr += sizeof(uint32_t);
 
+  if (extended) {
+    uint32_t netRequestId = htonl(header.requestId);
+    std::memcpy(ptr, &netRequestId, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+  }
+
   // Сериализуем тело сообщения
   if (!body.empty()) {
     std::memcpy(ptr, body.data(), body.size());
@@ -95,7 +108,10 @@ void Message::deserialize(const std::vector<uint8_t>& buffer) {
   const uint8_t* ptr = buffer.data();
 
   // Десериализуем поле type
-  header.type = static_cast<DataType>(*ptr);
+  bool extended = (*ptr & MESSAGE_EXTENDED_HEADER) != 0;
+  header.compressed = (*ptr & MESSAGE_COMPRESSED) != 0;
+  header.type = static_cast<DataType>(
+      *ptr & ~(MESSAGE_EXTENDED_HEADER | MESSAGE_COMPRESSED));
   ptr += sizeof(uint8_t);
 
   // Десериализуем поле size
@@ -110,6 +126,15 @@ void Message::deserialize(const std::vector<uint8_t>& buffer) {
   header.flag = ntohl(netFlag);
   ptr += sizeof(uint32_t);
 
+  header.requestId = 0;
+  if (extended &&
+      buffer.size() >= MESSAGE_HEADER_SIZE + MESSAGE_REQUEST_ID_SIZE) {
+    uint32_t netRequestId;
+    std::memcpy(&netRequestId, ptr, sizeof(uint32_t));
+    header.requestId = ntohl(netRequestId);
+    ptr += sizeof(uint32_t);
+  }
+
   // Десериализуем тело сообщения
   size_t bodySize = buffer.size() - (ptr - buffer.data());
   if (bodySize > 0) {
@@ -119,11 +144,69 @@ void Message::deserialize(const std::vector<uint8_t>& buffer) {
   }
 }
 
+MySocket::TrafficCounter MySocket::trafficCounter = nullptr;
+
 bool MySocket::sendMessage(const Message& message) {
   std::lock_guard<std::mutex> lock(send_mutex);
   std::vector<uint8_t> buffer;
+  encodeMessage(message, buffer);
+  countTraffic(true, message.header.type, buffer.size());
+
+  if (batching) {
+    if (outBatchCount >= BATCH_MAX_MESSAGES ||
+        outBatch.size() + buffer.size() > BATCH_MAX_SIZE) {
+      if (!flushBatchLocked()) {
+        return false;
+      }
+    }
+    outBatch.insert(outBatch.end(), buffer.begin(), buffer.end());
+    ++outBatchCount;
+    return true;
+  }
+  return sendBuffer(buffer);
+}
+
+bool MySocket::sendMessageNow(const Message& message) {
+  std::lock_guard<std::mutex> lock(send_mutex);
+  std::vector<uint8_t> buffer;
+  encodeMessage(message, buffer);
+  countTraffic(true, message.header.type, buffer.size());
+  return sendBuffer(buffer);
+}
+
+void MySocket::encodeMessage(const Message& message,
+                             std::vector<uint8_t>& buffer) {
+  if (compressionEnabled && !message.header.compressed &&
+      message.body.size() >= COMPRESSION_MIN_SIZE &&
+      (message.header.type == DataType::TEXT ||
+       message.header.type == DataType::FILE_TYPE)) {
+    Message compressed;
+    compressed.header = message.header;
+    if (compressBody(message.body, compressed.body)) {
+      compressed.header.compressed = true;
+      compressed.header.size = static_cast<uint32_t>(compressed.body.size());
+      compressed.serialize(buffer);
+      return;
+    }
+  }
   message.serialize(buffer);
+}
+
+bool MySocket::inflateMessage(Message& message) {
+  if (!message.header.compressed) {
+    return true;
+  }
+  std::vector<uint8_t> body;
+  if (!decompressBody(message.body, body)) {
+    return false;
+  }
+  message.body.swap(body);
+  message.header.size = static_cast<uint32_t>(message.body.size());
+  message.header.compressed = false;
+  return true;
+}
 
+bool MySocket::sendBuffer(const std::vector<uint8_t>& buffer) {
   size_t totalSent = 0;
   while (totalSent < buffer.size()) {
     ssize_t sent =
@@ -141,6 +224,65 @@ bool MySocket::sendMessage(const Message& message) {
   return true;
 }
 
+void MySocket::beginBatch() {
+  std::lock_guard<std::mutex> lock(send_mutex);
+  batching = true;
+}
+
+bool MySocket::flushBatch() {
+  std::lock_guard<std::mutex> lock(send_mutex);
+  batching = false;
+  return flushBatchLocked();
+}
+
+bool MySocket::flushBatchLocked() {
+  if (outBatchCount == 0) {
+    return true;
+  }
+  bool sent;
+  if (outBatchCount == 1 || !peerSupportsBatch) {
+    // Один кадр или старый собеседник - отправляем кадры как есть
+    sent = sendBuffer(outBatch);
+  } else {
+    Message batch;
+    batch.header.type = DataType::BATCH;
+    batch.header.size = static_cast<uint32_t>(outBatch.size());
+    batch.header.flag = static_cast<uint32_t>(outBatchCount);
+    batch.body.swap(outBatch);
+    std::vector<uint8_t> buffer;
+    batch.serialize(buffer);
+    // Вложенные кадры уже учтены в sendMessage
+    countTraffic(true, DataType::BATCH, buffer.size() - batch.body.size());
+    sent = sendBuffer(buffer);
+  }
+  outBatch.clear();
+  outBatchCount = 0;
+  return sent;
+}
+
+bool MySocket::hasBufferedInput() {
+  if (!inBatch.empty()) {
+    return true;
+  }
+  int available = 0;
+  if (ioctl(sock, FIONREAD, &available) != 0 ||
+      available < MESSAGE_HEADER_SIZE) {
+    return false;
+  }
+  uint8_t header[MESSAGE_HEADER_SIZE];
+  if (recv(sock, header, sizeof(header), MSG_PEEK | MSG_DONTWAIT) !=
+      static_cast<ssize_t>(sizeof(header))) {
+    return false;
+  }
+  uint32_t netSize;
+  std::memcpy(&netSize, header + sizeof(uint8_t), sizeof(uint32_t));
+  size_t frameSize = MESSAGE_HEADER_SIZE + ntohl(netSize);
+  if (header[0] & MESSAGE_EXTENDED_HEADER) {
+    frameSize += MESSAGE_REQUEST_ID_SIZE;
+  }
+  return static_cast<size_t>(available) >= frameSize;
+}
+
 bool MySocket::sendMessage(const Message& message, int socket) {
   std::lock_guard<std::mutex> lock(send_mutex);
   std::vector<uint8_t> buffer;
@@ -148,6 +290,7 @@ bool MySocket::sendMessage(const Message& message, int socket) {
   if (send(socket, buffer.data(), buffer.size(), 0) < 0) {
     return false;
   }
+  countTraffic(true, message.header.type, buffer.size());
   return true;
 }
 
@@ -214,11 +357,62 @@ bool MySocket::sendFile(const std::string& filePath, int socket) {
 }
 
 bool MySocket::receiveMessage(Message& message) {
+  while (inBatch.empty()) {
+    if (!readFrame(message)) {
+      return false;
+    }
+    if (message.header.type != DataType::BATCH) {
+      return true;
+    }
+    // Собеседник понимает BATCH - можно отвечать так же
+    peerSupportsBatch = true;
+    if (!unpackBatch(message)) {
+      std::cerr << "Malformed batch frame" << std::endl;
+      return false;
+    }
+  }
+  message = std::move(inBatch.front());
+  inBatch.pop_front();
+  return true;
+}
+
+bool MySocket::unpackBatch(const Message& batch) {
+  const uint8_t* ptr = batch.body.data();
+  const uint8_t* end = ptr + batch.body.size();
+  while (ptr != end) {
+    if (inBatch.size() >= BATCH_MAX_MESSAGES ||
+        static_cast<size_t>(end - ptr) < MESSAGE_HEADER_SIZE) {
+      return false;
+    }
+    size_t headerSize = MESSAGE_HEADER_SIZE;
+    if (*ptr & MESSAGE_EXTENDED_HEADER) {
+      headerSize += MESSAGE_REQUEST_ID_SIZE;
+    }
+    uint32_t netSize;
+    std::memcpy(&netSize, ptr + sizeof(uint8_t), sizeof(uint32_t));
+    size_t frameSize = headerSize + ntohl(netSize);
+    if (static_cast<size_t>(end - ptr) < frameSize) {
+      return false;
+    }
+
+    Message message;
+    message.deserialize(std::vector<uint8_t>(ptr, ptr + frameSize));
+    if (message.header.type == DataType::BATCH || !inflateMessage(message)) {
+      return false;
+    }
+    countTraffic(false, message.header.type, frameSize);
+    inBatch.push_back(std::move(message));
+    ptr += frameSize;
+  }
+  return true;
+}
+
+bool MySocket::readFrame(Message& message) {
   message.clearMessage(message);
 
-  // Размер заголовка
-  size_t headerSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
-  std::vector<uint8_t> headerBuffer(headerSize);
+  // Размер заголовка; для версии 2 дочитываем requestId
+  size_t headerSize = MESSAGE_HEADER_SIZE;
+  std::vector<uint8_t> headerBuffer(headerSize + MESSAGE_REQUEST_ID_SIZE);
 
   size_t totalBytesRead = 0;
   while (totalBytesRead < headerSize) {
@@ -230,14 +424,18 @@ bool MySocket::receiveMessage(Message& message) {
     }
 
     totalBytesRead += bytesRead;
+    if (totalBytesRead == MESSAGE_HEADER_SIZE &&
+        (headerBuffer[0] & MESSAGE_EXTENDED_HEADER)) {
+      headerSize += MESSAGE_REQUEST_ID_SIZE;
+    }
   }
+  headerBuffer.resize(headerSize);
 
   // Десериализуем заголовок
   message.deserialize(headerBuffer);
 
   // Проверка допустимого размера тела сообщения
-  const uint32_t MAX_MESSAGE_SIZE = 10 * 1024 * 1024;  // 10 МБ
-  if (message.header.size > MAX_MESSAGE_SIZE) {
+  if (message.header.size > MESSAGE_MAX_SIZE) {
     std::cerr << "Message size exceeds maximum allowed size" << std::endl;
     return false;
   }
@@ -257,6 +455,15 @@ bool MySocket::receiveMessage(Message& message) {
   // std::cout << "Successfully received " << totalBytesRead << " bytes to
   // socket "
   //           << sock << std::endl;
+  // У BATCH здесь учитывается только заголовок, кадры - в unpackBatch
+  countTraffic(false, message.header.type,
+               message.header.type == DataType::BATCH
+                   ? headerSize
+                   : headerSize + message.header.size);
+  if (!inflateMessage(message)) {
+    std::cerr << "Error decompressing body" << std::endl;
+    return false;
+  }
   return true;
 }
 
@@ -514,7 +721,11 @@ bool Message::setAudioMessage(const std::string& filePath) {
 
   // Получаем имя файла
   std::string fileName = filePath.substr(filePath.find_last_of("/\\") + 1);
+  return setAudioMessage(fileName, audioData);
+}
 
+bool Message::setAudioMessage(const std::string& fileName,
+                              const std::vector<uint8_t>& audioData) {
   // Подготавливаем тело сообщения
   body.clear();
 
@@ -563,16 +774,131 @@ bool saveFile(const std::string& directory, const std::string& fileName,
   return true;
 }
 
+static uint16_t readLittle16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
+
+static uint32_t readLittle32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+         static_cast<uint32_t>(data[2]) << 16 |
+         static_cast<uint32_t>(data[3]) << 24;
+}
+
+/**
+ * Проходит чанки RIFF до чанка data, не читая сами сэмплы. Чанки выровнены
+ * по двум байтам; неизвестные (LIST, fact и т.п.) пропускаются.
+ */
+bool parseWavHeader(const uint8_t* data, size_t size, uint64_t totalSize,
+                    WavInfo& info, std::string& error) {
+  if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 ||
+      std::memcmp(data + 8, "WAVE", 4) != 0) {
+    error = "not a RIFF/WAVE file";
+    return false;
+  }
+
+  bool haveFormat = false;
+  uint64_t offset = 12;
+  while (offset + 8 <= size) {
+    const uint8_t* chunk = data + offset;
+    uint32_t chunkSize = readLittle32(chunk + 4);
+    offset += 8;
+
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      if (chunkSize < 16 || offset + 16 > size) {
+        error = "truncated fmt chunk";
+        return false;
+      }
+      info.format = readLittle16(chunk + 8);
+      info.channels = readLittle16(chunk + 10);
+      info.sampleRate = readLittle32(chunk + 12);
+      info.blockAlign = readLittle16(chunk + 20);
+      info.bitsPerSample = readLittle16(chunk + 22);
+      // Только целочисленный PCM: float (3) и extensible (0xFFFE) не принимаются
+      if (info.format != 1) {
+        error = "unsupported encoding " + std::to_string(info.format);
+        return false;
+      }
+      if (info.channels == 0 || info.sampleRate == 0 ||
+          info.bitsPerSample == 0 || info.bitsPerSample % 8 != 0 ||
+          info.blockAlign != info.channels * info.bitsPerSample / 8) {
+        error = "inconsistent fmt chunk";
+        return false;
+      }
+      haveFormat = true;
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        error = "data chunk before fmt chunk";
+        return false;
+      }
+      if (chunkSize > totalSize - offset) {
+        error = "data chunk exceeds file size";
+        return false;
+      }
+      info.dataOffset = offset;
+      info.dataSize = chunkSize;
+      return true;
+    }
+    offset += chunkSize + (chunkSize & 1);
+  }
+  error = "no data chunk";
+  return false;
+}
+
+bool probeWavFile(const std::string& filePath, WavInfo& info,
+                  std::string& error) {
+  std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    error = "cannot open file";
+    return false;
+  }
+  uint64_t totalSize = static_cast<uint64_t>(file.tellg());
+  std::vector<uint8_t> header(std::min<uint64_t>(totalSize, WAV_PROBE_SIZE));
+  file.seekg(0, std::ios::beg);
+  if (!file.read(reinterpret_cast<char*>(header.data()), header.size())) {
+    error = "cannot read file";
+    return false;
+  }
+  return parseWavHeader(header.data(), header.size(), totalSize, info, error);
+}
+
 double getAudioDuration(const std::string& filePath) {
-  SF_INFO sfInfo;
-  SNDFILE* sndFile = sf_open(filePath.c_str(), SFM_READ, &sfInfo);
-  if (!sndFile) {
+  WavInfo info;
+  std::string error;
+  if (!probeWavFile(filePath, info, error)) {
     return 0.0;
   }
+  return info.duration();
+}
+
+void Message::setUploadChunk(uint64_t uploadId, uint64_t offset,
+                             const uint8_t* data, size_t size) {
+  header.type = DataType::FILE_TYPE;
+  header.flag = Flags::UPLOAD_CHUNK;
+  body.resize(UPLOAD_CHUNK_HEADER_SIZE + size);
+
+  uint64_t netUploadId = htobe64(uploadId);
+  uint64_t netOffset = htobe64(offset);
+  std::memcpy(body.data(), &netUploadId, sizeof(uint64_t));
+  std::memcpy(body.data() + sizeof(uint64_t), &netOffset, sizeof(uint64_t));
+  if (size > 0) {
+    std::memcpy(body.data() + UPLOAD_CHUNK_HEADER_SIZE, data, size);
+  }
+  header.size = static_cast<uint32_t>(body.size());
+}
 
-  double duration = static_cast<double>(sfInfo.frames) / sfInfo.samplerate;
-  sf_close(sndFile);
-  return duration;
+bool Message::getUploadChunk(uint64_t& uploadId, uint64_t& offset,
+                             const uint8_t*& data, size_t& size) const {
+  if (body.size() < UPLOAD_CHUNK_HEADER_SIZE) {
+    return false;
+  }
+  uint64_t netUploadId, netOffset;
+  std::memcpy(&netUploadId, body.data(), sizeof(uint64_t));
+  std::memcpy(&netOffset, body.data() + sizeof(uint64_t), sizeof(uint64_t));
+  uploadId = be64toh(netUploadId);
+  offset = be64toh(netOffset);
+  data = body.data() + UPLOAD_CHUNK_HEADER_SIZE;
+  size = body.size() - UPLOAD_CHUNK_HEADER_SIZE;
+  return true;
 }
 
 bool Message::setFileMessage(const FilePacket& packet,
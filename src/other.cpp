@@ -1,6 +1,6 @@
 #include "../include/other.hpp"
 
-std::mutex dbMutex;
+MeteredMutex dbMutex(Metric::LOCK_DB);
 std::mutex logMutex;
 
 void logMessage(const std::string &message, const std::string &filename) {
@@ -0,0 +1,160 @@
+#include "../include/presence.hpp"
+
+#include <sys/socket.h>
+
+#include <algorithm>
+
+#include "../include/other.hpp"
+
+Connection::Connection(MySocket &socket) : socket(socket) {
+  writer = std::thread(&Connection::run, this);
+}
+
+Connection::~Connection() { close(); }
+
+bool Connection::post(const Message &message) {
+  bool overflow = false;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (closing) {
+      return false;
+    }
+    recordMetric(Metric::QUEUE_OUTBOUND, queue.size());
+    if (queue.size() >= OUTBOUND_QUEUE_CAPACITY &&
+        message.header.type == DataType::VOICE) {
+      addCounter(Counter::OUTBOUND_DROPPED);
+      return false;
+    }
+    if (queue.size() < OUTBOUND_QUEUE_HARD_CAPACITY) {
+      queue.push_back(message);
+    } else {
+      // Получатель не читает: кадр нельзя потерять молча, поэтому
+      // соединение закрывается, а клиент переподключится
+      closing = true;
+      overflow = true;
+      queue.clear();
+    }
+  }
+  queueCondition.notify_one();
+  if (overflow) {
+    // Будит поток очереди в send и поток владельца в receive; поток
+    // очереди присоединяет close() при завершении сессии
+    shutdown(socket.getSocket(), SHUT_RDWR);
+    logMessage("Outbound queue overflow, connection closed", SERVER_LOG_FILE);
+    return false;
+  }
+  return true;
+}
+
+void Connection::close() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    closing = true;
+  }
+  queueCondition.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+}
+
+void Connection::run() {
+  while (true) {
+    Message message;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] { return closing || !queue.empty(); });
+      if (queue.empty()) {
+        break;
+      }
+      message = std::move(queue.front());
+      queue.pop_front();
+    }
+    // Пакет сокета открывает и отправляет поток владельца
+    socket.sendMessageNow(message);
+  }
+}
+
+void PresenceRegistry::add(LocalId user,
+                           const std::shared_ptr<Connection> &connection) {
+  std::lock_guard<MeteredMutex> lock(mutex);
+  std::vector<std::shared_ptr<Connection>> &list = connections[user];
+  if (list.empty()) {
+    onlineUsers.fetch_add(1, std::memory_order_relaxed);
+  }
+  list.push_back(connection);
+}
+
+void PresenceRegistry::remove(LocalId user,
+                              const std::shared_ptr<Connection> &connection) {
+  std::lock_guard<MeteredMutex> lock(mutex);
+  auto it = connections.find(user);
+  if (it == connections.end()) {
+    return;
+  }
+  std::vector<std::shared_ptr<Connection>> &list = it->second;
+  list.erase(std::remove(list.begin(), list.end(), connection), list.end());
+  if (list.empty()) {
+    connections.erase(it);
+    onlineUsers.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+size_t PresenceRegistry::send(LocalId user, const Message &message) {
+  std::lock_guard<MeteredMutex> lock(mutex);
+  auto it = connections.find(user);
+  if (it == connections.end()) {
+    return 0;
+  }
+  size_t delivered = 0;
+  for (const std::shared_ptr<Connection> &connection : it->second) {
+    delivered += connection->post(message);
+  }
+  return delivered;
+}
+
+size_t PresenceRegistry::sendToMany(const std::unordered_set<LocalId> &users,
+                                    const Message &message, LocalId except) {
+  std::lock_guard<MeteredMutex> lock(mutex);
+  size_t delivered = 0;
+  for (LocalId user : users) {
+    if (user == except) {
+      continue;
+    }
+    auto it = connections.find(user);
+    if (it == connections.end()) {
+      continue;
+    }
+    for (const std::shared_ptr<Connection> &connection : it->second) {
+      delivered += connection->post(message);
+    }
+  }
+  return delivered;
+}
+
+PresenceSession::PresenceSession(PresenceRegistry &registry, MySocket &socket)
+    : registry(registry), socket(socket) {}
+
+PresenceSession::~PresenceSession() {
+  if (user != INVALID_LOCAL_ID) {
+    registry.remove(user, connection);
+  }
+  if (connection) {
+    connection->close();
+  }
+}
+
+void PresenceSession::login(LocalId newUser) {
+  if (newUser == user) {
+    return;
+  }
+  if (user != INVALID_LOCAL_ID) {
+    registry.remove(user, connection);
+  }
+  user = newUser;
+  if (user != INVALID_LOCAL_ID) {
+    if (!connection) {
+      connection = std::make_shared<Connection>(socket);
+    }
+    registry.add(user, connection);
+  }
+}
@@ -0,0 +1,120 @@
+#include "../include/rate_limiter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct ClassLimit {
+  double rate;
+  double burst;
+};
+
+const ClassLimit classLimits[] = {
+    {RATE_COMMANDS_PER_SEC, RATE_COMMANDS_BURST},
+    {RATE_VOICE_PER_SEC, RATE_VOICE_BURST},
+    {RATE_UPLOAD_BYTES_PER_SEC, RATE_UPLOAD_BURST},
+};
+
+std::vector<TokenBucket> makeBuckets(double factor) {
+  std::vector<TokenBucket> buckets;
+  for (const ClassLimit &limit : classLimits) {
+    buckets.emplace_back(limit.rate * factor, limit.burst * factor);
+  }
+  return buckets;
+}
+
+}  // namespace
+
+TrafficClass classifyMessage(const Message &message) {
+  if (message.header.type == DataType::VOICE) {
+    return TrafficClass::VOICE;
+  }
+  if (message.header.type == DataType::AUDIO ||
+      message.header.type == DataType::FILE_TYPE ||
+      message.header.flag == Flags::UPLOAD_BEGIN ||
+      message.header.flag == Flags::UPLOAD_END) {
+    return TrafficClass::UPLOAD;
+  }
+  return TrafficClass::COMMAND;
+}
+
+bool isBackpressured(const Message &message) {
+  return message.header.type == DataType::FILE_TYPE &&
+         message.header.flag == Flags::UPLOAD_CHUNK;
+}
+
+double messageCost(TrafficClass trafficClass, const Message &message) {
+  if (trafficClass == TrafficClass::UPLOAD) {
+    return std::max<double>(1, message.body.size());
+  }
+  return 1;
+}
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate(rate),
+      burst(burst),
+      tokens(burst),
+      updated(std::chrono::steady_clock::now()) {}
+
+bool TokenBucket::take(double cost, std::chrono::steady_clock::time_point now,
+                       uint32_t &retryMs) {
+  double elapsed = std::chrono::duration<double>(now - updated).count();
+  if (elapsed > 0) {
+    tokens = std::min(burst, tokens + elapsed * rate);
+    updated = now;
+  }
+  // Кадр больше ведра проходит, когда оно полное: иначе он не пройдёт никогда
+  cost = std::min(cost, burst);
+  if (tokens >= cost) {
+    tokens -= cost;
+    return true;
+  }
+  retryMs = static_cast<uint32_t>(std::ceil((cost - tokens) / rate * 1000));
+  return false;
+}
+
+void TokenBucket::give(double cost) {
+  tokens = std::min(burst, tokens + std::min(cost, burst));
+}
+
+bool UserRateLimits::take(LocalId user, TrafficClass trafficClass, double cost,
+                          std::chrono::steady_clock::time_point now,
+                          uint32_t &retryMs) {
+  Shard &shard = shards[user % RATE_USER_SHARDS];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.buckets.find(user);
+  if (it == shard.buckets.end()) {
+    it = shard.buckets.emplace(user, makeBuckets(RATE_USER_FACTOR)).first;
+  }
+  return it->second[static_cast<size_t>(trafficClass)].take(cost, now,
+                                                            retryMs);
+}
+
+ConnectionRateLimits::ConnectionRateLimits()
+    : buckets(makeBuckets(1)),
+      throttled(static_cast<size_t>(TrafficClass::COUNT), false) {}
+
+bool ConnectionRateLimits::admit(TrafficClass trafficClass, double cost,
+                                 LocalId user, UserRateLimits &users,
+                                 uint32_t &retryMs) {
+  size_t index = static_cast<size_t>(trafficClass);
+  auto now = std::chrono::steady_clock::now();
+  bool admitted = buckets[index].take(cost, now, retryMs);
+  if (admitted && user != INVALID_LOCAL_ID &&
+      !users.take(user, trafficClass, cost, now, retryMs)) {
+    buckets[index].give(cost);
+    admitted = false;
+  }
+  if (admitted) {
+    throttled[index] = false;
+  }
+  return admitted;
+}
+
+bool ConnectionRateLimits::shouldNotify(TrafficClass trafficClass) {
+  size_t index = static_cast<size_t>(trafficClass);
+  bool first = !throttled[index];
+  throttled[index] = true;
+  return first;
+}
@@ -0,0 +1,127 @@
+#include "../include/search_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+std::vector<std::string> tokenizeText(const std::string &text) {
+  std::vector<std::string> tokens;
+  std::string token;
+  for (unsigned char c : text) {
+    // Байты >= 0x80 - части многобайтовых символов UTF-8 (кириллица)
+    if (std::isalnum(c) || c >= 0x80 || c == '_') {
+      token += static_cast<char>(std::tolower(c));
+    } else if (!token.empty()) {
+      tokens.push_back(token);
+      token.clear();
+    }
+  }
+  if (!token.empty()) {
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+void SearchIndex::indexDocument(ChannelIndex &index,
+                                const SearchDocument &document) {
+  uint32_t documentNumber = static_cast<uint32_t>(index.documents.size());
+  index.documents.push_back(document);
+
+  std::vector<std::string> tokens = tokenizeText(document.text);
+  tokens.push_back("@" + std::to_string(document.userId));
+  for (const std::string &token : tokens) {
+    std::vector<uint32_t> &list = index.postings[token];
+    // Номера добавляются по возрастанию, повтор слова в сообщении пропускаем
+    if (list.empty() || list.back() != documentNumber) {
+      list.push_back(documentNumber);
+    }
+  }
+}
+
+bool SearchIndex::isLoaded(const std::string &channel) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  return channels.find(channel) != channels.end();
+}
+
+bool SearchIndex::loadChannel(const std::string &channel,
+                              const std::string &indexPath,
+                              UserRegistry &registry) {
+  std::ifstream indexFile(indexPath);
+  if (!indexFile.is_open()) {
+    return false;
+  }
+
+  ChannelIndex index;
+  std::string line;
+  while (std::getline(indexFile, line)) {
+    std::istringstream iss(line);
+    SearchDocument document;
+    std::string id;
+    if (std::getline(iss, document.time, '\t') &&
+        std::getline(iss, id, '\t') && std::getline(iss, document.text)) {
+      document.userId = registry.parseStored(id);
+      indexDocument(index, document);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  channels[channel] = std::move(index);
+  return true;
+}
+
+void SearchIndex::addMessage(const std::string &channel,
+                             const std::string &indexPath,
+                             const SearchDocument &document) {
+  {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    indexDocument(channels[channel], document);
+  }
+  std::ofstream indexFile(indexPath, std::ios_base::app);
+  indexFile << document.time << '\t' << document.userId << '\t' << document.text
+            << std::endl;
+}
+
+std::vector<SearchDocument> SearchIndex::search(
+    const std::string &channel, const std::vector<std::string> &terms,
+    size_t limit) {
+  std::vector<SearchDocument> result;
+  std::lock_guard<std::mutex> lock(indexMutex);
+  auto channelIt = channels.find(channel);
+  if (channelIt == channels.end() || terms.empty()) {
+    return result;
+  }
+  ChannelIndex &index = channelIt->second;
+
+  std::vector<const std::vector<uint32_t> *> lists;
+  for (const std::string &term : terms) {
+    auto it = index.postings.find(term);
+    if (it == index.postings.end()) {
+      return result;
+    }
+    lists.push_back(&it->second);
+  }
+  // Перебираем самый короткий список с конца, остальные проверяем бинпоиском
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+              return a->size() < b->size();
+            });
+
+  const std::vector<uint32_t> &shortest = *lists.front();
+  for (auto it = shortest.rbegin();
+       it != shortest.rend() && result.size() < limit; ++it) {
+    bool inAll = true;
+    for (size_t i = 1; i < lists.size() && inAll; ++i) {
+      inAll = std::binary_search(lists[i]->begin(), lists[i]->end(), *it);
+    }
+    if (inAll) {
+      result.push_back(index.documents[*it]);
+    }
+  }
+  return result;
+}
+
+void SearchIndex::dropChannel(const std::string &channel) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  channels.erase(channel);
+}
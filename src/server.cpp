@@ -9,56 +9,10 @@ uint32_t generateUniqueID() {
   return audioMessageCounter.fetch_add(1, std::memory_order_relaxed);
 }
 
-std::string Server::hashPassword(const std::string &password,
-                                 const std::string &salt) {
-  std::string saltedPassword = password + salt;
-  unsigned char hash[EVP_MAX_MD_SIZE];
-  unsigned int hashLength = 0;
-
-  EVP_MD_CTX *context = EVP_MD_CTX_new();
-  if (context == nullptr) {
-    throw std::runtime_error("Failed to create EVP_MD_CTX");
-  }
-
-  const EVP_MD *md = EVP_sha256();
-
-  if (!EVP_DigestInit_ex(context, md, nullptr)) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("EVP_DigestInit_ex failed");
-  }
-
-  if (!EVP_DigestUpdate(context, saltedPassword.c_str(),
-                        saltedPassword.size())) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("EVP_DigestUpdate failed");
-  }
-
-  if (!EVP_DigestFinal_ex(context, hash, &hashLength)) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("EVP_DigestFinal_ex failed");
-  }
-
-  EVP_MD_CTX_free(context);
-
-  // Конвертация байтового массива хеша в строку hex
-  std::stringstream ss;
-  for (unsigned int i = 0; i < hashLength; ++i) {
-    ss << std::hex << std::setw(2) << std::setfill('0')
-       << static_cast<int>(hash[i]);
-  }
-
-  return ss.str();
-}
-
-bool Server::loginInSet(std::string login,
-                        std::unordered_set<std::string> set) {
-  return set.find(login) != set.end();
-}
-
 void Server::registrationOnServer(MySocket &client, std::string nickname,
                                   std::string login, std::string password) try {
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.addUser(nickname, client.getSocket(), login, password);
     logMessage("Add user: " + nickname, SERVER_LOG_FILE);
   }
@@ -68,6 +22,37 @@ void Server::registrationOnServer(MySocket &client, std::string nickname,
   std::cerr << "Error during registration: " << e.what() << std::endl;
 }
 
+// Метрика задержки команды. Новая команда без своей метрики попадает в
+// COMMAND_UNKNOWN, а не в чужую гистограмму; switch без default, чтобы
+// -Wswitch указал, какой не хватает
+static Metric commandMetric(CommandId id) {
+  switch (id) {
+    case CommandId::READ:
+      return Metric::COMMAND_READ;
+    case CommandId::SEND:
+      return Metric::COMMAND_SEND;
+    case CommandId::JOIN:
+      return Metric::COMMAND_JOIN;
+    case CommandId::SEARCH:
+      return Metric::COMMAND_SEARCH;
+    case CommandId::EXIT:
+      return Metric::COMMAND_EXIT;
+    case CommandId::NICK:
+      return Metric::COMMAND_NICK;
+    case CommandId::CONNECT:
+      return Metric::COMMAND_CONNECT;
+    case CommandId::CHANNELS:
+      return Metric::COMMAND_CHANNELS;
+    case CommandId::TIME_ON:
+      return Metric::COMMAND_TIME_ON;
+    case CommandId::TIME_OFF:
+      return Metric::COMMAND_TIME_OFF;
+    case CommandId::VOICEMAIL_ON:
+      return Metric::COMMAND_VOICEMAIL_ON;
+  }
+  return Metric::COMMAND_UNKNOWN;
+}
+
 /**
  * Processes a command received from a client.
  *
@@ -79,99 +64,100 @@ void Server::registrationOnServer(MySocket &client, std::string nickname,
  * @throws None.
  */
 void Server::commandProcessing(MySocket &client, User &user, Message &message) {
+  ScopedLatency latency(Metric::COMMAND_UNKNOWN);
   std::string command = messageToString(message);
   // std::cout << "Received: " << command << std::endl;
   message = flagOff(message);
   std::string answer;
-  std::istringstream iss(command);
-  std::vector<std::string> words{std::istream_iterator<std::string>{iss},
-                                 std::istream_iterator<std::string>{}};
-  if (words[0] == "/read") {
-    ReadCommand read;
-    answer = read.handleCommand(words, db, user);
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Read command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/send") {
-    SendCommand send;
-    answer = send.handleCommand(words, db, user);
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Send command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/join") {
-    JoinCommand join;
-    answer = join.handleCommand(words, db, user);
-    if (answer == "Channel does not exist") {
-      message = flagOn(message, Flags::NO_CHANNEL);
-    }
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Join command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/exit") {
-    ExitCommand exit;
-    answer = exit.handleCommand(words, db, user);
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Exit command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/nick") {
-    NickCommand nick;
-    answer = nick.handleCommand(words, db, user);
-    message = flagOn(message, Flags::CHANGE_NICK);
-    logMessage(answer, SERVER_LOG_FILE);
-    message = stringToMessage(answer, message);
-
-    client.sendMessage(message);
-    logMessage("Change command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/connect") {
-    client.closeSocket();
-    logMessage("Client disconnected: " + user.id, SERVER_LOG_FILE);
-  } else if (words[0] == "/channels") {
-    answer = db.listOfChannelsOnServer();
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-  } else if (words[0] == "/time_on") {
-    user.timeFlag = true;
-    answer = "Time on";
-    message = flagOn(message, Flags::TIME_ON);
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Time on command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/time_off") {
-    user.timeFlag = false;
-
-    answer = "Time off";
-    message = stringToMessage(answer, message);
-    client.sendMessage(message);
-    logMessage("Time off command: " + command + " from " + user.id,
-               SERVER_LOG_FILE);
-  } else if (words[0] == "/voicemail_on") {
-    sendAudiofiletoClient(words[1], client);
-  } else {
+  CommandTokens words;
+  tokenizeCommand(command, words);
+  const CommandEntry *entry =
+      words.size() != 0 ? findCommand(words[0]) : nullptr;
+  if (entry == nullptr) {
     message = stringToMessage("Wrong command", message);
     client.sendMessage(message);
     logMessage("Wrong command: " + command + " from " + user.id,
                SERVER_LOG_FILE);
+    return;
+  }
+  latency.setMetric(commandMetric(entry->id));
+
+  switch (entry->id) {
+    case CommandId::READ:
+    case CommandId::SEND:
+    case CommandId::SEARCH:
+    case CommandId::EXIT:
+      answer = runChannelCommand(*entry, words, command, user);
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      break;
+    case CommandId::JOIN:
+      answer = runChannelCommand(*entry, words, command, user);
+      if (answer == "Channel does not exist") {
+        message = flagOn(message, Flags::NO_CHANNEL);
+      }
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      break;
+    case CommandId::NICK:
+      answer = entry->handler->handleCommand(words, db, user);
+      // Клиент принимает тело CHANGE_NICK за новый ник, ошибка идёт ответом
+      if (answer == user.nickname) {
+        message = flagOn(message, Flags::CHANGE_NICK);
+      }
+      logMessage(answer, SERVER_LOG_FILE);
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      break;
+    case CommandId::CONNECT:
+      // Сокет закроет handleClient после снятия присутствия
+      shutdown(client.getSocket(), SHUT_RDWR);
+      logMessage("Client disconnected: " + user.id, SERVER_LOG_FILE);
+      return;
+    case CommandId::CHANNELS:
+      answer = listChannels();
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      return;
+    case CommandId::TIME_ON:
+      user.timeFlag = true;
+      answer = "Time on";
+      message = flagOn(message, Flags::TIME_ON);
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      break;
+    case CommandId::TIME_OFF:
+      user.timeFlag = false;
+      answer = "Time off";
+      message = stringToMessage(answer, message);
+      client.sendMessage(message);
+      break;
+    case CommandId::VOICEMAIL_ON:
+      if (words.size() < 2) {
+        message = stringToMessage("Wrong command", message);
+        client.sendMessage(message);
+        return;
+      }
+      {
+        // Необязательные слова после id: поддерживаемые клиентом режимы
+        bool acceptsOpus = false, stream = false;
+        for (size_t i = 2; i < words.size(); ++i) {
+          acceptsOpus |= words[i] == VOICEMAIL_CODEC_NAME;
+          stream |= words[i] == VOICEMAIL_STREAM_OPTION;
+        }
+        if (!stream || !streamVoicemailToClient(std::string(words[1]),
+                                                client, acceptsOpus)) {
+          sendAudiofiletoClient(std::string(words[1]), client, acceptsOpus);
+        }
+      }
+      return;
   }
+  logMessage("Command " + command + " from " + user.id, SERVER_LOG_FILE);
 }
 
 bool Server::checkLogin(const std::string &login, User &user, int regOrLog) {
   logMessage("Check login: " + login, SERVER_LOG_FILE);
-  std::unordered_set<std::string> loginSet;
-  {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_names = db.nicknamesFile();
-    for (User &user : db.database_names) {
-      loginSet.insert(user.login);
-    }
-  }
-
-  if (loginInSet(login, loginSet)) {
+  if (db.userRegistry.loginExists(login)) {
     if (regOrLog == 0) {
       return false;
     }
@@ -185,69 +171,65 @@ bool Server::checkLogin(const std::string &login, User &user, int regOrLog) {
 
 bool Server::checkPasswordServer(const std::string &password, User &user) {
   logMessage("Check password: " + password, SERVER_LOG_FILE);
-  std::string salt = "fixed_salt_value";
-  try {
-    std::string hashedPassword = hashPassword(password, salt);
-
-    // std::cout << "Password: " << password << std::endl;
-    // std::cout << "Salt: " << salt << std::endl;
-    // std::cout << "Hashed Password: " << hashedPassword << std::endl;
-    user.password = hashedPassword;
-  } catch (const std::exception &ex) {
-    std::cerr << "Error: " << ex.what() << std::endl;
+  std::string hashedPassword;
+  if (!authPool.run([&](AuthWorkerContext &context) {
+        hashedPassword = makePasswordHash(context, password);
+      })) {
+    logMessage("Password hashing failed or auth queue is full",
+               SERVER_LOG_FILE);
     return false;
   }
+  user.password = hashedPassword;
   return true;
 }
 
 bool Server::checkPasswordAthorization(const std::string &login,
                                        const std::string &password) {
   logMessage("Проверка авторизации для логина: " + login, SERVER_LOG_FILE);
-  std::string salt = "fixed_salt_value";
-  std::string hashedPassword = hashPassword(password, salt);
-
+  std::string storedPassword;
+  bool found = false;
+  if (login.empty()) {
+    return false;
+  }
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_names = db.nicknamesFile();  // Загружаем пользователей из файла
     for (User &user : db.database_names) {
       if (user.login == login) {
         logMessage("Найден пользователь с логином: " + user.login,
                    SERVER_LOG_FILE);
-        logMessage(
-            "Сравнение паролей: " + user.password + " и " + hashedPassword,
-            SERVER_LOG_FILE);
-        if (user.password == hashedPassword) {
-          // Логин и пароль совпадают
-          user.password = hashedPassword;
-          // user.id = user.id;
-          // userInfo.nickname = user.nickname;
-          return true;
-        } else {
-          // Логин найден, но пароль неверный
-          logMessage("Пароль не совпадает для пользователя: " + user.login,
-                     SERVER_LOG_FILE);
-          return false;
-        }
+        storedPassword = user.password;
+        found = true;
+        break;
       }
     }
   }
-  // Пользователь с таким логином не найден
-  logMessage("Пользователь с логином " + login + " не найден", SERVER_LOG_FILE);
-  return false;
+  if (!found) {
+    // Пользователь с таким логином не найден
+    logMessage("Пользователь с логином " + login + " не найден",
+               SERVER_LOG_FILE);
+    return false;
+  }
+
+  // Хеширование выполняется в пуле, без удержания dbMutex
+  bool matches = false;
+  if (!authPool.run([&](AuthWorkerContext &context) {
+        matches = checkPasswordHash(context, password, storedPassword);
+      })) {
+    logMessage("Password check failed or auth queue is full", SERVER_LOG_FILE);
+    return false;
+  }
+  if (!matches) {
+    // Логин найден, но пароль неверный
+    logMessage("Пароль не совпадает для пользователя: " + login,
+               SERVER_LOG_FILE);
+  }
+  return matches;
 }
 
 bool Server::checkNickname(const std::string &nickname, User &user) {
   logMessage("Check nickname: " + nickname, SERVER_LOG_FILE);
-  std::unordered_set<std::string> nicknameSet;
-  {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_names = db.nicknamesFile();
-    for (User &user : db.database_names) {
-      nicknameSet.insert(user.nickname);
-    }
-  }
-
-  if (db.nickameInSet(nickname, nicknameSet)) {
+  if (db.userRegistry.nicknameExists(nickname)) {
     logMessage("Nickname already exists: " + nickname, SERVER_LOG_FILE);
     return false;
   }
@@ -256,6 +238,45 @@ bool Server::checkNickname(const std::string &nickname, User &user) {
   return true;
 }
 
+bool Server::resumeSession(MySocket &client, User &user, std::string &channel,
+                           const std::string &body) {
+  Message message;
+  std::string token = body.substr(0, body.find('\n'));
+  std::string resumeChannel =
+      token.size() < body.size() ? body.substr(token.size() + 1) : "";
+
+  std::string id;
+  LocalId localId = INVALID_LOCAL_ID;
+  if (sessionTokens.verify(token, id)) {
+    localId = db.userRegistry.find(id);
+  }
+  if (localId == INVALID_LOCAL_ID) {
+    logMessage("Session token rejected", SERVER_LOG_FILE);
+    message = flagOn(message, Flags::RESUME_FAILED);
+    client.sendMessage(stringToMessage("Session expired", message));
+    return false;
+  }
+
+  user.id = id;
+  user.localId = localId;
+  user.nickname = db.userRegistry.nickname(localId);
+  if (!resumeChannel.empty()) {
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    db.database_channels = db.channelsFile();
+    if (db.ChannelExists(resumeChannel)) {
+      channel = resumeChannel;
+    }
+  }
+  logMessage("Session resumed: " + user.id, SERVER_LOG_FILE);
+
+  message = flagOn(message, Flags::ID_CORRECT);
+  client.sendMessage(stringToMessage(user.nickname, message));
+  // Продлеваем срок действия для активных пользователей
+  message = flagOn(message, Flags::SESSION_TOKEN);
+  client.sendMessage(stringToMessage(sessionTokens.issue(user.id), message));
+  return true;
+}
+
 bool extractAudioMessageData(const Message &message, std::string &fileName,
                              std::vector<uint8_t> &audioData) {
   const uint8_t *dataPtr = message.body.data();
@@ -320,8 +341,7 @@ bool appendToChannelLog(const std::string &channel, std::string &id_user,
   return true;
 }
 
-void Server::proccessFileMessage(const Message &message,
-                                 const std::string &senderNickname) {
+void Server::proccessFileMessage(const Message &message, LocalId senderId) {
   const uint8_t *dataPtr = message.body.data();
   size_t dataSize = message.body.size();
 
@@ -409,21 +429,18 @@ void Server::proccessFileMessage(const Message &message,
   dataPtr += sizeof(uint32_t);
   dataSize -= sizeof(uint32_t);
 
-  uint32_t fileMessageID = generateUniqueID();
-
-  // Преобразуем идентификатор в строку
-  std::string fileMessageIDStr = std::to_string(fileMessageID);
-  std::filesystem::path pathObj(fileName);
-  // Сохраняем аудиофайл с новым именем (например, используем audioMessageID)
-  std::string fileDirectory = "channels/files";
-  std::string fileFilePath =
-      fileDirectory + "/" + fileMessageIDStr + pathObj.extension().string();
-  ;
-  if (!saveFile(fileDirectory, fileMessageIDStr + pathObj.extension().string(),
-                fileData)) {
+  // Идентификатор сообщения - дайджест содержимого, повтор не пишется
+  std::string fileMessageIDStr = db.blobStore.addBuffer(fileData, BlobRef::FILE);
+  if (fileMessageIDStr.empty()) {
+    logMessage("Failed to store file " + fileName, SERVER_LOG_FILE);
     return;
   }
+  storeFileMessage(senderId, channel, fileMessageIDStr, fileName, fileSize);
+}
 
+void Server::storeFileMessage(LocalId senderId, const std::string &channel,
+                              const std::string &fileMessageIDStr,
+                              std::string fileName, uint32_t fileSize) {
   // Получаем текущее время в формате YYYY-MM-DD HH:MM:SS
   std::time_t currentTime = std::time(nullptr);
   char timeBuffer[20];
@@ -431,24 +448,116 @@ void Server::proccessFileMessage(const Message &message,
                 std::localtime(&currentTime));
 
   FileMessage fileMessage;
-  fileMessage.messageID = fileMessageID;
-  fileMessage.senderNickname = senderNickname;
+  fileMessage.messageID = fileMessageIDStr;
+  fileMessage.senderNickname = db.userRegistry.nickname(senderId);
   fileMessage.timestamp = timeBuffer;
   fileMessage.filename = fileName;
   fileMessage.fileSize = fileSize;
 
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_channels_history = db.channelsHistoryFile(channel);
-    db.addFileMessageToChannelHistory(senderNickname, channel, fileMessageIDStr,
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    db.addFileMessageToChannelHistory(senderId, channel, fileMessageIDStr,
                                       fileName, fileSize);
   }
   logMessage("File message saved for channel " + channel, SERVER_LOG_FILE);
 }
 
+/**
+ * @brief Загрузка файла или голосового сообщения по частям
+ *
+ * @details
+ * На UPLOAD_BEGIN и каждую часть отвечает UPLOAD_ACK с числом принятых байт.
+ * На UPLOAD_END переносит принятый файл в хранилище вложений под его
+ * SHA-256 и добавляет запись в историю канала, как при приёме одним кадром.
+ */
+void Server::processUploadMessage(MySocket &client, User &user,
+                                  Message &message) {
+  std::string error;
+  uint64_t uploadId = 0;
+  Message answer;
+
+  if (message.header.flag == Flags::UPLOAD_CHUNK) {
+    uint64_t received;
+    if (uploads.writeChunk(user.localId, message, uploadId, received,
+                           error)) {
+      answer = stringToMessage(
+          std::to_string(uploadId) + " " + std::to_string(received), answer);
+      client.sendMessage(flagOn(answer, Flags::UPLOAD_ACK));
+      return;
+    }
+  } else if (message.header.flag == Flags::UPLOAD_BEGIN) {
+    Upload upload;
+    // Вложения хранятся рядом с историей канала, на узле-владельце
+    std::string header = messageToString(message);
+    size_t channelStart = header.find('\n');
+    std::string target =
+        channelStart == std::string::npos
+            ? ""
+            : header.substr(channelStart + 1,
+                            header.find('\n', channelStart + 1) -
+                                channelStart - 1);
+    if (!cluster.ownsChannel(target)) {
+      error = "Channel is hosted on node " + cluster.ownerOf(target) +
+              ", connect to it to upload files";
+    } else if (uploads.begin(user.localId, header, upload, error)) {
+      logMessage("Upload " + std::to_string(upload.id) + " of " +
+                     upload.filename + " from " + user.id + " at " +
+                     std::to_string(upload.received),
+                 SERVER_LOG_FILE);
+      answer = stringToMessage(std::to_string(upload.id) + " " +
+                                   std::to_string(upload.received),
+                               answer);
+      client.sendMessage(flagOn(answer, Flags::UPLOAD_ACK));
+      return;
+    }
+  } else {
+    Upload upload;
+    try {
+      uploadId = std::stoull(messageToString(message));
+    } catch (const std::exception &e) {
+      uploadId = 0;
+    }
+    WavInfo wavInfo;
+    if (uploads.finish(user.localId, uploadId, upload, error)) {
+      // Дайджест посчитан по мере приёма частей
+      std::string messageIDStr = upload.hash->finalHex();
+      if (upload.kind == UploadKind::AUDIO &&
+          !probeWavFile(upload.partPath, wavInfo, error)) {
+        error = "Invalid WAV file: " + error;
+      } else if (db.blobStore.addFile(upload.partPath, messageIDStr,
+                                      upload.totalSize,
+                                      upload.kind == UploadKind::AUDIO
+                                          ? BlobRef::VOICEMAIL
+                                          : BlobRef::FILE)) {
+        if (upload.kind == UploadKind::AUDIO) {
+          storeAudioMessage(user.localId, client.getIP(), upload.channel,
+                            messageIDStr, db.blobStore.path(messageIDStr),
+                            wavInfo.duration());
+        } else {
+          storeFileMessage(user.localId, upload.channel, messageIDStr,
+                           upload.filename,
+                           static_cast<uint32_t>(upload.totalSize));
+        }
+        answer = stringToMessage(
+            std::to_string(uploadId) + " Uploaded " + upload.filename, answer);
+        client.sendMessage(flagOn(answer, Flags::UPLOAD_END));
+        return;
+      }
+      std::remove(upload.partPath.c_str());
+      if (error.empty()) {
+        error = "Failed to store upload";
+      }
+    }
+  }
+
+  logMessage("Upload error from " + user.id + ": " + error, SERVER_LOG_FILE);
+  answer = stringToMessage(std::to_string(uploadId) + " " + error, answer);
+  client.sendMessage(flagOn(answer, Flags::UPLOAD_ERROR));
+}
+
 void Server::processAudioMessage(const Message &message,
                                  const std::string &senderIP,
-                                 const std::string &senderNickname) {
+                                 LocalId senderId) {
   const uint8_t *dataPtr = message.body.data();
   size_t dataSize = message.body.size();
 
@@ -526,34 +635,46 @@ void Server::processAudioMessage(const Message &message,
   // Оставшиеся данные — это аудиоданные
   std::vector<uint8_t> audioData(dataPtr, dataPtr + dataSize);
 
-  // Генерируем уникальный идентификатор аудиосообщения (например, UUID или на
-  // основе времени)
-
-  uint32_t audioMessageID = generateUniqueID();
-
-  // Преобразуем идентификатор в строку
-  std::string audioMessageIDStr = std::to_string(audioMessageID);
+  // Длительность берётся из заголовка ещё до записи на диск
+  WavInfo wavInfo;
+  std::string error;
+  if (!parseWavHeader(audioData.data(), audioData.size(), audioData.size(),
+                      wavInfo, error)) {
+    logMessage("Invalid AUDIO message: " + error, SERVER_LOG_FILE);
+    return;
+  }
 
-  // Сохраняем аудиофайл с новым именем (например, используем audioMessageID)
-  std::string audioDirectory = "channels/audio";
-  std::string audioFilePath = audioDirectory + "/" + audioMessageIDStr + ".wav";
-  if (!saveFile(audioDirectory, audioMessageIDStr + ".wav", audioData)) {
+  // Идентификатор сообщения - дайджест содержимого, повтор не пишется
+  std::string audioMessageIDStr = db.blobStore.addBuffer(audioData, BlobRef::VOICEMAIL);
+  if (audioMessageIDStr.empty()) {
+    logMessage("Failed to store audio " + fileName, SERVER_LOG_FILE);
     return;
   }
+  storeAudioMessage(senderId, senderIP, channel, audioMessageIDStr,
+                    db.blobStore.path(audioMessageIDStr), wavInfo.duration());
+}
 
+void Server::storeAudioMessage(LocalId senderId, const std::string &senderIP,
+                               const std::string &channel,
+                               const std::string &audioMessageIDStr,
+                               const std::string &audioFilePath,
+                               double duration) {
   // Получаем текущее время в формате YYYY-MM-DD HH:MM:SS
   std::time_t currentTime = std::time(nullptr);
   char timeBuffer[20];
   std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S",
                 std::localtime(&currentTime));
 
-  // Вычисляем продолжительность аудиосообщения
-  double duration = getAudioDuration(audioFilePath);
+  // Повтор уже перекодированного сообщения не кодируется заново
+  bool inBlobStore = BlobStore::isDigest(audioMessageIDStr);
+  bool transcoded =
+      inBlobStore && std::filesystem::exists(
+                         db.blobStore.transcodedPath(audioMessageIDStr));
 
   // Создаем объект AudioMessage
   AudioMessage audioMessage;
   audioMessage.timestamp = timeBuffer;
-  audioMessage.senderNickname = senderNickname;
+  audioMessage.senderNickname = db.userRegistry.nickname(senderId);
   audioMessage.senderIP = senderIP;
   audioMessage.messageID = audioMessageIDStr;
   audioMessage.duration = duration;
@@ -565,35 +686,178 @@ void Server::processAudioMessage(const Message &message,
     channelAudioMessages[channel].push_back(audioMessage);
   }
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_channels_history = db.channelsHistoryFile(channel);
-    db.addAudioMessageToChannelHistory(senderNickname, channel,
-                                       audioMessageIDStr, duration);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
+    db.addAudioMessageToChannelHistory(senderId, channel, audioMessageIDStr,
+                                       duration);
+  }
+  if (inBlobStore && !transcoded) {
+    transcoder.enqueue(audioMessageIDStr);
   }
   logMessage("Audio message saved for channel " + channel, SERVER_LOG_FILE);
 }
 
+/**
+ * @brief Перестроение списка голосовых сообщений каналов
+ *
+ * @details
+ * Записи Voicemail_ID собираются из файлов истории всех каналов, после чего
+ * длительность каждого сообщения читается из заголовка его файла. Чтение
+ * заголовков - это в основном ожидание диска, поэтому файлы делятся между
+ * несколькими потоками через общий счётчик.
+ */
+std::string Server::reindexAudio() {
+  static const std::regex voicemailRecord(
+      R"(\[([^\]]+)\] (.+?): \[Voicemail_ID: ([^,]+), duration:)");
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::pair<std::string, AudioMessage>> entries;
+  std::unordered_set<std::string> channels = db.channelsFile();
+  for (const std::string &channel : channels) {
+    std::ifstream history(db.pathToChannelsHistory(channel));
+    std::string line;
+    std::smatch match;
+    while (std::getline(history, line)) {
+      if (!std::regex_search(line, match, voicemailRecord)) {
+        continue;
+      }
+      AudioMessage audioMessage;
+      audioMessage.timestamp = match[1];
+      // Отправитель - номер, UUID старого формата или ник в ранних записях
+      LocalId senderId = db.userRegistry.parseStored(match[2]);
+      audioMessage.senderNickname = senderId != INVALID_LOCAL_ID
+                                        ? db.userRegistry.nickname(senderId)
+                                        : match[2].str();
+      audioMessage.messageID = match[3];
+      audioMessage.duration = 0.0;
+      entries.emplace_back(channel, std::move(audioMessage));
+    }
+  }
+
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> unreadable{0};
+  auto probeWorker = [&]() {
+    for (size_t i = next++; i < entries.size(); i = next++) {
+      AudioMessage &audioMessage = entries[i].second;
+      const std::string &audioId = audioMessage.messageID;
+      WavInfo wavInfo;
+      std::string error;
+      if (!BlobStore::isDigest(audioId)) {
+        audioMessage.filePath = "channels/audio/" + audioId + ".wav";
+      } else if (std::filesystem::exists(
+                     db.blobStore.transcodedPath(audioId))) {
+        audioMessage.filePath = db.blobStore.transcodedPath(audioId);
+        audioMessage.duration = encodedVoicemailDuration(audioMessage.filePath);
+        unreadable += audioMessage.duration == 0.0;
+        continue;
+      } else {
+        audioMessage.filePath = db.blobStore.path(audioId);
+      }
+      if (probeWavFile(audioMessage.filePath, wavInfo, error)) {
+        audioMessage.duration = wavInfo.duration();
+      } else {
+        ++unreadable;
+      }
+    }
+  };
+  // Потоков больше, чем ядер: они простаивают на чтении, а не на разборе
+  size_t workers = std::min<size_t>(AUDIO_REINDEX_MAX_WORKERS,
+                                    std::max<size_t>(1, entries.size()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workers; ++i) {
+    threads.emplace_back(probeWorker);
+  }
+  probeWorker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  double totalDuration = 0.0;
+  std::unordered_map<std::string, std::vector<AudioMessage>> index;
+  for (auto &[channel, audioMessage] : entries) {
+    totalDuration += audioMessage.duration;
+    index[channel].push_back(std::move(audioMessage));
+  }
+  {
+    std::lock_guard<std::mutex> lock(channelDataMutex);
+    channelAudioMessages.swap(index);
+  }
+
+  double elapsedMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  std::ostringstream oss;
+  oss << "Voicemails indexed: " << entries.size() << " in " << channels.size()
+      << " channels, unreadable " << unreadable << ", total duration "
+      << static_cast<uint64_t>(totalDuration) << " s, " << workers
+      << " threads, " << std::fixed << std::setprecision(1) << elapsedMs
+      << " ms";
+  return oss.str();
+}
+
+static bool readBinaryFile(const std::string &path,
+                           std::vector<uint8_t> &data) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+  data.resize(file.tellg());
+  file.seekg(0, std::ios::beg);
+  return static_cast<bool>(
+      file.read(reinterpret_cast<char *>(data.data()), data.size()));
+}
+
 void Server::sendAudiofiletoClient(const std::string &audioId,
-                                   MySocket &client) {
+                                   MySocket &client, bool acceptsOpus) {
   Message msg;
   logMessage("Received audio request for ID: " + audioId, SERVER_LOG_FILE);
 
-  // Построение пути к аудиофайлу
-  std::string audioDirectory = "channels/audio/";
-  std::string audioFilePath = audioDirectory + audioId + ".wav";
+  // Построение пути к аудиофайлу: дайджест в хранилище вложений или
+  // числовой идентификатор записей, сделанных до него
+  bool inBlobStore = BlobStore::isDigest(audioId);
+  std::string audioFilePath = inBlobStore
+                                  ? db.blobStore.path(audioId)
+                                  : "channels/audio/" + audioId + ".wav";
+  std::string transcodedPath =
+      inBlobStore ? db.blobStore.transcodedPath(audioId) : "";
+
+  // Сжатую копию отдаём как есть, старому клиенту собираем из неё WAV.
+  // Перекодирование переименовывает .opus раньше, чем удаляет WAV, поэтому
+  // после неудачного чтения WAV сжатая копия уже на месте
+  std::vector<uint8_t> audioData, encoded;
+  std::string fileName = audioId + ".wav";
+  bool found = false;
+  if (acceptsOpus && inBlobStore && readBinaryFile(transcodedPath, audioData)) {
+    fileName = audioId + VOICEMAIL_OPUS_EXTENSION;
+    found = true;
+  } else if (readBinaryFile(audioFilePath, audioData)) {
+    found = true;
+  } else if (inBlobStore && readBinaryFile(transcodedPath, encoded)) {
+    if (acceptsOpus) {
+      audioData = std::move(encoded);
+      fileName = audioId + VOICEMAIL_OPUS_EXTENSION;
+      found = true;
+    } else {
+      std::vector<int16_t> pcm;
+      int sampleRate, channels;
+      if (decodeVoicemail(encoded, pcm, sampleRate, channels)) {
+        audioData = pcmToWav(pcm, sampleRate, channels);
+        found = true;
+      }
+    }
+  }
 
   // Проверка существования файла
-  if (!std::filesystem::exists(audioFilePath)) {
+  if (!found) {
     logMessage("Audio file not found: " + audioFilePath, SERVER_LOG_FILE);
 
     // Отправляем сообщение об ошибке клиенту
     msg = flagOn(msg, Flags::AUDIOFILE_ERROR);
     std::string errorText =
         "Error: Audio message with ID " + audioId + " not found.";
-    client.sendMessage(msg);
+    client.sendMessage(stringToMessage(errorText, msg));
     return;
   }
-  msg.setAudioMessage(audioFilePath);
+  msg.setAudioMessage(fileName, audioData);
   if (client.sendMessage(msg)) {
     logMessage("Sent audio message ID " + audioId + " to client.",
                SERVER_LOG_FILE);
@@ -603,99 +867,220 @@ void Server::sendAudiofiletoClient(const std::string &audioId,
   }
 }
 
-// Функция для создания map из user_id в socket
-std::unordered_map<std::string, int> createUserSocketMap(
-    const std::vector<User> &users) {
-  std::unordered_map<std::string, int> user_socket_map;
-  user_socket_map.reserve(users.size());
+/**
+ * @brief Голосовое сообщение частями
+ *
+ * @details
+ * VOICEMAIL_STREAM_BEGIN несёт формат, дальше идут части по
+ * VOICEMAIL_STREAM_CHUNK_MS: пакеты сжатой копии или PCM из WAV, который
+ * ещё не перекодирован. Первая часть короче и уходит сразу, минуя
+ * пакетную отправку, чтобы клиент начал играть, не дожидаясь остального.
+ */
+bool Server::streamVoicemailToClient(const std::string &audioId,
+                                     MySocket &client, bool acceptsOpus) {
+  bool inBlobStore = BlobStore::isDigest(audioId);
+  std::string audioFilePath = inBlobStore
+                                  ? db.blobStore.path(audioId)
+                                  : "channels/audio/" + audioId + ".wav";
+  Message msg;
+  msg.header.type = DataType::AUDIO;
+
+  std::vector<uint8_t> encoded;
+  VoicemailHeader opusHeader;
+  if (acceptsOpus && inBlobStore &&
+      readBinaryFile(db.blobStore.transcodedPath(audioId), encoded) &&
+      parseVoicemailHeader(encoded.data(), encoded.size(), opusHeader)) {
+    msg.header.flag = Flags::VOICEMAIL_STREAM_BEGIN;
+    msg.setTextMessage(audioId + " " + VOICEMAIL_CODEC_NAME + " " +
+                       std::to_string(opusHeader.sampleRate) + " " +
+                       std::to_string(opusHeader.channels) + " " +
+                       std::to_string(opusHeader.frames) + " " +
+                       std::to_string(opusHeader.preSkip));
+    msg.header.type = DataType::AUDIO;
+    client.sendMessage(msg);
 
-  for (const auto &user : users) {
-    try {
-      int socket = std::stoi(user.socketNumber);
-      user_socket_map.emplace(user.id, socket);
-    } catch (const std::invalid_argument &e) {
-      std::cerr << "Неверный формат socket для user_id " << user.id << ": "
-                << user.socketNumber << std::endl;
-    } catch (const std::out_of_range &e) {
-      std::cerr << "Socket вне диапазона для user_id " << user.id << ": "
-                << user.socketNumber << std::endl;
+    // Пакеты по 20 мс: часть - целое число пакетов
+    size_t packetsPerChunk =
+        VOICEMAIL_STREAM_FIRST_MS * VOICEMAIL_OPUS_FRAMES_PER_SECOND / 1000;
+    size_t offset = VOICEMAIL_OPUS_HEADER_SIZE;
+    msg.header.flag = Flags::VOICEMAIL_STREAM_CHUNK;
+    while (offset < encoded.size()) {
+      size_t end = offset;
+      for (size_t packets = 0;
+           packets < packetsPerChunk && end + sizeof(uint16_t) <= encoded.size();
+           ++packets) {
+        uint16_t netLength;
+        std::memcpy(&netLength, encoded.data() + end, sizeof(netLength));
+        end = std::min(encoded.size(),
+                       end + sizeof(netLength) + be16toh(netLength));
+      }
+      if (end == offset) {
+        break;
+      }
+      msg.body.assign(encoded.begin() + offset, encoded.begin() + end);
+      msg.header.size = msg.body.size();
+      if (!client.sendMessage(msg) || !client.flushBatch()) {
+        return true;
+      }
+      offset = end;
+      packetsPerChunk =
+          VOICEMAIL_STREAM_CHUNK_MS * VOICEMAIL_OPUS_FRAMES_PER_SECOND / 1000;
     }
-  }
-
-  return user_socket_map;
-}
+  } else {
+    // WAV отдаётся частями прямо с диска, если это PCM 16 бит
+    WavInfo wavInfo;
+    std::string error;
+    if (!probeWavFile(audioFilePath, wavInfo, error) || wavInfo.format != 1 ||
+        wavInfo.bitsPerSample != 16 || wavInfo.channels > 2) {
+      return false;
+    }
+    std::ifstream file(audioFilePath, std::ios::binary);
+    file.seekg(wavInfo.dataOffset);
+    if (!file) {
+      return false;
+    }
+    msg.header.flag = Flags::VOICEMAIL_STREAM_BEGIN;
+    msg.setTextMessage(audioId + " pcm " +
+                       std::to_string(wavInfo.sampleRate) + " " +
+                       std::to_string(wavInfo.channels) + " " +
+                       std::to_string(wavInfo.dataSize / wavInfo.blockAlign));
+    msg.header.type = DataType::AUDIO;
+    client.sendMessage(msg);
 
-// Функция для получения списка сокетов подключенных клиентов с использованием
-// map
-std::vector<int> Server::getClientSocketsOptimized(
-    const std::unordered_set<std::string> &channel_members,
-    const std::unordered_map<std::string, int> &user_socket_map) {
-  client_sockets.clear();
-  client_sockets.reserve(channel_members.size());
-
-  for (const auto &user_id : channel_members) {
-    auto it = user_socket_map.find(user_id);
-    if (it != user_socket_map.end()) {
-      client_sockets.push_back(it->second);
-    } else {
-      std::cerr << "Пользователь с user_id " << user_id << " не найден в map."
-                << std::endl;
+    uint64_t bytesPerSecond =
+        static_cast<uint64_t>(wavInfo.sampleRate) * wavInfo.blockAlign;
+    uint64_t chunkBytes = std::max<uint64_t>(
+        wavInfo.blockAlign,
+        bytesPerSecond * VOICEMAIL_STREAM_FIRST_MS / 1000 /
+            wavInfo.blockAlign * wavInfo.blockAlign);
+    uint64_t remaining = wavInfo.dataSize;
+    msg.header.flag = Flags::VOICEMAIL_STREAM_CHUNK;
+    while (remaining > 0) {
+      msg.body.resize(std::min(remaining, chunkBytes));
+      if (!file.read(reinterpret_cast<char *>(msg.body.data()),
+                     msg.body.size())) {
+        break;
+      }
+      msg.header.size = msg.body.size();
+      if (!client.sendMessage(msg) || !client.flushBatch()) {
+        return true;
+      }
+      remaining -= msg.body.size();
+      chunkBytes = bytesPerSecond * VOICEMAIL_STREAM_CHUNK_MS / 1000 /
+                   wavInfo.blockAlign * wavInfo.blockAlign;
     }
   }
 
-  return client_sockets;
+  msg.header.flag = Flags::VOICEMAIL_STREAM_END;
+  msg.setTextMessage(audioId);
+  msg.header.type = DataType::AUDIO;
+  client.sendMessage(msg);
+  logMessage("Streamed audio message ID " + audioId + " to client.",
+             SERVER_LOG_FILE);
+  return true;
 }
 
 void Server::broadcast_audio(const std::vector<SAMPLE_TYPE> &audioData,
-                             int sender_socket, std::string &channel) {
+                             const User &sender, std::string &channel) {
   logMessage("broadcast_audio", SERVER_LOG_FILE);
-  std::lock_guard<std::mutex> lock(clients_mutex);
-
-  MySocket client;
-  for (int client_socket : client_sockets) {
-    if (client_socket != sender_socket) {
-      logMessage(
-          "Sending audio data to client " + std::to_string(client_socket),
-          SERVER_LOG_FILE);
-      // std::cout << "Sending audio data to client "
-      //           << std::to_string(client_socket) << "..." << std::endl;
-      Message voiceMessage;
-      voiceMessage.setVoiceMessage(audioData, channel);
-      client.setSocket(client_socket);
-      client.sendMessage(voiceMessage);
-      // send(client_socket, audioData.data(),
-      //      audioData.size() * sizeof(SAMPLE_TYPE), 0);
+  Message voiceMessage;
+  voiceMessage.setVoiceMessage(audioData, channel);
+  if (!cluster.ownsChannel(channel)) {
+    // Участников знает только владелец канала, он и разошлёт кадр
+    if (cluster.post(cluster.ownerOf(channel),
+                     clusterMessage(ClusterOp::VOICE,
+                                    {channel, sender.id,
+                                     std::string(voiceMessage.body.begin(),
+                                                 voiceMessage.body.end())},
+                                    DataType::VOICE))) {
+      addCounter(Counter::CLUSTER_RELAYED);
     }
+    return;
   }
+  // Получатели - участники канала; сокеты знает реестр присутствия
+  deliverToMembers(db.channelMembers(channel), voiceMessage, sender.id);
 }
 
-void mix_audio_buffers(std::vector<int16_t *> &buffers, int16_t *output,
-                       int frame_count) {
-  memset(output, 0, frame_count * NUM_CHANNELS * sizeof(int16_t));
-
-  for (int i = 0; i < frame_count * NUM_CHANNELS; ++i) {
-    int32_t mixed_sample = 0;
-    for (auto &buffer : buffers) {
-      mixed_sample += buffer[i];
+void Server::deliverToMembers(const std::unordered_set<LocalId> &members,
+                              const Message &message,
+                              const std::string &senderId) {
+  presence.sendToMany(members, message,
+                      senderId.empty() ? INVALID_LOCAL_ID
+                                       : db.userRegistry.find(senderId));
+  if (!cluster.enabled()) {
+    return;
+  }
+  // Участники с других узлов - заглушки без логина. На каком узле они
+  // вошли, неизвестно, поэтому список получает каждый сосед
+  std::vector<std::string> fields = {
+      std::to_string(message.header.type), std::to_string(message.header.flag),
+      senderId, std::string(message.body.begin(), message.body.end())};
+  size_t localFields = fields.size();
+  for (LocalId member : members) {
+    if (!db.userRegistry.hasLogin(member)) {
+      fields.push_back(db.userRegistry.toString(member));
     }
+  }
+  if (fields.size() == localFields) {
+    return;
+  }
+  Message deliver =
+      clusterMessage(ClusterOp::DELIVER, fields, message.header.type);
+  for (const std::string &peer : cluster.peers()) {
+    if (cluster.post(peer, deliver)) {
+      addCounter(Counter::CLUSTER_RELAYED);
+    }
+  }
+}
 
-    // Ограничение значений, чтобы избежать переполнения
-    if (mixed_sample > INT16_MAX) mixed_sample = INT16_MAX;
-    if (mixed_sample < INT16_MIN) mixed_sample = INT16_MIN;
-
-    output[i] = static_cast<int16_t>(mixed_sample);
+bool Server::admitMessage(MySocket &client, const User &user,
+                          ConnectionRateLimits &limits, Message &message) {
+  TrafficClass trafficClass = classifyMessage(message);
+  double cost = messageCost(trafficClass, message);
+  uint32_t retryMs = 0;
+  if (limits.admit(trafficClass, cost, user.localId, userRateLimits,
+                   retryMs)) {
+    return true;
+  }
+  if (isBackpressured(message)) {
+    addCounter(Counter::THROTTLED_UPLOAD);
+    // Ответы уже принятым кадрам не должны ждать вместе с частью
+    client.flushBatch();
+    do {
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          std::clamp<uint32_t>(retryMs, 1, RATE_BACKPRESSURE_MAX_WAIT_MS)));
+      if (!serverRunning) {
+        return false;
+      }
+    } while (!limits.admit(trafficClass, cost, user.localId, userRateLimits,
+                           retryMs));
+    client.beginBatch();
+    return true;
   }
+  addCounter(static_cast<Counter>(static_cast<int>(Counter::THROTTLED_COMMAND) +
+                                  static_cast<int>(trafficClass)));
+  if (limits.shouldNotify(trafficClass)) {
+    logMessage("Rate limit exceeded by socket " +
+                   std::to_string(client.getSocket()),
+               SERVER_LOG_FILE);
+    message = flagOn(message, Flags::THROTTLED);
+    client.sendMessage(stringToMessage(
+        "Rate limit exceeded, retry in " + std::to_string(retryMs) + " ms",
+        message));
+  }
+  return false;
 }
+
 void Server::messageProcessing(MySocket &client, User &user,
                                std::string &channel) {
   Message message;
   bool idReceived = false;
-
-  {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_names = db.nicknamesFile();
-    // db.database_channels = db.channelsFile();
-  }
+  // Пароль проверен или пользователь только что зарегистрирован: без этого
+  // ID не подтверждается и токен сессии не выдаётся
+  bool authenticated = false;
+  ConnectionRateLimits limits;
+  // Снимается до закрытия сокета в handleClient
+  PresenceSession session(presence, client);
 
   while (serverRunning) {
     message.clearMessage(message);
@@ -704,9 +1089,25 @@ void Server::messageProcessing(MySocket &client, User &user,
     if (!client.receiveMessage(message)) {
       std::cerr << "Client disconnect" << std::endl;
       logMessage("Client disconnect", SERVER_LOG_FILE);
-      client.closeSocket();
       break;
     }
+    // Замер заканчивается после отправки ответов в конце итерации; кадры
+    // неизвестного типа обрабатываются как текст
+    ScopedLatency latency(
+        message.header.type <= DataType::BATCH
+            ? static_cast<Metric>(static_cast<int>(Metric::MESSAGE_TEXT) +
+                                  message.header.type)
+            : Metric::MESSAGE_TEXT);
+    // Ответы копятся, пока от клиента есть непрочитанные команды
+    client.beginBatch();
+
+    // Кадр сверх лимита не доходит ни до диска, ни до микшера
+    if (!admitMessage(client, user, limits, message)) {
+      if (!client.hasBufferedInput()) {
+        client.flushBatch();
+      }
+      continue;
+    }
 
     // Логирование полученного сообщения
     std::string messageContent = (message.header.type == DataType::AUDIO)
@@ -719,7 +1120,7 @@ void Server::messageProcessing(MySocket &client, User &user,
     // Проверяем тип сообщения
     if (message.header.type == DataType::AUDIO) {
       logMessage("Received AUDIO message", SERVER_LOG_FILE);
-      processAudioMessage(message, client.getIP(), user.id);
+      processAudioMessage(message, client.getIP(), user.localId);
 
     } else if (message.header.type == DataType::VOICE) {
       logMessage("Received VOICE message", SERVER_LOG_FILE);
@@ -732,6 +1133,7 @@ void Server::messageProcessing(MySocket &client, User &user,
         logMessage(
             "Invalid VOICE message: insufficient data for channel length",
             SERVER_LOG_FILE);
+        client.flushBatch();
         return;
       }
       uint32_t netChannelLength;
@@ -744,6 +1146,7 @@ void Server::messageProcessing(MySocket &client, User &user,
       if (dataSize < channelLength) {
         logMessage("Invalid VOICE message: channel length mismatch",
                    SERVER_LOG_FILE);
+        client.flushBatch();
         return;
       }
 
@@ -757,6 +1160,7 @@ void Server::messageProcessing(MySocket &client, User &user,
       if (dataSize < sizeof(uint32_t)) {
         logMessage("Invalid VOICE message: insufficient data for Opus length",
                    SERVER_LOG_FILE);
+        client.flushBatch();
         return;
       }
       uint32_t netOpusLength;
@@ -769,6 +1173,7 @@ void Server::messageProcessing(MySocket &client, User &user,
       if (dataSize < opusLength) {
         logMessage("Invalid VOICE message: Opus data length mismatch",
                    SERVER_LOG_FILE);
+        client.flushBatch();
         return;
       }
 
@@ -782,9 +1187,16 @@ void Server::messageProcessing(MySocket &client, User &user,
       memcpy(packet.opus_data, opusData.data(), opusLength);
 
       // Добавляем в буфер клиента
+      auto tickStart = std::chrono::steady_clock::now();
       {
         std::lock_guard<std::mutex> lock(client_buffers_mutex);
-        client_buffers[client.getSocket()].push(packet);
+        auto [entry, inserted] = client_buffers.try_emplace(client.getSocket());
+        if (inserted) {
+          addCounter(Counter::VOICE_STREAMS_STARTED);
+        }
+        std::queue<AudioPacket> &buffer = entry->second;
+        buffer.push(packet);
+        recordMetric(Metric::QUEUE_VOICE, buffer.size());
       }
 
       // Декодирование и микширование аудиоданных
@@ -805,6 +1217,7 @@ void Server::messageProcessing(MySocket &client, User &user,
         if (error != OPUS_OK) {
           std::cerr << "Failed to create Opus decoder: " << opus_strerror(error)
                     << std::endl;
+          client.flushBatch();
           return;
         }
 
@@ -825,67 +1238,35 @@ void Server::messageProcessing(MySocket &client, User &user,
         opus_decoder_destroy(decoder);
       }
 
-      // Обновление базы данных
-      {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        db.database_names = db.nicknamesFile();
-        db.database_channels_members = db.channelsMembersFile(channel);
-      }
-
-      // Создание карты пользователей и получение списка сокетов клиентов
-      std::unordered_map<std::string, int> user_socket_map;
-      {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        user_socket_map = createUserSocketMap(db.database_names);
-      }
-
-      std::vector<int> client_sockets;
-      {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        client_sockets = getClientSocketsOptimized(db.database_channels_members,
-                                                   user_socket_map);
-      }
-
-      // Удаляем отправителя из списка получателей
-      {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        client_sockets.erase(
-            std::remove(client_sockets.begin(), client_sockets.end(),
-                        client.getSocket()),
-            client_sockets.end());
-      }
-
       if (!decoded_buffers.empty()) {
         std::vector<SAMPLE_TYPE> mixed_audio(FRAMES_PER_BUFFER * NUM_CHANNELS);
         mix_audio_buffers(decoded_buffers, mixed_audio.data(),
-                          FRAMES_PER_BUFFER);
-        // вывод client_sockets
-        for (int sock : client_sockets) {
-          std::cout << "Client socket: " << sock;
-        }
-        std::cout << std::endl;
-        broadcast_audio(mixed_audio, client.getSocket(), channel);
+                          FRAMES_PER_BUFFER, NUM_CHANNELS);
+        broadcast_audio(mixed_audio, user, channel);
+      }
+      // Кадр должен уложиться в свою длительность, иначе голос отстаёт
+      addCounter(Counter::MIXER_TICKS);
+      if (std::chrono::steady_clock::now() - tickStart >
+          std::chrono::microseconds(1000000LL * FRAMES_PER_BUFFER /
+                                    SAMPLE_RATE)) {
+        addCounter(Counter::MIXER_OVERRUNS);
       }
 
-      // // Отправляем аудиосообщение другим клиентам
-      // for (auto &sock : client_sockets) {
-      //   MySocket recipient(sock);
-      //   if (!recipient.sendMessage(audioMessage)) {
-      //     std::cerr << "Failed to send audio message to socket: " << sock
-      //               << std::endl;
-      //     // Опционально: можно удалить клиента из списка при ошибке отправки
-      //     // removeClient(sock);
-      //   }
-      // }
+    } else if (message.header.type == DataType::FILE_TYPE &&
+               message.header.flag == Flags::UPLOAD_CHUNK) {
+      if (idReceived) {
+        processUploadMessage(client, user, message);
+      }
     } else if (message.header.type == DataType::FILE_TYPE) {
       logMessage("Received FILE_TYPE message", SERVER_LOG_FILE);
-      proccessFileMessage(message, user.id);
+      proccessFileMessage(message, user.localId);
     } else {
       // Обработка текстовых сообщений по флагам
       switch (message.header.flag) {
         case Flags::LOGIN_SIGN_UP:
           logMessage("LOGIN_SIGN_UP with login: " + messageToString(message),
                      SERVER_LOG_FILE);
+          authenticated = false;
           if (checkLogin(messageToString(message), user, 0)) {
             message = flagOn(message, Flags::CHECK_LOGIN);
             message = stringToMessage("Login correct", message);
@@ -898,6 +1279,8 @@ void Server::messageProcessing(MySocket &client, User &user,
         case Flags::LOGIN_LOG_IN:
           logMessage("LOGIN_LOG_IN with login: " + messageToString(message),
                      SERVER_LOG_FILE);
+          // Новый логин требует своего пароля
+          authenticated = false;
           if (checkLogin(messageToString(message), user, 1)) {
             message = flagOn(message, Flags::CHECK_LOGIN);
             message = stringToMessage("Login correct", message);
@@ -923,6 +1306,7 @@ void Server::messageProcessing(MySocket &client, User &user,
               "PASSWORD_LOG_IN with password: " + messageToString(message),
               SERVER_LOG_FILE);
           if (checkPasswordAthorization(user.login, messageToString(message))) {
+            authenticated = true;
             logMessage(
                 "Authorization is successful, nickname: " + user.nickname,
                 SERVER_LOG_FILE);
@@ -934,7 +1318,21 @@ void Server::messageProcessing(MySocket &client, User &user,
           break;
 
         case Flags::CHANNEL:
-          db.channelMessage(message, channel, client);
+          if (cluster.ownsChannel(messageToString(message))) {
+            db.channelMessage(message, channel, client);
+          } else {
+            // Канал создаётся на своём узле, а не копией здесь. Без ответа:
+            // вход клиента не ждёт узел-владелец и не пишет в консоль
+            channel = messageToString(message);
+            if (!cluster.post(
+                    cluster.ownerOf(channel),
+                    clusterMessage(ClusterOp::CREATE_CHANNEL, {channel}))) {
+              logMessage("Channel node " + cluster.ownerOf(channel) +
+                             " is unavailable, channel " + channel +
+                             " not created",
+                         SERVER_LOG_FILE);
+            }
+          }
           break;
 
         case Flags::NICK:
@@ -950,11 +1348,12 @@ void Server::messageProcessing(MySocket &client, User &user,
                          SERVER_LOG_FILE);
               registrationOnServer(client, user.nickname, user.login,
                                    user.password);
+              authenticated = true;
               logMessage("Registered", SERVER_LOG_FILE);
 
               if (!channel.empty()) {
-                std::lock_guard<std::mutex> lock(dbMutex);
-                db.addChannelMember(user.id, channel);
+                std::lock_guard<MeteredMutex> lock(dbMutex);
+                db.addChannelMember(user.localId, channel);
               }
             }
             client.sendMessage(message);
@@ -971,6 +1370,7 @@ void Server::messageProcessing(MySocket &client, User &user,
         case Flags::CHECK_ID:
           logMessage("Checking id", SERVER_LOG_FILE);
           user.id = db.userId(user.login);
+          user.localId = db.userRegistry.find(user.id);
           logMessage("id: " + user.id, SERVER_LOG_FILE);
           message.clearMessage(message);
 
@@ -983,17 +1383,51 @@ void Server::messageProcessing(MySocket &client, User &user,
 
         case Flags::ID:
           logMessage("ID flag", SERVER_LOG_FILE);
-          if (db.idMessage(idReceived, message, user.id)) {
+          if (!authenticated) {
+            logMessage("ID before authorization from " + client.getIP(),
+                       SERVER_LOG_FILE);
+          } else if (db.idMessage(idReceived, message, user.id)) {
             message = flagOn(message, Flags::ID_CORRECT);
             user.nickname = db.userNickbyId(user.id);
             message = stringToMessage(user.nickname, message);
             if (!client.sendMessage(message)) {
               std::cerr << "Failed to send id." << std::endl;
             }
+            message = flagOn(message, Flags::SESSION_TOKEN);
+            client.sendMessage(
+                stringToMessage(sessionTokens.issue(user.id), message));
+            session.login(user.localId);
           }
           // userInfo = {"", "", "", ""};
           break;
 
+        case Flags::COMPRESSION:
+          // Отвечаем несжатым кадром, затем включаем сжатие для клиента
+          if (messageToString(message) == COMPRESSION_NAME) {
+            client.sendMessage(stringToMessage(COMPRESSION_NAME, message));
+            client.enableCompression();
+          } else {
+            client.sendMessage(stringToMessage("", message));
+          }
+          break;
+
+        case Flags::UPLOAD_BEGIN:
+        case Flags::UPLOAD_END:
+          if (idReceived) {
+            processUploadMessage(client, user, message);
+          }
+          break;
+
+        case Flags::RESUME:
+          logMessage("RESUME flag", SERVER_LOG_FILE);
+          idReceived =
+              resumeSession(client, user, channel, messageToString(message));
+          authenticated = idReceived;
+          if (idReceived) {
+            session.login(user.localId);
+          }
+          break;
+
         default:
           if (idReceived) {
             logMessage("START COMMAND PROCESSING", SERVER_LOG_FILE);
@@ -1006,6 +1440,9 @@ void Server::messageProcessing(MySocket &client, User &user,
           break;
       }
     }
+    if (!client.hasBufferedInput()) {
+      client.flushBatch();
+    }
   }
 }
 
@@ -1047,7 +1484,52 @@ void handleClient(int clientSocket, Server &server) {
   server.messageProcessing(client, user, channel);
   // server.messageProcessing(client, db, user.id, channel, user.nickname);
 
+  // До закрытия: иначе номер сокета может получить новый клиент
+  {
+    std::lock_guard<std::mutex> lock(server.client_buffers_mutex);
+    if (server.client_buffers.erase(clientSocket) > 0) {
+      addCounter(Counter::VOICE_STREAMS_ENDED);
+    }
+  }
   client.closeSocket();
+  server.activeConnections.fetch_sub(1, std::memory_order_relaxed);
+  addCounter(Counter::CONNECTIONS_CLOSED);
+}
+
+void recordTraffic(bool outgoing, DataType type, size_t bytes) {
+  // Неизвестные типы обрабатываются как текст
+  size_t index = type <= DataType::BATCH ? type : DataType::TEXT;
+  Counter first = outgoing ? Counter::BYTES_OUT_TEXT : Counter::BYTES_IN_TEXT;
+  addCounter(static_cast<Counter>(static_cast<size_t>(first) + index), bytes);
+}
+
+std::string Server::prometheusReport() {
+  uint64_t hits = db.historyCache.hits();
+  uint64_t misses = db.historyCache.misses();
+  std::ostringstream oss;
+  oss << metricsExposition()
+      << "# HELP chat_history_cache_requests_total /read requests by result.\n"
+      << "# TYPE chat_history_cache_requests_total counter\n"
+      << "chat_history_cache_requests_total{result=\"hit\"} " << hits << "\n"
+      << "chat_history_cache_requests_total{result=\"miss\"} " << misses
+      << "\n"
+      << "# HELP chat_history_cache_hit_ratio Share of /read served from "
+         "the cache.\n"
+      << "# TYPE chat_history_cache_hit_ratio gauge\n"
+      << "chat_history_cache_hit_ratio "
+      << (hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses))
+      << "\n"
+      << "# HELP chat_users_online Users with at least one logged-in "
+         "connection.\n"
+      << "# TYPE chat_users_online gauge\n"
+      << "chat_users_online " << presence.online() << "\n";
+  if (cluster.enabled()) {
+    oss << "# HELP chat_cluster_links_up Outgoing links to other nodes that "
+           "are connected.\n"
+        << "# TYPE chat_cluster_links_up gauge\n"
+        << "chat_cluster_links_up " << cluster.linksUp() << "\n";
+  }
+  return oss.str();
 }
 
 /**
@@ -1064,6 +1546,8 @@ void signalHandlerServer(int signal) {
                SERVER_LOG_FILE);
     std::cout << "Shutting down server..." << std::endl;
     if (globalServer) {
+      // Снимок пишет main после выхода из цикла accept: здесь нельзя
+      // захватывать мьютексы, которые может держать прерванный поток
       globalServer->serverRunning = false;
       globalServer->serverSocket.closeSocket();
     }
@@ -1071,14 +1555,20 @@ void signalHandlerServer(int signal) {
 }
 
 void Server::helpToUse(const char *programName) {
-  std::cout << "Usage: " << programName << " <port>" << std::endl;
+  std::cout << "Usage: " << programName
+            << " <port> [admin_port] [cluster_file node_id]" << std::endl;
   std::cout << "Options:\n"
-            << "  -h, --help  Show this help message\n";
+            << "  -h, --help  Show this help message\n"
+            << "  cluster_file  Lines \"<node_id> <host> <port>\" with the "
+               "inter-node port of every node\n";
 }
 
 bool Server::addChannelOnServer(std::string &channel) {
+  if (!cluster.ownsChannel(channel)) {
+    return requestChannelChange(ClusterOp::CREATE_CHANNEL, channel);
+  }
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.database_channels = db.channelsFile();
   }
   if (db.ChannelExists(channel)) {
@@ -1086,24 +1576,195 @@ bool Server::addChannelOnServer(std::string &channel) {
     return false;
   }
   {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<MeteredMutex> lock(dbMutex);
     db.addChannel(channel);
   }
   std::cout << "A new channel has been created: " << channel << std::endl;
   return true;
 }
 
+bool Server::deleteChannelOnServer(std::string &channel) {
+  if (!cluster.ownsChannel(channel)) {
+    return requestChannelChange(ClusterOp::DELETE_CHANNEL, channel);
+  }
+  db.deleteChannel(channel);
+  return removeMembersFromDeleteChannel(channel);
+}
+
+bool Server::requestChannelChange(ClusterOp op, const std::string &channel) {
+  const std::string &owner = cluster.ownerOf(channel);
+  Message reply;
+  std::vector<std::string> fields;
+  if (!cluster.request(owner, clusterMessage(op, {channel}), reply) ||
+      !readFields(reply.body, fields) || fields.size() != 1) {
+    std::cout << "Channel node " << owner << " is unavailable." << std::endl;
+    return false;
+  }
+  std::cout << "Node " << owner << ": " << fields[0] << std::endl;
+  return true;
+}
+
+std::string Server::listChannels() {
+  std::string output = db.listOfChannelsOnServer();
+  const std::string empty = "No existing channels.\n";
+  if (output == empty) {
+    output.clear();
+  }
+  for (const std::string &peer : cluster.peers()) {
+    Message reply;
+    std::vector<std::string> fields;
+    if (!cluster.request(peer, clusterMessage(ClusterOp::CHANNELS, {}),
+                         reply) ||
+        !readFields(reply.body, fields) || fields.size() != 1) {
+      output += "Node " + peer + " is unavailable\n";
+    } else if (fields[0] != empty) {
+      output += fields[0];
+    }
+  }
+  return output.empty() ? empty : output;
+}
+
+std::string Server::runChannelCommand(const CommandEntry &entry,
+                                      const CommandTokens &words,
+                                      const std::string &command,
+                                      User &user) {
+  if (words.size() < 2 || cluster.ownsChannel(words[1])) {
+    return entry.handler->handleCommand(words, db, user);
+  }
+  // Владелец хранит участников и историю; пользователь для него - заглушка
+  // с тем же UUID и ником
+  const std::string &owner = cluster.ownerOf(words[1]);
+  Message reply;
+  std::vector<std::string> fields;
+  if (!cluster.request(owner,
+                       clusterMessage(ClusterOp::COMMAND,
+                                      {user.id, user.nickname,
+                                       user.timeFlag ? "1" : "0", command}),
+                       reply) ||
+      !readFields(reply.body, fields) || fields.size() != 1) {
+    addCounter(Counter::CLUSTER_FORWARD_FAILED);
+    return "Channel node " + owner + " is unavailable, try again later";
+  }
+  addCounter(Counter::CLUSTER_FORWARDED);
+  return fields[0];
+}
+
+Message Server::handleClusterMessage(const Message &message) {
+  std::vector<std::string> fields;
+  if (!readFields(message.body, fields)) {
+    logMessage("Malformed cluster frame", SERVER_LOG_FILE);
+    return clusterMessage(ClusterOp::REPLY, {"Malformed request"});
+  }
+  std::string answer;
+  switch (static_cast<ClusterOp>(message.header.flag)) {
+    case ClusterOp::COMMAND: {
+      if (fields.size() != 4) {
+        answer = "Malformed request";
+        break;
+      }
+      User user;
+      user.id = fields[0];
+      user.nickname = fields[1];
+      user.timeFlag = fields[2] == "1";
+      {
+        std::lock_guard<MeteredMutex> lock(dbMutex);
+        user.localId = db.addRemoteUser(user.id, user.nickname);
+      }
+      CommandTokens words;
+      tokenizeCommand(fields[3], words);
+      const CommandEntry *entry =
+          words.size() != 0 ? findCommand(words[0]) : nullptr;
+      // Через узлы передаются только команды канала и только от имени
+      // пользователей других узлов: свою учётную запись сосед не подменит
+      if (user.localId == INVALID_LOCAL_ID ||
+          db.userRegistry.hasLogin(user.localId) || entry == nullptr ||
+          entry->handler == nullptr || entry->id == CommandId::NICK) {
+        answer = "Wrong command";
+        break;
+      }
+      answer = entry->handler->handleCommand(words, db, user);
+      break;
+    }
+    case ClusterOp::CHANNELS:
+      answer = db.listOfChannelsOnServer();
+      break;
+    case ClusterOp::CREATE_CHANNEL:
+    case ClusterOp::DELETE_CHANNEL:
+      if (fields.size() != 1 || !cluster.ownsChannel(fields[0])) {
+        answer = "Channel is not hosted on this node";
+      } else if (static_cast<ClusterOp>(message.header.flag) ==
+                     ClusterOp::CREATE_CHANNEL &&
+                 message.header.requestId == 0) {
+        // Кадр CHANNEL клиента другого узла: как channelMessage, без консоли
+        {
+          std::lock_guard<MeteredMutex> lock(dbMutex);
+          db.database_channels = db.channelsFile();
+        }
+        if (!db.ChannelExists(fields[0])) {
+          std::lock_guard<MeteredMutex> lock(dbMutex);
+          db.addChannel(fields[0]);
+          logMessage("Channel created: " + fields[0], SERVER_LOG_FILE);
+        }
+      } else if (static_cast<ClusterOp>(message.header.flag) ==
+                 ClusterOp::CREATE_CHANNEL) {
+        answer = addChannelOnServer(fields[0]) ? "Channel created"
+                                               : "Channel already exists";
+      } else {
+        answer = deleteChannelOnServer(fields[0]) ? "Channel removed"
+                                                  : "Channel not removed";
+      }
+      break;
+    case ClusterOp::VOICE: {
+      if (fields.size() != 3 || !cluster.ownsChannel(fields[0])) {
+        break;
+      }
+      Message voiceMessage;
+      voiceMessage.header.type = DataType::VOICE;
+      voiceMessage.body.assign(fields[2].begin(), fields[2].end());
+      voiceMessage.header.size = voiceMessage.body.size();
+      deliverToMembers(db.channelMembers(fields[0]), voiceMessage, fields[1]);
+      break;
+    }
+    case ClusterOp::DELIVER: {
+      if (fields.size() < 4) {
+        break;
+      }
+      Message delivered;
+      unsigned long type = std::strtoul(fields[0].c_str(), nullptr, 10);
+      delivered.header.type =
+          type < DataType::BATCH ? static_cast<DataType>(type) : DataType::TEXT;
+      delivered.header.flag =
+          static_cast<uint32_t>(std::strtoul(fields[1].c_str(), nullptr, 10));
+      delivered.body.assign(fields[3].begin(), fields[3].end());
+      delivered.header.size = delivered.body.size();
+      std::unordered_set<LocalId> recipients;
+      for (size_t i = 4; i < fields.size(); ++i) {
+        LocalId recipient = db.userRegistry.find(fields[i]);
+        if (recipient != INVALID_LOCAL_ID) {
+          recipients.insert(recipient);
+        }
+      }
+      presence.sendToMany(recipients, delivered,
+                          fields[2].empty() ? INVALID_LOCAL_ID
+                                            : db.userRegistry.find(fields[2]));
+      break;
+    }
+    default:
+      logMessage("Unknown cluster operation " +
+                     std::to_string(message.header.flag),
+                 SERVER_LOG_FILE);
+      break;
+  }
+  return clusterMessage(ClusterOp::REPLY, {answer});
+}
+
 bool Server::removeMembersFromDeleteChannel(std::string &channel) {
   Message message;
-  message = flagOn(message, Flags::DEL_CHANNEL);
-  {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    db.database_channels_members = db.channelsMembersFile(channel);
-    db.database_names = db.nicknamesFile();
-  }
+  std::unordered_set<LocalId> members = db.channelMembers(channel);
+  db.dropChannelMembers(channel);
   std::string pathMembers = "channels/members/" + channel + "_members.txt";
   std::string pathHistory = "channels/history/" + channel + "_history.txt";
-  if (db.database_channels_members.empty()) {
+  if (members.empty()) {
     std::cout << "No members in this channel. Removing channel..." << std::endl;
     if (db.removeChannelFiles(pathMembers, pathHistory)) {
       std::cout << "Channel removed." << std::endl;
@@ -1113,15 +1774,8 @@ bool Server::removeMembersFromDeleteChannel(std::string &channel) {
   std::string notification =
       "Channel " + channel + " removed on server. You exit from channel.";
 
-  for (std::string id : db.database_channels_members) {
-    for (User &user : db.database_names) {
-      if (id == user.id) {
-        message = flagOn(message, Flags::DEL_CHANNEL);
-        serverSocket.sendMessage(stringToMessage(notification, message),
-                                 std::stoi(user.socketNumber));
-      }
-    }
-  }
+  message = flagOn(message, Flags::DEL_CHANNEL);
+  deliverToMembers(members, stringToMessage(notification, message), "");
   if (db.removeChannelFiles(pathMembers, pathHistory)) {
     std::cout << "Notifications have been sent to users. Channel removed."
               << std::endl;
@@ -1149,7 +1803,7 @@ void serverCommand(int port, Server &server) {
         continue;
       }
       logMessage("Server command: /channels", SERVER_LOG_FILE);
-      std::cout << server.db.listOfChannelsOnServer() << std::endl;
+      std::cout << server.listChannels() << std::endl;
     } else if (words[0] == "/add_channel") {
       logMessage("Server command: /add_channel", SERVER_LOG_FILE);
       if (words.size() != 2) {
@@ -1165,14 +1819,85 @@ void serverCommand(int port, Server &server) {
         continue;
       }
       logMessage("Server command: /del_channel", SERVER_LOG_FILE);
-      server.db.deleteChannel(words[1]);
-      server.removeMembersFromDeleteChannel(words[1]);
+      server.deleteChannelOnServer(words[1]);
+    } else if (words[0] == "/cache_stats") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      std::cout << server.db.historyCache.stats() << std::endl;
+    } else if (words[0] == "/blob_stats") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      std::cout << server.db.blobStore.stats() << std::endl;
+      std::cout << server.transcoder.stats() << std::endl;
+    } else if (words[0] == "/auth_stats") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      std::cout << server.authPool.stats() << std::endl;
+    } else if (words[0] == "/stats") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      std::cout << metricsReport() << std::endl;
+    } else if (words[0] == "/reindex_audio") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      logMessage("Server command: /reindex_audio", SERVER_LOG_FILE);
+      std::cout << server.reindexAudio() << std::endl;
+    } else if (words[0] == "/cluster") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      std::cout << server.cluster.status() << std::endl;
+    } else if (words[0] == "/snapshot") {
+      if (words.size() != 1) {
+        std::cout << "Wrong command, use /help" << std::endl;
+        continue;
+      }
+      logMessage("Server command: /snapshot", SERVER_LOG_FILE);
+      std::cout << (server.db.saveSnapshot(server.dbMutex)
+                        ? "Snapshot saved."
+                        : "Failed to save snapshot.")
+                << std::endl;
     } else {
       std::cout << "Wrong command, use /help" << std::endl;
     }
   }
 }
 
+void snapshotLoop(Server &server) {
+  int elapsed = 0;
+  while (server.serverRunning) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (++elapsed >= SNAPSHOT_INTERVAL_SEC) {
+      server.db.saveSnapshot(server.dbMutex);
+      elapsed = 0;
+    }
+  }
+}
+
+void metricsDumpLoop(Server &server) {
+  int elapsed = 0;
+  while (server.serverRunning) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (++elapsed >= METRICS_DUMP_INTERVAL_SEC) {
+      if (!dumpMetrics(METRICS_DUMP_FILE)) {
+        logMessage("Failed to write " METRICS_DUMP_FILE, SERVER_LOG_FILE);
+      }
+      elapsed = 0;
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   Server server;
   globalServer = &server;
@@ -1183,13 +1908,31 @@ int main(int argc, char *argv[]) {
   }
 
   if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
+    std::cerr << "Usage: " << argv[0]
+              << " <port> [admin_port] [cluster_file node_id]" << std::endl;
     exit(1);
   }
 
   int port = std::atoi(argv[1]);
+  // 0 отключает порт метрик
+  int adminPort = argc >= 3 ? std::atoi(argv[2]) : port + ADMIN_PORT_OFFSET;
 
   signal(SIGINT, signalHandlerServer);
+  // Оборванное соединение (клиент или узел кластера) - ошибка send, а не
+  // завершение процесса
+  signal(SIGPIPE, SIG_IGN);
+
+  if (argc == 5) {
+    std::string error;
+    if (!server.cluster.load(argv[3], argv[4], error)) {
+      std::cerr << "Cluster config error: " << error << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  } else if (argc > 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <port> [admin_port] [cluster_file node_id]" << std::endl;
+    exit(1);
+  }
 
   if (!server.serverSocket.createSocket()) {
     std::cerr << "socket failed" << std::endl;
@@ -1211,8 +1954,46 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  MySocket::setTrafficCounter(recordTraffic);
+  // Ошибка accept из-за нехватки дескрипторов останавливает сервер, поэтому
+  // отказываем раньше
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY) {
+    server.maxConnections = static_cast<int>(std::max<rlim_t>(
+        1, std::min<rlim_t>(MAX_CLIENT_CONNECTIONS,
+                            files.rlim_cur - std::min<rlim_t>(
+                                files.rlim_cur, CONNECTION_FD_RESERVE))));
+  }
+  if (adminPort > 0) {
+    if (server.admin.start(adminPort)) {
+      logMessage("Metrics on 127.0.0.1:" + std::to_string(adminPort) +
+                     "/metrics",
+                 SERVER_LOG_FILE);
+    } else {
+      std::cerr << "Failed to open admin port " << adminPort << std::endl;
+      logMessage("Admin port bind failed", SERVER_LOG_FILE);
+    }
+  }
+
+  if (server.cluster.enabled()) {
+    if (!server.cluster.start([&server](const Message &message) {
+          return server.handleClusterMessage(message);
+        })) {
+      std::cerr << "Failed to open cluster port" << std::endl;
+      logMessage("Cluster port bind failed", SERVER_LOG_FILE);
+      server.serverSocket.closeSocket();
+      exit(EXIT_FAILURE);
+    }
+    logMessage("Cluster node " + server.cluster.selfId() + " started",
+               SERVER_LOG_FILE);
+  }
+
   std::thread serverThread(serverCommand, port, std::ref(server));
   serverThread.detach();
+  std::thread snapshotThread(snapshotLoop, std::ref(server));
+  snapshotThread.detach();
+  std::thread metricsThread(metricsDumpLoop, std::ref(server));
+  metricsThread.detach();
 
   std::vector<std::thread> clientThreads;
 
@@ -1231,18 +2012,38 @@ int main(int argc, char *argv[]) {
         server.serverSocket.closeSocket();
         exit(EXIT_FAILURE);
       }
+    } else if (server.activeConnections.load(std::memory_order_relaxed) >=
+               server.maxConnections) {
+      // Отказ до создания потока: перегруженный сервер не тратит на клиента
+      // ни поток, ни чтение базы
+      logMessage("Connection rejected: limit reached", SERVER_LOG_FILE);
+      addCounter(Counter::CONNECTIONS_REJECTED);
+      MySocket rejected;
+      rejected.setSocket(clientSocket);
+      Message busy;
+      busy = flagOn(busy, Flags::THROTTLED);
+      rejected.sendMessage(
+          stringToMessage("Server is busy, try again later", busy));
     } else {
       logMessage("Connection established", SERVER_LOG_FILE);
+      addCounter(Counter::CONNECTIONS_ACCEPTED);
+      server.activeConnections.fetch_add(1, std::memory_order_relaxed);
       clientThreads.emplace_back(handleClient, clientSocket, std::ref(server));
     }
   }
 
+  server.cluster.stop();
+
   for (auto &thread : clientThreads) {
     if (thread.joinable()) {
       thread.join();
     }
   }
 
+  // Клиентские потоки завершены: снимок видит всех зарегистрированных
+  server.db.saveSnapshot(server.dbMutex);
+  dumpMetrics(METRICS_DUMP_FILE);
+
   server.serverSocket.closeSocket();
   std::cout << "Server shut down successfully." << std::endl;
   return 0;
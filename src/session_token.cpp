@@ -0,0 +1,100 @@
+#include "../include/session_token.hpp"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "../include/other.hpp"
+
+SessionTokens::SessionTokens() {
+  std::ifstream keyFile(SESSION_KEY_FILE, std::ios::binary);
+  key.assign(std::istreambuf_iterator<char>(keyFile),
+             std::istreambuf_iterator<char>());
+  if (key.size() == SESSION_KEY_SIZE) {
+    return;
+  }
+
+  key.resize(SESSION_KEY_SIZE);
+  if (RAND_bytes(reinterpret_cast<unsigned char *>(&key[0]),
+                 SESSION_KEY_SIZE) != 1) {
+    throw std::runtime_error("RAND_bytes failed");
+  }
+  std::filesystem::create_directories("./users/");
+  // Файл создаётся сразу с правами 0600: ключ не бывает доступен другим
+  // пользователям даже между созданием и записью
+  std::filesystem::remove(SESSION_KEY_FILE);
+  int fd = open(SESSION_KEY_FILE, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot create session key file");
+  }
+  size_t written = 0;
+  while (written < key.size()) {
+    ssize_t result = write(fd, key.data() + written, key.size() - written);
+    if (result <= 0) {
+      close(fd);
+      throw std::runtime_error("Cannot write session key file");
+    }
+    written += result;
+  }
+  close(fd);
+  logMessage("Session key created", SERVER_LOG_FILE);
+}
+
+std::string SessionTokens::sign(const std::string &payload) {
+  unsigned char mac[EVP_MAX_MD_SIZE];
+  unsigned int macLength = 0;
+  HMAC(EVP_sha256(), key.data(), key.size(),
+       reinterpret_cast<const unsigned char *>(payload.data()), payload.size(),
+       mac, &macLength);
+
+  std::ostringstream oss;
+  for (unsigned int i = 0; i < macLength; ++i) {
+    oss << std::hex << std::setw(2) << std::setfill('0')
+        << static_cast<int>(mac[i]);
+  }
+  return oss.str();
+}
+
+std::string SessionTokens::issue(const std::string &userId) {
+  std::string payload =
+      userId + "." + std::to_string(std::time(nullptr) + SESSION_TOKEN_TTL_SEC);
+  return payload + "." + sign(payload);
+}
+
+bool SessionTokens::verify(const std::string &token, std::string &userId) {
+  size_t signatureDot = token.rfind('.');
+  if (signatureDot == std::string::npos) {
+    return false;
+  }
+  std::string payload = token.substr(0, signatureDot);
+  std::string signature = token.substr(signatureDot + 1);
+  std::string expected = sign(payload);
+  if (signature.size() != expected.size() ||
+      CRYPTO_memcmp(signature.data(), expected.data(), expected.size()) != 0) {
+    return false;
+  }
+
+  size_t expiryDot = payload.rfind('.');
+  if (expiryDot == std::string::npos) {
+    return false;
+  }
+  try {
+    if (std::stoll(payload.substr(expiryDot + 1)) < std::time(nullptr)) {
+      return false;
+    }
+  } catch (const std::exception &e) {
+    return false;
+  }
+  userId = payload.substr(0, expiryDot);
+  return true;
+}
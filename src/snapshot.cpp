@@ -0,0 +1,93 @@
+#include "../include/snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+void SnapshotWriter::writeU32(uint32_t value) {
+  writeBytes(&value, sizeof(value));
+}
+
+void SnapshotWriter::writeU64(uint64_t value) {
+  writeBytes(&value, sizeof(value));
+}
+
+void SnapshotWriter::writeString(const std::string &value) {
+  writeU32(static_cast<uint32_t>(value.size()));
+  buffer.append(value);
+}
+
+void SnapshotWriter::writeBytes(const void *data, size_t size) {
+  buffer.append(static_cast<const char *>(data), size);
+}
+
+bool SnapshotWriter::commit(const std::string &path) {
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    file.write(buffer.data(), buffer.size());
+    if (!file) {
+      return false;
+    }
+  }
+  return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+SnapshotReader::SnapshotReader(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+      data = static_cast<const uint8_t *>(mapped);
+      size = st.st_size;
+    }
+  }
+  // Отображение остаётся действительным и после закрытия файла
+  close(fd);
+}
+
+SnapshotReader::~SnapshotReader() {
+  if (data != nullptr) {
+    munmap(const_cast<uint8_t *>(data), size);
+  }
+}
+
+bool SnapshotReader::readU32(uint32_t &value) {
+  return readBytes(&value, sizeof(value));
+}
+
+bool SnapshotReader::readU64(uint64_t &value) {
+  return readBytes(&value, sizeof(value));
+}
+
+bool SnapshotReader::readString(std::string &value) {
+  uint32_t length;
+  if (!readU32(length) || size - position < length) {
+    return false;
+  }
+  value.assign(reinterpret_cast<const char *>(data + position), length);
+  position += length;
+  return true;
+}
+
+bool SnapshotReader::readBytes(void *out, size_t count) {
+  if (data == nullptr || size - position < count) {
+    return false;
+  }
+  std::memcpy(out, data + position, count);
+  position += count;
+  return true;
+}
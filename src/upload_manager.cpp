@@ -0,0 +1,189 @@
+#include "../include/upload_manager.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+UploadManager::UploadManager() : random(std::random_device{}()) {
+  std::error_code ec;
+  std::filesystem::remove_all(UPLOAD_DIRECTORY, ec);
+  std::filesystem::create_directories(UPLOAD_DIRECTORY, ec);
+}
+
+void UploadManager::expireLocked(std::time_t now) {
+  for (auto it = uploads.begin(); it != uploads.end();) {
+    if (!it->second.writing &&
+        now - it->second.lastActivity > UPLOAD_IDLE_TIMEOUT_SEC) {
+      std::remove(it->second.partPath.c_str());
+      it = uploads.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool UploadManager::begin(LocalId owner, const std::string &body,
+                          Upload &upload, std::string &error) {
+  std::istringstream iss(body);
+  std::string kind, size, resumeId;
+  Upload request;
+  if (!std::getline(iss, kind) || !std::getline(iss, request.channel) ||
+      !std::getline(iss, request.filename) || !std::getline(iss, size)) {
+    error = "Malformed upload request";
+    return false;
+  }
+  std::getline(iss, resumeId);
+  try {
+    request.totalSize = std::stoull(size);
+    request.id = resumeId.empty() ? 0 : std::stoull(resumeId);
+  } catch (const std::exception &e) {
+    error = "Malformed upload request";
+    return false;
+  }
+  if (kind != "file" && kind != "audio") {
+    error = "Unknown upload kind";
+    return false;
+  }
+  request.kind = kind == "audio" ? UploadKind::AUDIO : UploadKind::FILE;
+  // Имя файла без каталогов
+  request.filename =
+      std::filesystem::path(request.filename).filename().string();
+  if (request.filename.empty() || request.channel.empty()) {
+    error = "Malformed upload request";
+    return false;
+  }
+  if (request.totalSize > UPLOAD_MAX_SIZE) {
+    error = "File is too large";
+    return false;
+  }
+  if (request.kind == UploadKind::AUDIO &&
+      request.totalSize > UPLOAD_AUDIO_MAX_SIZE) {
+    error = "Voicemail is too large";
+    return false;
+  }
+
+  std::time_t now = std::time(nullptr);
+  std::lock_guard<std::mutex> lock(uploadsMutex);
+  expireLocked(now);
+
+  if (request.id != 0) {
+    auto it = uploads.find(request.id);
+    if (it != uploads.end() && it->second.owner == owner &&
+        it->second.kind == request.kind &&
+        it->second.channel == request.channel &&
+        it->second.totalSize == request.totalSize &&
+        it->second.filename == request.filename && !it->second.writing) {
+      // Хвост после последнего подтверждения мог записаться не целиком
+      std::error_code ec;
+      std::filesystem::resize_file(it->second.partPath, it->second.received,
+                                   ec);
+      it->second.lastActivity = now;
+      upload = it->second;
+      return true;
+    }
+    // Неизвестную загрузку начинаем заново
+  }
+
+  size_t active = 0;
+  for (const auto &[id, existing] : uploads) {
+    active += existing.owner == owner;
+  }
+  if (active >= UPLOAD_MAX_PER_USER) {
+    error = "Too many unfinished uploads";
+    return false;
+  }
+
+  do {
+    request.id = random();
+  } while (request.id == 0 || uploads.count(request.id) != 0);
+  request.owner = owner;
+  request.hash = std::make_shared<Sha256>();
+  request.partPath = UPLOAD_DIRECTORY + std::to_string(request.id) + ".part";
+  request.lastActivity = now;
+  std::ofstream part(request.partPath, std::ios::binary | std::ios::trunc);
+  if (!part.is_open()) {
+    error = "Failed to create upload file";
+    return false;
+  }
+  upload = request;
+  uploads.emplace(request.id, std::move(request));
+  return true;
+}
+
+bool UploadManager::writeChunk(LocalId owner, const Message &chunk,
+                               uint64_t &uploadId, uint64_t &received,
+                               std::string &error) {
+  uint64_t offset;
+  const uint8_t *data;
+  size_t size;
+  if (!chunk.getUploadChunk(uploadId, offset, data, size)) {
+    error = "Malformed upload chunk";
+    return false;
+  }
+
+  std::string partPath;
+  std::shared_ptr<Sha256> hash;
+  {
+    std::lock_guard<std::mutex> lock(uploadsMutex);
+    auto it = uploads.find(uploadId);
+    if (it == uploads.end() || it->second.owner != owner) {
+      error = "Unknown upload";
+      return false;
+    }
+    Upload &upload = it->second;
+    received = upload.received;
+    // Повтор или пропуск - клиент продолжит с received
+    if (upload.writing || offset != upload.received) {
+      return true;
+    }
+    if (upload.received + size > upload.totalSize) {
+      error = "Upload exceeds declared size";
+      return false;
+    }
+    upload.writing = true;
+    partPath = upload.partPath;
+    hash = upload.hash;
+    received = upload.received;
+  }
+
+  // Запись и хеширование идут без блокировки, другие загрузки не ждут диска
+  std::ofstream part(partPath, std::ios::binary | std::ios::app);
+  part.write(reinterpret_cast<const char *>(data), size);
+  part.close();
+  bool written = !part.fail();
+  if (written) {
+    hash->update(data, size);
+  } else {
+    std::error_code ec;
+    std::filesystem::resize_file(partPath, received, ec);
+  }
+
+  std::lock_guard<std::mutex> lock(uploadsMutex);
+  Upload &upload = uploads[uploadId];
+  upload.writing = false;
+  upload.lastActivity = std::time(nullptr);
+  if (!written) {
+    error = "Failed to write upload";
+    return false;
+  }
+  upload.received += size;
+  received = upload.received;
+  return true;
+}
+
+bool UploadManager::finish(LocalId owner, uint64_t uploadId, Upload &upload,
+                           std::string &error) {
+  std::lock_guard<std::mutex> lock(uploadsMutex);
+  auto it = uploads.find(uploadId);
+  if (it == uploads.end() || it->second.owner != owner) {
+    error = "Unknown upload";
+    return false;
+  }
+  if (it->second.writing || it->second.received != it->second.totalSize) {
+    error = "Upload is incomplete";
+    return false;
+  }
+  upload = std::move(it->second);
+  uploads.erase(it);
+  return true;
+}
@@ -0,0 +1,207 @@
+#include "../include/user_registry.hpp"
+
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <cctype>
+
+bool parseUuid(const std::string &text, boost::uuids::uuid &uuid) {
+  if (text.size() != 36) {
+    return false;
+  }
+  try {
+    uuid = boost::uuids::string_generator()(text);
+  } catch (const std::exception &e) {
+    return false;
+  }
+  return true;
+}
+
+LocalId UserRegistry::intern(const boost::uuids::uuid &uuid) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  auto it = localIds.find(uuid);
+  if (it != localIds.end()) {
+    return it->second;
+  }
+  LocalId localId = static_cast<LocalId>(uuids.size());
+  uuids.push_back(uuid);
+  nicknames.emplace_back();
+  logins.emplace_back();
+  localIds.emplace(uuid, localId);
+  return localId;
+}
+
+LocalId UserRegistry::find(const std::string &text) {
+  boost::uuids::uuid uuid;
+  if (!parseUuid(text, uuid)) {
+    return INVALID_LOCAL_ID;
+  }
+  std::lock_guard<std::mutex> lock(registryMutex);
+  auto it = localIds.find(uuid);
+  return it != localIds.end() ? it->second : INVALID_LOCAL_ID;
+}
+
+LocalId UserRegistry::parseStored(const std::string &text) {
+  if (text.empty() || text.size() > 10) {
+    return find(text);
+  }
+  // Десять цифр не помещаются в uint32_t
+  uint64_t localId = 0;
+  for (char c : text) {
+    if (!std::isdigit(static_cast<unsigned char>(c))) {
+      return INVALID_LOCAL_ID;
+    }
+    localId = localId * 10 + (c - '0');
+  }
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return localId < uuids.size() ? static_cast<LocalId>(localId)
+                                : INVALID_LOCAL_ID;
+}
+
+std::string UserRegistry::toString(LocalId localId) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (localId >= uuids.size()) {
+    return "";
+  }
+  return boost::uuids::to_string(uuids[localId]);
+}
+
+void UserRegistry::addToFilter(
+    BloomFilter &filter, const std::unordered_map<std::string, LocalId> &index,
+    const std::string &key) {
+  if (!filter.isFull()) {
+    filter.add(key);
+    return;
+  }
+  filter.reset(filter.capacity() * 2);
+  for (const auto &entry : index) {
+    filter.add(entry.first);
+  }
+}
+
+bool UserRegistry::existsIn(
+    const BloomFilter &filter,
+    const std::unordered_map<std::string, LocalId> &index,
+    const std::string &key) {
+  return filter.mightContain(key) && index.count(key) != 0;
+}
+
+void UserRegistry::setNickname(LocalId localId, const std::string &nickname) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (localId >= nicknames.size() || nicknames[localId] == nickname) {
+    return;
+  }
+  // Ник заглушки с другого узла не занимает ник на этом: регистрация и
+  // поиск по нику видят только свои учётные записи
+  if (logins[localId].empty()) {
+    nicknames[localId] = nickname;
+    return;
+  }
+  auto old = nicknameIndex.find(nicknames[localId]);
+  if (old != nicknameIndex.end() && old->second == localId) {
+    nicknameIndex.erase(old);
+  }
+  nicknames[localId] = nickname;
+  nicknameIndex[nickname] = localId;
+  addToFilter(nicknameFilter, nicknameIndex, nickname);
+}
+
+void UserRegistry::setLogin(LocalId localId, const std::string &login) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (localId >= logins.size() || logins[localId] == login) {
+    return;
+  }
+  logins[localId] = login;
+  loginIndex[login] = localId;
+  addToFilter(loginFilter, loginIndex, login);
+}
+
+bool UserRegistry::hasLogin(LocalId localId) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return localId < logins.size() && !logins[localId].empty();
+}
+
+bool UserRegistry::loginExists(const std::string &login) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return existsIn(loginFilter, loginIndex, login);
+}
+
+LocalId UserRegistry::findNickname(const std::string &nickname) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  auto it = nicknameIndex.find(nickname);
+  return it != nicknameIndex.end() ? it->second : INVALID_LOCAL_ID;
+}
+
+bool UserRegistry::nicknameExists(const std::string &nickname) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return existsIn(nicknameFilter, nicknameIndex, nickname);
+}
+
+std::string UserRegistry::nickname(LocalId localId) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (localId >= nicknames.size()) {
+    return "";
+  }
+  return nicknames[localId];
+}
+
+size_t UserRegistry::size() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return uuids.size();
+}
+
+void UserRegistry::saveSnapshot(SnapshotWriter &writer) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  writer.writeU32(static_cast<uint32_t>(uuids.size()));
+  for (size_t i = 0; i < uuids.size(); ++i) {
+    writer.writeBytes(uuids[i].data, uuids[i].size());
+    writer.writeString(nicknames[i]);
+    writer.writeString(logins[i]);
+  }
+}
+
+bool UserRegistry::loadSnapshot(SnapshotReader &reader) {
+  uint32_t count;
+  if (!reader.readU32(count)) {
+    return false;
+  }
+  std::vector<boost::uuids::uuid> loadedUuids(count);
+  std::vector<std::string> loadedNicknames(count);
+  std::vector<std::string> loadedLogins(count);
+  std::unordered_map<boost::uuids::uuid, LocalId,
+                     boost::hash<boost::uuids::uuid>>
+      loadedIds;
+  std::unordered_map<std::string, LocalId> loadedLoginIndex;
+  std::unordered_map<std::string, LocalId> loadedNicknameIndex;
+  loadedIds.reserve(count);
+  loadedLoginIndex.reserve(count);
+  loadedNicknameIndex.reserve(count);
+  BloomFilter loadedLoginFilter(count * 2);
+  BloomFilter loadedNicknameFilter(count * 2);
+  for (LocalId localId = 0; localId < count; ++localId) {
+    if (!reader.readBytes(loadedUuids[localId].data,
+                          loadedUuids[localId].size()) ||
+        !reader.readString(loadedNicknames[localId]) ||
+        !reader.readString(loadedLogins[localId])) {
+      return false;
+    }
+    loadedIds.emplace(loadedUuids[localId], localId);
+    // Заглушки с других узлов, как в setLogin и setNickname, не ищутся
+    if (!loadedLogins[localId].empty()) {
+      loadedLoginIndex[loadedLogins[localId]] = localId;
+      loadedLoginFilter.add(loadedLogins[localId]);
+      loadedNicknameIndex[loadedNicknames[localId]] = localId;
+      loadedNicknameFilter.add(loadedNicknames[localId]);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  uuids = std::move(loadedUuids);
+  nicknames = std::move(loadedNicknames);
+  logins = std::move(loadedLogins);
+  localIds = std::move(loadedIds);
+  loginIndex = std::move(loadedLoginIndex);
+  nicknameIndex = std::move(loadedNicknameIndex);
+  loginFilter = std::move(loadedLoginFilter);
+  nicknameFilter = std::move(loadedNicknameFilter);
+  return true;
+}
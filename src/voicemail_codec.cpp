@@ -0,0 +1,214 @@
+#include "../include/voicemail_codec.hpp"
+
+#include <endian.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+void appendBytes(std::vector<uint8_t> &out, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  out.insert(out.end(), bytes, bytes + size);
+}
+
+bool opusSampleRate(int sampleRate) {
+  return sampleRate == 8000 || sampleRate == 12000 || sampleRate == 16000 ||
+         sampleRate == 24000 || sampleRate == 48000;
+}
+
+}  // namespace
+
+bool encodeVoicemail(const std::string &wavPath, std::vector<uint8_t> &encoded,
+                     std::string &error) {
+  SF_INFO info;
+  std::memset(&info, 0, sizeof(info));
+  SNDFILE *wav = sf_open(wavPath.c_str(), SFM_READ, &info);
+  if (!wav) {
+    error = "not a readable audio file";
+    return false;
+  }
+  if (!opusSampleRate(info.samplerate) || info.channels < 1 ||
+      info.channels > 2 || info.frames <= 0) {
+    sf_close(wav);
+    error = "unsupported format " + std::to_string(info.samplerate) + " Hz, " +
+            std::to_string(info.channels) + " channels";
+    return false;
+  }
+
+  int opusError;
+  OpusEncoder *encoder = opus_encoder_create(
+      info.samplerate, info.channels, OPUS_APPLICATION_VOIP, &opusError);
+  if (opusError != OPUS_OK) {
+    sf_close(wav);
+    error = opus_strerror(opusError);
+    return false;
+  }
+  opus_encoder_ctl(encoder, OPUS_SET_BITRATE(VOICEMAIL_OPUS_BITRATE_PER_CHANNEL *
+                                             info.channels));
+  opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+  opus_int32 preSkip = 0;
+  opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&preSkip));
+
+  encoded.clear();
+  appendBytes(encoded, VOICEMAIL_OPUS_MAGIC, 4);
+  encoded.push_back(VOICEMAIL_OPUS_VERSION);
+  encoded.push_back(static_cast<uint8_t>(info.channels));
+  uint16_t netPreSkip = htobe16(static_cast<uint16_t>(preSkip));
+  uint32_t netSampleRate = htobe32(static_cast<uint32_t>(info.samplerate));
+  uint64_t netFrames = htobe64(static_cast<uint64_t>(info.frames));
+  appendBytes(encoded, &netPreSkip, sizeof(netPreSkip));
+  appendBytes(encoded, &netSampleRate, sizeof(netSampleRate));
+  appendBytes(encoded, &netFrames, sizeof(netFrames));
+
+  // Кодируем кадры файла и ещё pre-skip кадров тишины, чтобы кодер
+  // выдал хвост, задержанный на время упреждения
+  const int frameSize = info.samplerate / VOICEMAIL_OPUS_FRAMES_PER_SECOND;
+  std::vector<opus_int16> pcm(frameSize * info.channels);
+  unsigned char packet[VOICEMAIL_OPUS_MAX_PACKET];
+  int64_t remaining = info.frames + preSkip;
+  bool ok = true;
+  while (remaining > 0) {
+    sf_count_t read = sf_readf_short(wav, pcm.data(), frameSize);
+    if (read < 0) {
+      read = 0;
+    }
+    std::fill(pcm.begin() + read * info.channels, pcm.end(), 0);
+    opus_int32 length = opus_encode(encoder, pcm.data(), frameSize, packet,
+                                    sizeof(packet));
+    if (length < 0) {
+      error = opus_strerror(length);
+      ok = false;
+      break;
+    }
+    uint16_t netLength = htobe16(static_cast<uint16_t>(length));
+    appendBytes(encoded, &netLength, sizeof(netLength));
+    appendBytes(encoded, packet, length);
+    remaining -= frameSize;
+  }
+
+  opus_encoder_destroy(encoder);
+  sf_close(wav);
+  return ok;
+}
+
+bool parseVoicemailHeader(const uint8_t *data, size_t size,
+                          VoicemailHeader &header) {
+  if (size < VOICEMAIL_OPUS_HEADER_SIZE ||
+      std::memcmp(data, VOICEMAIL_OPUS_MAGIC, 4) != 0 ||
+      data[4] != VOICEMAIL_OPUS_VERSION) {
+    return false;
+  }
+  header.channels = data[5];
+  uint16_t netPreSkip;
+  uint32_t netSampleRate;
+  uint64_t netFrames;
+  std::memcpy(&netPreSkip, data + 6, sizeof(netPreSkip));
+  std::memcpy(&netSampleRate, data + 8, sizeof(netSampleRate));
+  std::memcpy(&netFrames, data + 12, sizeof(netFrames));
+  header.preSkip = be16toh(netPreSkip);
+  header.sampleRate = static_cast<int>(be32toh(netSampleRate));
+  header.frames = be64toh(netFrames);
+  return opusSampleRate(header.sampleRate) && header.channels >= 1 &&
+         header.channels <= 2;
+}
+
+bool decodeVoicemail(const std::vector<uint8_t> &encoded,
+                     std::vector<int16_t> &pcm, int &sampleRate,
+                     int &channels) {
+  VoicemailHeader header;
+  if (!parseVoicemailHeader(encoded.data(), encoded.size(), header)) {
+    return false;
+  }
+  channels = header.channels;
+  sampleRate = header.sampleRate;
+  size_t preSkip = header.preSkip;
+  uint64_t frames = header.frames;
+
+  int opusError;
+  OpusDecoder *decoder = opus_decoder_create(sampleRate, channels, &opusError);
+  if (opusError != OPUS_OK) {
+    return false;
+  }
+  const int frameSize = sampleRate / VOICEMAIL_OPUS_FRAMES_PER_SECOND;
+  std::vector<opus_int16> frame(frameSize * channels);
+  pcm.clear();
+  pcm.reserve((frames + preSkip) * channels);
+
+  size_t offset = VOICEMAIL_OPUS_HEADER_SIZE;
+  bool ok = true;
+  while (offset + sizeof(uint16_t) <= encoded.size()) {
+    uint16_t netLength;
+    std::memcpy(&netLength, encoded.data() + offset, sizeof(netLength));
+    size_t length = be16toh(netLength);
+    offset += sizeof(netLength);
+    if (offset + length > encoded.size()) {
+      ok = false;
+      break;
+    }
+    int decoded = opus_decode(decoder, encoded.data() + offset,
+                              static_cast<opus_int32>(length), frame.data(),
+                              frameSize, 0);
+    if (decoded < 0) {
+      ok = false;
+      break;
+    }
+    pcm.insert(pcm.end(), frame.begin(), frame.begin() + decoded * channels);
+    offset += length;
+  }
+  opus_decoder_destroy(decoder);
+
+  // Отбрасываем задержку кодера и дополнение последнего пакета
+  size_t skip = std::min(preSkip * channels, pcm.size());
+  pcm.erase(pcm.begin(), pcm.begin() + skip);
+  if (pcm.size() > frames * channels) {
+    pcm.resize(frames * channels);
+  }
+  return ok;
+}
+
+double encodedVoicemailDuration(const std::string &path) {
+  uint8_t data[VOICEMAIL_OPUS_HEADER_SIZE];
+  std::ifstream file(path, std::ios::binary);
+  VoicemailHeader header;
+  if (!file.read(reinterpret_cast<char *>(data), sizeof(data)) ||
+      !parseVoicemailHeader(data, sizeof(data), header)) {
+    return 0.0;
+  }
+  return static_cast<double>(header.frames) / header.sampleRate;
+}
+
+std::vector<uint8_t> pcmToWav(const std::vector<int16_t> &pcm, int sampleRate,
+                              int channels) {
+  uint32_t dataSize = static_cast<uint32_t>(pcm.size() * sizeof(int16_t));
+  uint32_t riffSize = htole32(36 + dataSize);
+  uint32_t fmtSize = htole32(16);
+  uint16_t format = htole16(1);  // PCM
+  uint16_t numChannels = htole16(static_cast<uint16_t>(channels));
+  uint32_t rate = htole32(static_cast<uint32_t>(sampleRate));
+  uint32_t byteRate = htole32(sampleRate * channels * sizeof(int16_t));
+  uint16_t blockAlign = htole16(channels * sizeof(int16_t));
+  uint16_t bitsPerSample = htole16(16);
+  uint32_t netDataSize = htole32(dataSize);
+
+  std::vector<uint8_t> wav;
+  wav.reserve(44 + dataSize);
+  appendBytes(wav, "RIFF", 4);
+  appendBytes(wav, &riffSize, sizeof(riffSize));
+  appendBytes(wav, "WAVEfmt ", 8);
+  appendBytes(wav, &fmtSize, sizeof(fmtSize));
+  appendBytes(wav, &format, sizeof(format));
+  appendBytes(wav, &numChannels, sizeof(numChannels));
+  appendBytes(wav, &rate, sizeof(rate));
+  appendBytes(wav, &byteRate, sizeof(byteRate));
+  appendBytes(wav, &blockAlign, sizeof(blockAlign));
+  appendBytes(wav, &bitsPerSample, sizeof(bitsPerSample));
+  appendBytes(wav, "data", 4);
+  appendBytes(wav, &netDataSize, sizeof(netDataSize));
+  for (int16_t sample : pcm) {
+    uint16_t littleSample = htole16(static_cast<uint16_t>(sample));
+    appendBytes(wav, &littleSample, sizeof(littleSample));
+  }
+  return wav;
+}
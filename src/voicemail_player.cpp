@@ -0,0 +1,424 @@
+#include "../include/voicemail_player.hpp"
+
+#include <endian.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "../include/voicemail_codec.hpp"
+
+static std::mutex portAudioMutex;
+static int portAudioUsers = 0;
+
+PaError acquirePortAudio() {
+  std::lock_guard<std::mutex> lock(portAudioMutex);
+  if (portAudioUsers == 0) {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+      return err;
+    }
+  }
+  ++portAudioUsers;
+  return paNoError;
+}
+
+void releasePortAudio() {
+  std::lock_guard<std::mutex> lock(portAudioMutex);
+  if (portAudioUsers > 0 && --portAudioUsers == 0) {
+    Pa_Terminate();
+  }
+}
+
+SampleRing::SampleRing(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  buffer.resize(size);
+  mask = size - 1;
+}
+
+size_t SampleRing::write(const int16_t *data, size_t count) {
+  size_t writePosition = head.load(std::memory_order_relaxed);
+  size_t readPosition = tail.load(std::memory_order_acquire);
+  count = std::min(count, buffer.size() - (writePosition - readPosition));
+  for (size_t i = 0; i < count; ++i) {
+    buffer[(writePosition + i) & mask] = data[i];
+  }
+  head.store(writePosition + count, std::memory_order_release);
+  return count;
+}
+
+size_t SampleRing::read(int16_t *data, size_t count) {
+  size_t readPosition = tail.load(std::memory_order_relaxed);
+  size_t writePosition = head.load(std::memory_order_acquire);
+  count = std::min(count, writePosition - readPosition);
+  for (size_t i = 0; i < count; ++i) {
+    data[i] = buffer[(readPosition + i) & mask];
+  }
+  tail.store(readPosition + count, std::memory_order_release);
+  return count;
+}
+
+size_t SampleRing::available() const {
+  return head.load(std::memory_order_acquire) -
+         tail.load(std::memory_order_acquire);
+}
+
+VoiceOutput::VoiceOutput(int rate, int channelCount)
+    : sampleRate(rate),
+      channels(channelCount),
+      ring(static_cast<size_t>(rate) * channelCount * VOICE_RING_MS / 1000) {}
+
+VoiceOutput::~VoiceOutput() {
+  if (stream == nullptr) {
+    return;
+  }
+  Pa_StopStream(stream);
+  Pa_CloseStream(stream);
+  releasePortAudio();
+  if (dropped > 0) {
+    std::cout << "Voice frames dropped as late: " << dropped << std::endl;
+  }
+}
+
+bool VoiceOutput::open() {
+  PaError err = acquirePortAudio();
+  if (err != paNoError) {
+    std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+    unavailable = true;
+    return false;
+  }
+  PaStreamParameters outputParameters;
+  outputParameters.device = Pa_GetDefaultOutputDevice();
+  if (outputParameters.device == paNoDevice) {
+    std::cerr << "Error: No default output device." << std::endl;
+    releasePortAudio();
+    unavailable = true;
+    return false;
+  }
+  outputParameters.channelCount = channels;
+  outputParameters.sampleFormat = paInt16;
+  outputParameters.suggestedLatency =
+      Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
+  outputParameters.hostApiSpecificStreamInfo = NULL;
+  err = Pa_OpenStream(&stream, NULL, &outputParameters, sampleRate,
+                      VOICEMAIL_OUTPUT_FRAMES, paClipOff, playbackCallback,
+                      this);
+  if (err == paNoError) {
+    err = Pa_StartStream(stream);
+    if (err != paNoError) {
+      Pa_CloseStream(stream);
+    }
+  }
+  if (err != paNoError) {
+    std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+    stream = nullptr;
+    releasePortAudio();
+    unavailable = true;
+    return false;
+  }
+  return true;
+}
+
+bool VoiceOutput::play(const int16_t *samples, size_t count) {
+  if (stream == nullptr && (unavailable || !open())) {
+    return false;
+  }
+  size_t maxLag = static_cast<size_t>(sampleRate) * channels *
+                  VOICE_MAX_LAG_MS / 1000;
+  if (ring.available() > maxLag) {
+    ++dropped;
+    return false;
+  }
+  // Буфер больше допустимой задержки, лишнее не поместится только у
+  // кадра длиннее VOICE_RING_MS - VOICE_MAX_LAG_MS
+  ring.write(samples, count - count % channels);
+  return true;
+}
+
+int VoiceOutput::playbackCallback(const void *input, void *output,
+                                  unsigned long frameCount,
+                                  const PaStreamCallbackTimeInfo *timeInfo,
+                                  PaStreamCallbackFlags statusFlags,
+                                  void *userData) {
+  VoiceOutput *voice = static_cast<VoiceOutput *>(userData);
+  int16_t *samples = static_cast<int16_t *>(output);
+  size_t wanted = frameCount * voice->channels;
+  size_t got = voice->ring.read(samples, wanted);
+  // Между кадрами - тишина
+  std::fill(samples + got, samples + wanted, 0);
+  return paContinue;
+}
+
+VoicemailPlayer::~VoicemailPlayer() { stop(); }
+
+void VoicemailPlayer::expect(const std::string &directory) {
+  std::lock_guard<std::mutex> lock(streamMutex);
+  pendingSaveDirectory = directory;
+  requested = std::chrono::steady_clock::now();
+}
+
+bool VoicemailPlayer::begin(const std::string &header) {
+  stop();
+  std::lock_guard<std::mutex> lock(streamMutex);
+
+  std::istringstream iss(header);
+  std::string codec;
+  skipFrames = 0;
+  if (!(iss >> id >> codec >> sampleRate >> channels >> totalFrames) ||
+      (codec != VOICEMAIL_CODEC_NAME && codec != "pcm") || sampleRate <= 0 ||
+      channels < 1 || channels > 2) {
+    std::cerr << "Invalid voicemail stream header: " << header << std::endl;
+    return false;
+  }
+  iss >> skipFrames;
+  opusCodec = codec == VOICEMAIL_CODEC_NAME;
+  if (opusCodec) {
+    int error;
+    decoder = opus_decoder_create(sampleRate, channels, &error);
+    if (error != OPUS_OK) {
+      std::cerr << "Failed to create Opus decoder: " << opus_strerror(error)
+                << std::endl;
+      decoder = nullptr;
+      return false;
+    }
+  }
+
+  ring = std::make_unique<SampleRing>(static_cast<size_t>(sampleRate) *
+                                      channels * VOICEMAIL_RING_SECONDS);
+  {
+    std::lock_guard<std::mutex> chunksLock(chunksMutex);
+    chunks.clear();
+    finished = false;
+  }
+  stopping = false;
+  heard = false;
+  saveDirectory = pendingSaveDirectory;
+  pendingSaveDirectory.clear();
+  playbackRequested = requested;
+
+  // Без устройства вывода сообщение всё равно можно сохранить
+  PaError err = acquirePortAudio();
+  PaStreamParameters outputParameters;
+  if (err == paNoError) {
+    outputParameters.device = Pa_GetDefaultOutputDevice();
+    if (outputParameters.device == paNoDevice) {
+      std::cerr << "Error: No default output device." << std::endl;
+      releasePortAudio();
+      err = paNoDevice;
+    }
+  }
+  if (err == paNoError) {
+    outputParameters.channelCount = channels;
+    outputParameters.sampleFormat = paInt16;
+    outputParameters.suggestedLatency =
+        Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+    err = Pa_OpenStream(&stream, NULL, &outputParameters, sampleRate,
+                        VOICEMAIL_OUTPUT_FRAMES, paClipOff, playbackCallback,
+                        this);
+    if (err == paNoError) {
+      err = Pa_StartStream(stream);
+      if (err != paNoError) {
+        Pa_CloseStream(stream);
+      }
+    }
+    if (err != paNoError) {
+      std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+      stream = nullptr;
+      releasePortAudio();
+    }
+  }
+
+  decodeThread = std::thread(&VoicemailPlayer::decodeLoop, this);
+  return true;
+}
+
+void VoicemailPlayer::push(std::vector<uint8_t> chunk) {
+  {
+    std::lock_guard<std::mutex> lock(chunksMutex);
+    chunks.push_back(std::move(chunk));
+  }
+  chunksCondition.notify_one();
+}
+
+void VoicemailPlayer::end() {
+  {
+    std::lock_guard<std::mutex> lock(chunksMutex);
+    finished = true;
+  }
+  chunksCondition.notify_one();
+}
+
+bool VoicemailPlayer::playPcm(const std::string &audioId,
+                              const std::vector<int16_t> &pcm, int rate,
+                              int channelCount) {
+  if (!begin(audioId + " pcm " + std::to_string(rate) + " " +
+             std::to_string(channelCount) + " " +
+             std::to_string(pcm.size() / channelCount))) {
+    return false;
+  }
+  std::vector<uint8_t> bytes(pcm.size() * sizeof(int16_t));
+  for (size_t i = 0; i < pcm.size(); ++i) {
+    uint16_t sample = htole16(static_cast<uint16_t>(pcm[i]));
+    std::memcpy(bytes.data() + i * sizeof(int16_t), &sample, sizeof(sample));
+  }
+  push(std::move(bytes));
+  end();
+  return true;
+}
+
+void VoicemailPlayer::stop() {
+  std::lock_guard<std::mutex> lock(streamMutex);
+  stopping = true;
+  chunksCondition.notify_all();
+  if (decodeThread.joinable()) {
+    decodeThread.join();
+  }
+  closeStream();
+  if (decoder != nullptr) {
+    opus_decoder_destroy(decoder);
+    decoder = nullptr;
+  }
+}
+
+void VoicemailPlayer::closeStream() {
+  if (stream == nullptr) {
+    return;
+  }
+  Pa_StopStream(stream);
+  Pa_CloseStream(stream);
+  releasePortAudio();
+  stream = nullptr;
+}
+
+int VoicemailPlayer::playbackCallback(const void *input, void *output,
+                                      unsigned long frameCount,
+                                      const PaStreamCallbackTimeInfo *timeInfo,
+                                      PaStreamCallbackFlags statusFlags,
+                                      void *userData) {
+  VoicemailPlayer *player = static_cast<VoicemailPlayer *>(userData);
+  int16_t *samples = static_cast<int16_t *>(output);
+  size_t wanted = frameCount * player->channels;
+  size_t got = player->ring->read(samples, wanted);
+  if (got > 0 && !player->heard.load(std::memory_order_relaxed)) {
+    player->firstAudio = std::chrono::steady_clock::now();
+    player->heard.store(true, std::memory_order_release);
+  }
+  // Буфер опустел раньше, чем пришла следующая часть - тишина
+  std::fill(samples + got, samples + wanted, 0);
+  return paContinue;
+}
+
+void VoicemailPlayer::writeSamples(const int16_t *samples, size_t frames,
+                                   std::vector<int16_t> &saved,
+                                   uint64_t &written) {
+  size_t skip = static_cast<size_t>(std::min<uint64_t>(skipFrames, frames));
+  skipFrames -= skip;
+  samples += skip * channels;
+  frames -= skip;
+  frames =
+      static_cast<size_t>(std::min<uint64_t>(frames, totalFrames - written));
+  written += frames;
+
+  size_t count = frames * channels;
+  if (!saveDirectory.empty()) {
+    saved.insert(saved.end(), samples, samples + count);
+  }
+  while (stream != nullptr && count > 0 && !stopping) {
+    size_t stored = ring->write(samples, count);
+    samples += stored;
+    count -= stored;
+    if (count > 0) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(VOICEMAIL_RING_WAIT_MS));
+    }
+  }
+}
+
+void VoicemailPlayer::decodeLoop() {
+  // Самый длинный пакет Opus - 120 мс
+  std::vector<int16_t> pcm(static_cast<size_t>(sampleRate) * channels * 12 /
+                           100);
+  std::vector<int16_t> saved;
+  uint64_t written = 0;
+
+  while (true) {
+    std::vector<uint8_t> chunk;
+    {
+      std::unique_lock<std::mutex> lock(chunksMutex);
+      chunksCondition.wait(
+          lock, [this] { return stopping || finished || !chunks.empty(); });
+      if (stopping || chunks.empty()) {
+        break;
+      }
+      chunk = std::move(chunks.front());
+      chunks.pop_front();
+    }
+
+    if (opusCodec) {
+      // Пакеты с длиной u16, как в контейнере на сервере
+      size_t offset = 0;
+      while (offset + sizeof(uint16_t) <= chunk.size()) {
+        uint16_t netLength;
+        std::memcpy(&netLength, chunk.data() + offset, sizeof(netLength));
+        size_t length = be16toh(netLength);
+        offset += sizeof(netLength);
+        if (offset + length > chunk.size()) {
+          break;
+        }
+        int decoded = opus_decode(decoder, chunk.data() + offset,
+                                  static_cast<opus_int32>(length), pcm.data(),
+                                  static_cast<int>(pcm.size() / channels), 0);
+        offset += length;
+        if (decoded > 0) {
+          writeSamples(pcm.data(), decoded, saved, written);
+        }
+      }
+    } else {
+      size_t count = chunk.size() / sizeof(int16_t);
+      std::vector<int16_t> samples(count);
+      for (size_t i = 0; i < count; ++i) {
+        uint16_t sample;
+        std::memcpy(&sample, chunk.data() + i * sizeof(int16_t),
+                    sizeof(sample));
+        samples[i] = static_cast<int16_t>(le16toh(sample));
+      }
+      writeSamples(samples.data(), count / channels, saved, written);
+    }
+  }
+  if (stopping) {
+    return;
+  }
+
+  // Дожидаемся, пока PortAudio доиграет буфер
+  while (stream != nullptr && ring->available() > 0 && !stopping) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(VOICEMAIL_RING_WAIT_MS));
+  }
+  closeStream();
+  if (heard.load(std::memory_order_acquire)) {
+    std::cout << "Voicemail " << id << ": first audio after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     firstAudio - playbackRequested)
+                     .count()
+              << " ms" << std::endl;
+  }
+  if (!saveDirectory.empty()) {
+    std::string path = saveDirectory + "/" + id + ".wav";
+    std::vector<uint8_t> wav = pcmToWav(saved, sampleRate, channels);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(wav.data()), wav.size());
+    if (file.good()) {
+      std::cout << "Voicemail saved to " << path << ", duration "
+                << static_cast<double>(written) / sampleRate << " seconds"
+                << std::endl;
+    } else {
+      std::cerr << "Error saving audio file " << path << std::endl;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+#include "../include/voicemail_transcoder.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "../include/metrics.hpp"
+
+VoicemailTranscoder::VoicemailTranscoder(BlobStore &blobStore)
+    : blobStore(blobStore) {
+  // Очередь не сохраняется: не перекодированные до остановки ставятся заново
+  for (const std::string &digest : blobStore.untranscodedVoicemails()) {
+    queue.push_back(digest);
+  }
+  worker = std::thread(&VoicemailTranscoder::workerLoop, this);
+}
+
+VoicemailTranscoder::~VoicemailTranscoder() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_all();
+  worker.join();
+}
+
+void VoicemailTranscoder::enqueue(const std::string &digest) {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    recordMetric(Metric::QUEUE_TRANSCODE, queue.size());
+    if (queue.size() >= VOICEMAIL_TRANSCODE_QUEUE_CAPACITY) {
+      ++skipped;
+      return;
+    }
+    queue.push_back(digest);
+  }
+  queueCondition.notify_one();
+}
+
+void VoicemailTranscoder::workerLoop() {
+  while (true) {
+    std::string digest;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+      // Необработанные при остановке остаются в WAV
+      if (stopping) {
+        return;
+      }
+      digest = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    std::string wavPath = blobStore.path(digest);
+    std::error_code ec;
+    uint64_t wavSize = std::filesystem::file_size(wavPath, ec);
+    std::vector<uint8_t> encoded;
+    std::string error;
+    bool ok = !ec && encodeVoicemail(wavPath, encoded, error);
+    if (ok) {
+      std::string tempPath = blobStore.transcodedPath(digest) + ".tmp";
+      std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(encoded.data()),
+                encoded.size());
+      out.close();
+      ok = !out.fail() && blobStore.storeTranscoded(digest, tempPath);
+      if (!ok) {
+        std::remove(tempPath.c_str());
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (ok) {
+      ++transcoded;
+      wavBytes += wavSize;
+      opusBytes += encoded.size();
+    } else {
+      ++skipped;
+    }
+  }
+}
+
+std::string VoicemailTranscoder::stats() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  std::ostringstream oss;
+  oss << "Voicemails transcoded: " << transcoded << ", skipped " << skipped
+      << ", queued " << queue.size() << ", " << wavBytes << " WAV bytes -> "
+      << opusBytes << " Opus bytes";
+  if (opusBytes > 0) {
+    oss << " (" << static_cast<double>(wavBytes) / opusBytes << "x)";
+  }
+  return oss.str();
+}
@@ -0,0 +1,540 @@
+#include <opus/opus.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/mysocket.hpp"
+
+#define LOAD_PASSWORD "Load_Passw0rd"
+#define LOAD_REPLY_TIMEOUT_MS 30000  // Ответ не пришёл - операция с ошибкой
+#define LOAD_VOICE_SAMPLE_RATE 48000
+#define LOAD_VOICE_CHANNELS 2
+#define LOAD_VOICE_FRAMES 480  // 10 мс, как FRAMES_PER_BUFFER клиента
+
+/**
+ * Нагрузочный клиент без интерфейса: каждый пользователь - отдельный поток
+ * с собственным соединением, который говорит с сервером напрямую кадрами
+ * протокола. Пользователь регистрируется (или входит с -L), заходит в
+ * канал и до конца прогона выполняет операции со своей частотой:
+ * /send, /read, голосовые пакеты и загрузку файла. В конце печатается
+ * пропускная способность и процентили задержки по каждой операции.
+ *
+ * Для тысяч пользователей серверу и клиенту нужен лимит открытых файлов
+ * выше 1024 (ulimit -n).
+ */
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 0;
+  int users = 100;
+  double durationSeconds = 30;
+  double connectRate = 200;  // Новых соединений в секунду
+  double sendRate = 1;       // Операций в секунду на пользователя
+  double readRate = 0.2;
+  double voiceRate = 0;
+  double uploadRate = 0;
+  size_t uploadSize = 64 * 1024;
+  std::string channel = "load";
+  std::string prefix;
+  bool existingAccounts = false;
+  bool uploadOnJoin = false;  // Одна загрузка сразу после входа в канал
+  bool strict = false;        // Код выхода 2 при любой ошибке операции
+};
+
+enum Operation {
+  OP_SIGN_UP,
+  OP_LOG_IN,
+  OP_JOIN,
+  OP_SEND,
+  OP_READ,
+  OP_VOICE,
+  OP_UPLOAD,
+  OPERATIONS
+};
+
+const char *operationNames[OPERATIONS] = {"signup", "login", "join", "send",
+                                          "read",   "voice", "upload"};
+
+// Задержки в микросекундах; у каждого потока свои, сливаются в конце
+struct Samples {
+  std::vector<uint32_t> latencies[OPERATIONS];
+  uint64_t errors[OPERATIONS] = {};
+};
+
+std::mutex resultsMutex;
+Samples results;
+std::atomic<int> connectedUsers{0};
+std::atomic<int> failedUsers{0};
+std::vector<uint8_t> voicePacket;  // Один пакет Opus на всех
+
+/**
+ * Соединение одного пользователя. Кадры, не относящиеся к ожидаемому
+ * ответу (рассылка голоса и сообщений канала), читаются и отбрасываются,
+ * чтобы сервер не упирался в заполненный буфер сокета.
+ */
+class LoadUser {
+ public:
+  LoadUser(const Options &options, int index)
+      : options(options),
+        name(options.prefix + "_" + std::to_string(index)),
+        random(index) {}
+
+  void run(std::chrono::steady_clock::time_point startAt,
+           std::chrono::steady_clock::time_point deadline);
+
+ private:
+  const Options &options;
+  std::string name;
+  MySocket socket;
+  uint32_t nextRequestId = 0;
+  std::mt19937 random;
+  Samples samples;
+
+  bool waitFlag(uint32_t flag, Message &reply);
+  bool waitRequest(uint32_t requestId, Message &reply);
+  bool drainUntil(std::chrono::steady_clock::time_point until);
+  bool sendFlag(uint32_t flag, const std::string &text);
+  bool command(const std::string &text, Operation operation);
+  bool signUp();
+  bool logIn();
+  bool finishLogin();
+  bool sendVoice();
+  bool upload();
+  void record(Operation operation,
+              std::chrono::steady_clock::time_point started, bool ok);
+  double nextDelay(double rate);
+};
+
+bool LoadUser::sendFlag(uint32_t flag, const std::string &text) {
+  Message message;
+  message = stringToMessage(text, message);
+  message.header.flag = flag;
+  return socket.sendMessage(message);
+}
+
+// Ждёт кадр с флагом, пропуская остальные
+bool LoadUser::waitFlag(uint32_t flag, Message &reply) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(LOAD_REPLY_TIMEOUT_MS);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (!socket.receiveMessage(reply)) {
+      return false;
+    }
+    if (reply.header.flag == flag && reply.header.type != DataType::VOICE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LoadUser::waitRequest(uint32_t requestId, Message &reply) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(LOAD_REPLY_TIMEOUT_MS);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (!socket.receiveMessage(reply)) {
+      return false;
+    }
+    if (reply.header.requestId == requestId) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Между операциями читаем всё, что присылает сервер
+bool LoadUser::drainUntil(std::chrono::steady_clock::time_point until) {
+  Message message;
+  while (true) {
+    if (socket.hasBufferedInput()) {
+      if (!socket.receiveMessage(message)) {
+        return false;
+      }
+      continue;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= until) {
+      return true;
+    }
+    pollfd descriptor{socket.getSocket(), POLLIN, 0};
+    int timeoutMs = static_cast<int>(
+        std::chrono::ceil<std::chrono::milliseconds>(until - now).count());
+    int ready = poll(&descriptor, 1, timeoutMs);
+    if (ready < 0) {
+      return false;
+    }
+    if (ready > 0 && !socket.receiveMessage(message)) {
+      return false;
+    }
+  }
+}
+
+void LoadUser::record(Operation operation,
+                      std::chrono::steady_clock::time_point started, bool ok) {
+  if (!ok) {
+    ++samples.errors[operation];
+    return;
+  }
+  samples.latencies[operation].push_back(static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - started)
+          .count()));
+}
+
+// Экспоненциальные интервалы: операции разных пользователей не совпадают
+double LoadUser::nextDelay(double rate) {
+  if (rate <= 0) {
+    return INFINITY;
+  }
+  return std::exponential_distribution<double>(rate)(random);
+}
+
+// ID и токен сессии после пароля, как у интерактивного клиента
+bool LoadUser::finishLogin() {
+  Message reply;
+  if (!sendFlag(Flags::CHECK_ID, "id") || !waitFlag(Flags::ID, reply)) {
+    return false;
+  }
+  std::string id(reply.body.begin(), reply.body.end());
+  return sendFlag(Flags::ID, id) && waitFlag(Flags::ID_CORRECT, reply);
+}
+
+bool LoadUser::signUp() {
+  Message reply;
+  return sendFlag(Flags::LOGIN_SIGN_UP, name) &&
+         waitFlag(Flags::CHECK_LOGIN, reply) &&
+         sendFlag(Flags::PASSWORD_SIGN_UP, LOAD_PASSWORD) &&
+         waitFlag(Flags::CHECK_PASSWORD, reply) &&
+         sendFlag(Flags::NICK, name) && waitFlag(Flags::REGISTERED, reply) &&
+         finishLogin();
+}
+
+bool LoadUser::logIn() {
+  Message reply;
+  return sendFlag(Flags::LOGIN_LOG_IN, name) &&
+         waitFlag(Flags::CHECK_LOGIN, reply) &&
+         sendFlag(Flags::PASSWORD_LOG_IN, LOAD_PASSWORD) &&
+         waitFlag(Flags::AUTHORIZED, reply) && finishLogin();
+}
+
+// Команда с номером запроса: ответ находится по тому же номеру
+bool LoadUser::command(const std::string &text, Operation operation) {
+  Message message;
+  message = stringToMessage(text, message);
+  message.header.requestId = ++nextRequestId;
+  auto started = std::chrono::steady_clock::now();
+  Message reply;
+  // Отказ по лимиту сервера - ошибка операции
+  bool ok = socket.sendMessage(message) &&
+            waitRequest(message.header.requestId, reply) &&
+            reply.header.flag != Flags::THROTTLED;
+  record(operation, started, ok);
+  return ok;
+}
+
+// Ответа на голос нет: задержка - время отправки
+bool LoadUser::sendVoice() {
+  AudioPacket packet;
+  packet.timestamp = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  packet.opus_length = static_cast<int>(voicePacket.size());
+  std::copy(voicePacket.begin(), voicePacket.end(), packet.opus_data);
+  Message message;
+  message.setVoiceMessage(packet, options.channel);
+  auto started = std::chrono::steady_clock::now();
+  bool ok = socket.sendMessage(message);
+  record(OP_VOICE, started, ok);
+  return ok;
+}
+
+// Загрузка по частям целиком, от UPLOAD_BEGIN до UPLOAD_END сервера
+bool LoadUser::upload() {
+  auto started = std::chrono::steady_clock::now();
+  std::vector<uint8_t> data(options.uploadSize);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(random());
+  }
+  Message reply;
+  bool ok = sendFlag(Flags::UPLOAD_BEGIN,
+                     "file\n" + options.channel + "\n" + name + ".bin\n" +
+                         std::to_string(data.size()) + "\n0") &&
+            waitFlag(Flags::UPLOAD_ACK, reply);
+  if (ok) {
+    uint64_t uploadId = std::strtoull(
+        std::string(reply.body.begin(), reply.body.end()).c_str(), nullptr,
+        10);
+    Message chunk;
+    for (uint64_t offset = 0; ok && offset < data.size();
+         offset += UPLOAD_CHUNK_SIZE) {
+      size_t size = static_cast<size_t>(
+          std::min<uint64_t>(UPLOAD_CHUNK_SIZE, data.size() - offset));
+      chunk.setUploadChunk(uploadId, offset, data.data() + offset, size);
+      ok = socket.sendMessage(chunk);
+    }
+    ok = ok && sendFlag(Flags::UPLOAD_END, std::to_string(uploadId)) &&
+         waitFlag(Flags::UPLOAD_END, reply);
+  }
+  record(OP_UPLOAD, started, ok);
+  return ok;
+}
+
+void LoadUser::run(std::chrono::steady_clock::time_point startAt,
+                   std::chrono::steady_clock::time_point deadline) {
+  std::this_thread::sleep_until(startAt);
+  bool ok = socket.createSocket() &&
+            socket.connectSocket(options.host, options.port);
+  if (ok) {
+    // Сервер не отвечает на неверный логин: без тайм-аута поток зависнет
+    timeval timeout{LOAD_REPLY_TIMEOUT_MS / 1000, 0};
+    setsockopt(socket.getSocket(), SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+    Operation operation =
+        options.existingAccounts ? OP_LOG_IN : OP_SIGN_UP;
+    auto started = std::chrono::steady_clock::now();
+    ok = options.existingAccounts ? logIn() : signUp();
+    record(operation, started, ok);
+  }
+  ok = ok && command("/join " + options.channel, OP_JOIN);
+  if (ok && options.uploadOnJoin) {
+    ok = upload();
+  }
+  if (!ok) {
+    ++failedUsers;
+  } else {
+    ++connectedUsers;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  const double rates[OPERATIONS] = {0,
+                                    0,
+                                    0,
+                                    options.sendRate,
+                                    options.readRate,
+                                    options.voiceRate,
+                                    options.uploadRate};
+  Clock::time_point due[OPERATIONS];
+  auto schedule = [&](int operation, Clock::time_point from) {
+    double delay = nextDelay(rates[operation]);
+    due[operation] =
+        std::isinf(delay)
+            ? Clock::time_point::max()
+            : from + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(delay));
+  };
+  auto now = Clock::now();
+  for (int operation = OP_SEND; operation < OPERATIONS; ++operation) {
+    schedule(operation, now);
+  }
+
+  uint64_t sent = 0;
+  while (ok) {
+    int operation = static_cast<int>(
+        std::min_element(due + OP_SEND, due + OPERATIONS) - due);
+    Clock::time_point at = std::min(due[operation], deadline);
+    if (!drainUntil(at) || at >= deadline) {
+      break;
+    }
+    switch (operation) {
+      case OP_SEND:
+        ok = command("/send " + options.channel + " " + name + " message " +
+                         std::to_string(++sent),
+                     OP_SEND);
+        break;
+      case OP_READ:
+        ok = command("/read " + options.channel, OP_READ);
+        break;
+      case OP_VOICE:
+        ok = sendVoice();
+        break;
+      case OP_UPLOAD:
+        ok = upload();
+        break;
+    }
+    schedule(operation, due[operation]);
+  }
+  socket.closeSocket();
+
+  std::lock_guard<std::mutex> lock(resultsMutex);
+  for (int operation = 0; operation < OPERATIONS; ++operation) {
+    results.latencies[operation].insert(results.latencies[operation].end(),
+                                        samples.latencies[operation].begin(),
+                                        samples.latencies[operation].end());
+    results.errors[operation] += samples.errors[operation];
+  }
+}
+
+// Пакет Opus из синусоиды, кодируется один раз до старта
+bool encodeVoicePacket() {
+  int error;
+  OpusEncoder *encoder =
+      opus_encoder_create(LOAD_VOICE_SAMPLE_RATE, LOAD_VOICE_CHANNELS,
+                          OPUS_APPLICATION_VOIP, &error);
+  if (error != OPUS_OK) {
+    std::cerr << "Failed to create Opus encoder: " << opus_strerror(error)
+              << std::endl;
+    return false;
+  }
+  std::vector<opus_int16> pcm(LOAD_VOICE_FRAMES * LOAD_VOICE_CHANNELS);
+  for (size_t i = 0; i < pcm.size(); ++i) {
+    pcm[i] = static_cast<opus_int16>(
+        8000 * std::sin(2 * M_PI * 440 * (i / LOAD_VOICE_CHANNELS) /
+                        LOAD_VOICE_SAMPLE_RATE));
+  }
+  voicePacket.resize(OPUS_MAX_PACKET_SIZE);
+  opus_int32 length =
+      opus_encode(encoder, pcm.data(), LOAD_VOICE_FRAMES, voicePacket.data(),
+                  static_cast<opus_int32>(voicePacket.size()));
+  opus_encoder_destroy(encoder);
+  if (length < 0) {
+    std::cerr << "Opus encode failed: " << opus_strerror(length) << std::endl;
+    return false;
+  }
+  voicePacket.resize(length);
+  return true;
+}
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void printReport(double seconds) {
+  std::cout << "users connected: " << connectedUsers
+            << ", failed: " << failedUsers << ", run " << std::fixed
+            << std::setprecision(1) << seconds << " s" << std::endl;
+  std::cout << std::setw(8) << "op" << std::setw(10) << "count"
+            << std::setw(8) << "errors" << std::setw(10) << "ops/s"
+            << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+            << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms"
+            << std::setw(10) << "max ms" << std::endl;
+  for (int operation = 0; operation < OPERATIONS; ++operation) {
+    std::vector<uint32_t> &latencies = results.latencies[operation];
+    if (latencies.empty() && results.errors[operation] == 0) {
+      continue;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(8) << operationNames[operation] << std::setw(10)
+              << latencies.size() << std::setw(8) << results.errors[operation]
+              << std::setprecision(1) << std::setw(10)
+              << latencies.size() / seconds << std::setprecision(3);
+    for (double fraction : {0.5, 0.9, 0.99, 0.999, 1.0}) {
+      std::cout << std::setw(10) << percentile(latencies, fraction) / 1000.0;
+    }
+    std::cout << std::endl;
+  }
+}
+
+void usage(const char *program) {
+  std::cerr
+      << "Usage: " << program << " -p <port> [options]\n"
+      << "  -a <host>      server address (127.0.0.1)\n"
+      << "  -u <users>     concurrent users (100)\n"
+      << "  -d <seconds>   run time after the last user connects (30)\n"
+      << "  -c <rate>      new connections per second (200)\n"
+      << "  -s <rate>      /send per user per second (1)\n"
+      << "  -r <rate>      /read per user per second (0.2)\n"
+      << "  -v <rate>      voice packets per user per second (0)\n"
+      << "  -f <rate>      file uploads per user per second (0)\n"
+      << "  -z <bytes>     upload size (65536)\n"
+      << "  -n <channel>   channel to join (load)\n"
+      << "  -x <prefix>    account name prefix (load<pid>)\n"
+      << "  -L             log in to accounts made by an earlier run with -x\n"
+      << "  -o             upload one file of -z bytes right after joining\n"
+      << "  -e             exit with status 2 if any operation failed\n";
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  options.prefix = "load" + std::to_string(getpid());
+  int option;
+  while ((option = getopt(argc, argv, "a:p:u:d:c:s:r:v:f:z:n:x:Loeh")) != -1) {
+    switch (option) {
+      case 'a': options.host = optarg; break;
+      case 'p': options.port = std::atoi(optarg); break;
+      case 'u': options.users = std::atoi(optarg); break;
+      case 'd': options.durationSeconds = std::atof(optarg); break;
+      case 'c': options.connectRate = std::atof(optarg); break;
+      case 's': options.sendRate = std::atof(optarg); break;
+      case 'r': options.readRate = std::atof(optarg); break;
+      case 'v': options.voiceRate = std::atof(optarg); break;
+      case 'f': options.uploadRate = std::atof(optarg); break;
+      case 'z': options.uploadSize = std::strtoull(optarg, nullptr, 10); break;
+      case 'n': options.channel = optarg; break;
+      case 'x': options.prefix = optarg; break;
+      case 'L': options.existingAccounts = true; break;
+      case 'o': options.uploadOnJoin = true; break;
+      case 'e': options.strict = true; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (options.port <= 0 || options.users <= 0 || options.connectRate <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (options.voiceRate > 0 && !encodeVoicePacket()) {
+    return 1;
+  }
+
+  // По сокету на пользователя
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto rampUp = std::chrono::duration<double>(options.users /
+                                              options.connectRate);
+  auto deadline =
+      start +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          rampUp + std::chrono::duration<double>(options.durationSeconds));
+
+  std::vector<std::unique_ptr<LoadUser>> users;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.users; ++i) {
+    users.push_back(std::make_unique<LoadUser>(options, i));
+    auto startAt =
+        start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(i / options.connectRate));
+    threads.emplace_back(&LoadUser::run, users.back().get(), startAt, deadline);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  printReport(std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count());
+  if (failedUsers == options.users) {
+    return 1;
+  }
+  if (options.strict) {
+    for (uint64_t errors : results.errors) {
+      if (errors != 0) {
+        return 2;
+      }
+    }
+  }
+  return 0;
+}